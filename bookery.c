@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +11,13 @@
 #include <openssl/evp.h>
 
 #include "lib/user.h"
+#include "lib/audit.h"
+#include "lib/server.h"
+#include "lib/stats.h"
+#include "lib/snapshot.h"
+#include "lib/chain.h"
+#include "lib/changes.h"
+#include "lib/memory.h"
 
 void friendlyCLI();
 
@@ -17,22 +26,32 @@ void friendlyCLI();
  * 
  * @details This function initializes the books, users, and rents tables in the database if they do not already exist.
  * 
- * @param None.
+ * @param database The open database connection.
  * 
  * @return An integer representing the status of the operation:
  *         - 0: If the operation was successful.
  *         - Non-zero: If an error occurred during initialization.
  */
-int initializeDatabase() {
-    sqlite3 *db;
+int initializeDatabase(struct Database *database) {
+    sqlite3 *db = database->db;
     char *errMsg = 0;
     int return_code;
 
-    // Open database connection.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
+    // SQL statement to create the authors and genres tables, each name stored once.
+    const char *sql_names = "CREATE TABLE IF NOT EXISTS authors ("
+                            "id INTEGER PRIMARY KEY,"
+                            "name TEXT NOT NULL UNIQUE"
+                            ");"
+                            "CREATE TABLE IF NOT EXISTS genres ("
+                            "id INTEGER PRIMARY KEY,"
+                            "name TEXT NOT NULL UNIQUE"
+                            ");";
+
+    // Execute SQL statement to create the authors and genres tables.
+    return_code = sqlite3_exec(db, sql_names, 0, 0, &errMsg);
     if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+        fprintf(stderr, "SQL error: %s\n", errMsg);
+        sqlite3_free(errMsg);
         return return_code;
     }
 
@@ -40,8 +59,8 @@ int initializeDatabase() {
     const char *sql_books = "CREATE TABLE IF NOT EXISTS books ("
                             "id INTEGER PRIMARY KEY AUTOINCREMENT,"
                             "title TEXT NOT NULL,"
-                            "author TEXT NOT NULL,"
-                            "genre TEXT,"
+                            "author_id INTEGER NOT NULL REFERENCES authors (id),"
+                            "genre_id INTEGER REFERENCES genres (id),"
                             "price REAL,"
                             "quantity_available INTEGER,"   
                             "quantity_rented INTEGER,"
@@ -58,13 +77,38 @@ int initializeDatabase() {
         // return return_code;
     }
 
+    // Move the author and genre names of books tables created before they had their own tables.
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, "SELECT author, genre FROM books;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        const char *sql_migrate = "BEGIN;"
+                                  "INSERT OR IGNORE INTO authors (name) SELECT DISTINCT author FROM books;"
+                                  "INSERT OR IGNORE INTO genres (name) SELECT DISTINCT COALESCE(genre, '') FROM books;"
+                                  "ALTER TABLE books ADD COLUMN author_id INTEGER REFERENCES authors (id);"
+                                  "ALTER TABLE books ADD COLUMN genre_id INTEGER REFERENCES genres (id);"
+                                  "UPDATE books SET author_id = (SELECT id FROM authors WHERE name = books.author),"
+                                  "genre_id = (SELECT id FROM genres WHERE name = COALESCE(books.genre, ''));"
+                                  "ALTER TABLE books DROP COLUMN author;"
+                                  "ALTER TABLE books DROP COLUMN genre;"
+                                  "COMMIT;";
+        return_code = sqlite3_exec(db, sql_migrate, 0, 0, &errMsg);
+        if (return_code != SQLITE_OK) {
+            fprintf(stderr, "SQL error: %s\n", errMsg);
+            sqlite3_free(errMsg);
+            sqlite3_exec(db, "ROLLBACK;", 0, 0, 0);
+            return return_code;
+        }
+    }
+
     // SQL statement to create users table.
     const char *sql_users = "CREATE TABLE IF NOT EXISTS users ("
                             "id INTEGER PRIMARY KEY AUTOINCREMENT,"
                             "username TEXT NOT NULL,"
                             "password TEXT NOT NULL,"
                             "email TEXT NOT NULL,"
-                            "role INTEGER NOT NULL" 
+                            "role INTEGER NOT NULL," 
+                            "salt TEXT,"
+                            "cost INTEGER NOT NULL DEFAULT 0"
                             ");";
 
     // Execute SQL statement to create users table.
@@ -75,6 +119,51 @@ int initializeDatabase() {
         // return return_code;
     }
 
+    // Add the salt and cost columns to users tables created before passwords were salted.
+    if (sqlite3_prepare_v2(db, "SELECT salt, cost FROM users;", -1, &stmt, NULL) == SQLITE_OK) {
+        sqlite3_finalize(stmt);
+    } else {
+        sqlite3_exec(db, "ALTER TABLE users ADD COLUMN salt TEXT;", 0, 0, 0);
+        sqlite3_exec(db, "ALTER TABLE users ADD COLUMN cost INTEGER NOT NULL DEFAULT 0;", 0, 0, 0);
+    }
+
+    // Usernames identify accounts at login, so they must be unique and indexed.
+    return_code = sqlite3_exec(db, "CREATE UNIQUE INDEX IF NOT EXISTS users_username ON users (username);", 0, 0, &errMsg);
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errMsg);
+        fprintf(stderr, "Remove duplicate usernames so logins can use the username index.\n");
+        sqlite3_free(errMsg);
+    }
+
+    // SQL statement to create settings table.
+    const char *sql_settings = "CREATE TABLE IF NOT EXISTS settings ("
+                               "name TEXT PRIMARY KEY,"
+                               "value INTEGER NOT NULL"
+                               ");";
+
+    // Execute SQL statement to create settings table.
+    return_code = sqlite3_exec(db, sql_settings, 0, 0, &errMsg);
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errMsg);
+        sqlite3_free(errMsg);
+        return return_code;
+    }
+
+    // SQL statement to create sessions table, holding the hash of every live session token.
+    const char *sql_sessions = "CREATE TABLE IF NOT EXISTS sessions ("
+                               "token TEXT PRIMARY KEY,"
+                               "username TEXT NOT NULL,"
+                               "expires INTEGER NOT NULL"
+                               ");";
+
+    // Execute SQL statement to create sessions table.
+    return_code = sqlite3_exec(db, sql_sessions, 0, 0, &errMsg);
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errMsg);
+        sqlite3_free(errMsg);
+        return return_code;
+    }
+
     // SQL statement to create rents table.
     const char *sql_rents = "CREATE TABLE IF NOT EXISTS rents ("
                             "id INTEGER PRIMARY KEY AUTOINCREMENT,"
@@ -95,8 +184,93 @@ int initializeDatabase() {
         return return_code;
     }
 
-    // Close database connection.
-    sqlite3_close(db);
+    // Indexes for the lookups of sales, rents, overdue rents and expired sessions; tests/plan.c
+    // fails if one of these statements goes back to scanning its table.
+    const char *sql_indexes = "CREATE INDEX IF NOT EXISTS books_title ON books (title);"
+                              "CREATE INDEX IF NOT EXISTS rents_return_date ON rents (return_date);"
+                              "CREATE INDEX IF NOT EXISTS sessions_expires ON sessions (expires);";
+
+    // Execute SQL statement to create the indexes.
+    return_code = sqlite3_exec(db, sql_indexes, 0, 0, &errMsg);
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errMsg);
+        sqlite3_free(errMsg);
+        return return_code;
+    }
+
+    // Log the changes of books, rents and users for head office.
+    return_code = createChangeLog(db);
+    if (return_code != SQLITE_OK) {
+        return return_code;
+    }
+
+    // Every change of this process goes through this connection; keep the book catalog in step with it.
+    watchCatalog(database);
+
+    // Same for the queue of open rentals, read in full now.
+    watchRentals(database);
+    if (!syncRentals(database)) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        return SQLITE_ERROR;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the shop database once for the lifetime of the process and creates missing tables.
+ *
+ * @return 0 on success, non-zero otherwise.
+ */
+int openShop() {
+    if (openDatabase(&shopDatabase, databaseName, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI) != SQLITE_OK) {
+        return 1;
+    }
+    if (memoryMode && loadMemoryDatabase(&shopDatabase) != SQLITE_OK) {
+        return 1;
+    }
+    if (initializeDatabase(&shopDatabase) != 0) {
+        fprintf(stderr, "Failed to initialize database.\n");
+        return 1;
+    }
+    attachStores(shopDatabase.db);
+    if (memoryMode && startSnapshots() != SQLITE_OK) {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the shop database read-only for reporting, so heavy reports run in their own
+ *        process without ever taking the write lock the tills need.
+ *
+ * @details The live database is opened with SQLITE_OPEN_READONLY and query_only; in WAL mode its
+ *          readers never block the writer. A snapshot copy is opened immutable as well: SQLite
+ *          then takes no locks at all and never checks the file for changes.
+ *
+ * @param snapshot Path of a snapshot copy of the database, or NULL for the live database.
+ *
+ * @return 0 on success, non-zero otherwise.
+ */
+int openReport(const char *snapshot) {
+    char uri[1024];
+    const char *path = databaseFile;
+
+    if (snapshot != NULL) {
+        databaseUri(uri, sizeof(uri), snapshot, "immutable=1");
+        path = uri;
+    }
+
+    if (openDatabase(&shopDatabase, path, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI) != SQLITE_OK) {
+        return 1;
+    }
+    attachStores(shopDatabase.db);
+    if (sqlite3_exec(shopDatabase.db, "PRAGMA query_only=1;", 0, 0, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(shopDatabase.db));
+        return 1;
+    }
+    watchCatalog(&shopDatabase);
+    watchRentals(&shopDatabase);
+    reportingMode = true;
     return 0;
 }
 
@@ -105,61 +279,45 @@ int initializeDatabase() {
 
 /**
  *@brief Generate a sales report including top 5 books and total revenue.
- *@param None.
- *@return void.
+ *@param session The session running the command.
+ *@return True on success, false if a query failed.
 */
-void generateSalesReport() {
-    sqlite3 *db;  // SQLite database object.
-    sqlite3_stmt *stmt;  // SQLite statement object.
-    int return_code;  // Return code for SQLite functions.
-
-    // Open the database connection.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
+bool execSalesReport(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
     // Print header for the sales report.
-    printf("\n%s************ Sales Report ************%s\n\n",PINK,RESET);
-    printf("\n%s********* Top 5 Books *********%s\n",YELLOW,RESET);
+    fprintf(out, "\n%s************ Sales Report ************%s\n\n",PINK,RESET);
+    fprintf(out, "\n%s********* Top 5 Books *********%s\n",YELLOW,RESET);
 
-    // SQL query to retrieve top 5 books based on quantity sold.
-    const char *sql = "SELECT title, author, genre, price, quantity_available, quantity_rented, quantity_sold FROM books ORDER BY quantity_sold DESC LIMIT 5;";
-    const char *sql2 = "SELECT price, quantity_sold FROM books;";  // SQL query to retrieve price and quantity sold for all books.
-
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Top 5 books based on quantity sold, from the resident catalog.
+    if (!readCatalog(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    int top[5];
+    int count = topCatalogBooks(catalog.sold, top, 5);
 
     // Calculate maximum widths for each column.
     int max_title_width = 0;
     int max_author_width = 0;
     int max_genre_width = 0;
-    double max_price = 0.0;
-    int max_qty_sold = 0;
 
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 0)));
-        max_author_width = fmax(max_author_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        max_genre_width = fmax(max_genre_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
-        max_price = fmax(max_price, sqlite3_column_double(stmt, 3));
-        max_qty_sold = fmax(max_qty_sold, sqlite3_column_int(stmt, 6));
+    for (int i = 0; i < count; i++) {
+        max_title_width = fmax(max_title_width, (int)strlen(catalogTitle(top[i])));
+        max_author_width = fmax(max_author_width, (int)strlen(catalogAuthor(top[i])));
+        max_genre_width = fmax(max_genre_width, (int)strlen(catalogGenre(top[i])));
     }
 
     // Print horizontal separator line.
-    printf("%s", BLUE);
+    fprintf(out, "%s", BLUE);
     for (int i = 0; i < (max_title_width + max_author_width + max_genre_width + 53); i++) {
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n", RESET);
+    fprintf(out, "%s\n", RESET);
 
     // Print column headers.
-    printf("%s%-*s | %-*s | %-*s | %-10s | %-13s | %-13s | %s\n",
+    fprintf(out, "%s%-*s | %-*s | %-*s | %-10s | %-13s | %-13s | %s\n",
            BLUE,
            max_title_width, "Title",
            max_author_width, "Author",
@@ -170,114 +328,96 @@ void generateSalesReport() {
            RESET);
 
     // Print horizontal separator line.
-    printf("%s", BLUE);
+    fprintf(out, "%s", BLUE);
     for (int i = 0; i < (max_title_width + max_author_width + max_genre_width + 53); i++) {
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n", RESET);
+    fprintf(out, "%s\n", RESET);
 
     // Print sales report data.
-    sqlite3_reset(stmt); // Reset the statement to re-execute.
     float totalRevenueTop_5 = 0;
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        const char *title = (const char *)sqlite3_column_text(stmt, 0);
-        const char *author = (const char *)sqlite3_column_text(stmt, 1);
-        const char *genre = (const char *)sqlite3_column_text(stmt, 2);
-        double price = sqlite3_column_double(stmt, 3);
-        int quantitySold = sqlite3_column_int(stmt, 6);
+    for (int i = 0; i < count; i++) {
+        double price = catalog.prices[top[i]];
+        int quantitySold = catalog.sold[top[i]];
         float revenue = price * quantitySold;
-        printf("%-*s | %-*s | %-*s | $%-9.2f | %-13d | $%-12.2f |\n",
-               max_title_width, title,
-               max_author_width, author,
-               max_genre_width, genre,
+        fprintf(out, "%-*s | %-*s | %-*s | $%-9.2f | %-13d | $%-12.2f |\n",
+               max_title_width, catalogTitle(top[i]),
+               max_author_width, catalogAuthor(top[i]),
+               max_genre_width, catalogGenre(top[i]),
                price,
                quantitySold,
                revenue);
         totalRevenueTop_5 += revenue;
         for (int i = 0; i < (max_title_width + max_author_width + max_genre_width + 53); i++) {
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
 
+    // Total revenue for all books, straight down the price and quantity columns.
     float totalRevenue = 0;
-
-    // Retrieve total revenue for all books.
-    return_code = sqlite3_prepare_v2(db, sql2, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-       totalRevenue+= sqlite3_column_double(stmt, 0) * sqlite3_column_int(stmt, 1);
+    for (int i = 0; i < catalog.count; i++) {
+        totalRevenue += catalog.prices[i] * catalog.sold[i];
     }
+    releaseCatalog();
 
     // Print total revenue.
-    printf("\n%s*********** Revenue ***********%s\n\n",YELLOW,RESET);
-    printf("Total Revenue of Top 5: %s$%.2f%s\n",GREEN, totalRevenueTop_5,RESET);
-    printf("Total Revenue of All:   %s$%.2f%s\n\n",GREEN, totalRevenue,RESET);
+    fprintf(out, "\n%s*********** Revenue ***********%s\n\n",YELLOW,RESET);
+    fprintf(out, "Total Revenue of Top 5: %s$%.2f%s\n",GREEN, totalRevenueTop_5,RESET);
+    fprintf(out, "Total Revenue of All:   %s$%.2f%s\n\n",GREEN, totalRevenue,RESET);
+    return true;
+}
 
-    sqlite3_finalize(stmt);  // Finalize the statement.
-    sqlite3_close(db);  // Close the database connection.
+/**
+ *@brief Generate a sales report including top 5 books and total revenue.
+ *@param None.
+ *@return void.
+*/
+void generateSalesReport() {
+    submitRequest("report sales");
 }
 
 /**
   @brief Generate a rental report including top 5 rented books.
-  @param None.
-  @return void.
+  @param session The session running the command.
+  @return True on success, false if the query failed.
 */
-void generateRentalReport() {
-    sqlite3 *db;  // SQLite database object.
-    sqlite3_stmt *stmt;  // SQLite statement object.
-    int return_code;  // Return code for SQLite functions.
-
-    // Open the database connection.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
+bool execRentalReport(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
     // Print header for the rental report.
-    printf("\n%s*********** Rental Report ************%s\n\n",PINK,RESET);
-    printf("\n%s******* Top 5 Rented Books *********%s\n",YELLOW,RESET);
+    fprintf(out, "\n%s*********** Rental Report ************%s\n\n",PINK,RESET);
+    fprintf(out, "\n%s******* Top 5 Rented Books *********%s\n",YELLOW,RESET);
 
-    // SQL query to retrieve top 5 rented books based on total quantity rented.
-    const char *sql = "SELECT title, author, genre, quantity_rented_all, quantity_rented_days FROM books ORDER BY quantity_rented_all DESC LIMIT 5;";
-
-    // Prepare the SQL statement.
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Top 5 rented books based on total quantity rented, from the resident catalog.
+    if (!readCatalog(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    int top[5];
+    int count = topCatalogBooks(catalog.rentedAll, top, 5);
 
     // Calculate maximum widths for each column.
     int max_title_width = 0;
     int max_author_width = 0;
     int max_genre_width = 0;
-    int max_qty_rented = 0;
 
-    // Iterate over the result set to find maximum widths.
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 0)));
-        max_author_width = fmax(max_author_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        max_genre_width = fmax(max_genre_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
-        max_qty_rented = fmax(max_qty_rented, sqlite3_column_double(stmt, 5));
+    for (int i = 0; i < count; i++) {
+        max_title_width = fmax(max_title_width, (int)strlen(catalogTitle(top[i])));
+        max_author_width = fmax(max_author_width, (int)strlen(catalogAuthor(top[i])));
+        max_genre_width = fmax(max_genre_width, (int)strlen(catalogGenre(top[i])));
     }
 
     // Print horizontal separator line.
-    printf("%s", BLUE);
+    fprintf(out, "%s", BLUE);
     for (int i = 0; i < (max_title_width + max_author_width + max_genre_width + 53); i++) {
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n", RESET);
+    fprintf(out, "%s\n", RESET);
 
     // Print column headers.
-    printf("%s%-*s | %-*s | %-*s | %-13s | %-14s |%s\n",
+    fprintf(out, "%s%-*s | %-*s | %-*s | %-13s | %-14s |%s\n",
            BLUE,
            max_title_width, "Title",
            max_author_width, "Author",
@@ -287,39 +427,584 @@ void generateRentalReport() {
            RESET);
 
     // Print horizontal separator line.
-    printf("%s", BLUE);
+    fprintf(out, "%s", BLUE);
     for (int i = 0; i < (max_title_width + max_author_width + max_genre_width + 53); i++) {
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n", RESET);
+    fprintf(out, "%s\n", RESET);
 
-    float totalRevenue;
+    float totalRevenue = 0;
     // Print rental report data.
-    sqlite3_reset(stmt); // Reset the statement to re-execute.
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        const char *title = (const char *)sqlite3_column_text(stmt, 0);
-        const char *author = (const char *)sqlite3_column_text(stmt, 1);
-        const char *genre = (const char *)sqlite3_column_text(stmt, 2);
-        int quantityRentedAll = sqlite3_column_int(stmt, 3);
-        int quantityRentedDays = sqlite3_column_int(stmt, 4);
-        printf("%-*s | %-*s | %-*s | %-19d | %-20d |\n",
-               max_title_width, title,
-               max_author_width, author,
-               max_genre_width, genre,
+    for (int i = 0; i < count; i++) {
+        int quantityRentedAll = catalog.rentedAll[top[i]];
+        int quantityRentedDays = catalog.rentedDays[top[i]];
+        fprintf(out, "%-*s | %-*s | %-*s | %-19d | %-20d |\n",
+               max_title_width, catalogTitle(top[i]),
+               max_author_width, catalogAuthor(top[i]),
+               max_genre_width, catalogGenre(top[i]),
                quantityRentedAll,
-               quantityRentedDays);     
+               quantityRentedDays);
         totalRevenue+=quantityRentedDays;
         for (int i = 0; i < (max_title_width + max_author_width + max_genre_width + 53); i++) {
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
+    releaseCatalog();
+
     // Print total revenue.
-    printf("\n%s*********** Revenue ***********%s\n\n",YELLOW,RESET);
-    printf("Total Revenue of All:   %s$%.2f%s\n\n",GREEN, totalRevenue,RESET);
+    fprintf(out, "\n%s*********** Revenue ***********%s\n\n",YELLOW,RESET);
+    fprintf(out, "Total Revenue of All:   %s$%.2f%s\n\n",GREEN, totalRevenue,RESET);
+    return true;
+}
+
+/**
+  @brief Generate a rental report including top 5 rented books.
+  @param None.
+  @return void.
+*/
+void generateRentalReport() {
+    submitRequest("report rents");
+}
+
+/**
+  @brief Prints the top 5 of a chain report, by copies sold or by copies rented.
+  @param out    Stream of the report.
+  @param chain  The merged books of every branch.
+  @param rented Whether to rank and show rentals rather than sales.
+  @return Revenue or days rented of the top 5.
+*/
+double printChainTop(FILE *out, const struct Chain *chain, bool rented) {
+    int top[5];
+    int count = topChainBooks(chain, rented ? offsetof(struct ChainBook, rentedAll) : offsetof(struct ChainBook, sold), top, 5);
+    double total = 0;
+
+    // Calculate maximum widths for each column.
+    int max_title_width = 5;
+    int max_author_width = 6;
+    int max_genre_width = 5;
+
+    for (int i = 0; i < count; i++) {
+        max_title_width = fmax(max_title_width, (int)chain->books[top[i]].title->length);
+        max_author_width = fmax(max_author_width, (int)chain->books[top[i]].author->length);
+        max_genre_width = fmax(max_genre_width, (int)chain->books[top[i]].genre->length);
+    }
+    int width = max_title_width + max_author_width + max_genre_width + (rented ? 53 : 40);
+
+    fprintf(out, "%s", BLUE);
+    for (int i = 0; i < width; i++) {
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n", RESET);
+    if (rented) {
+        fprintf(out, "%s%-*s | %-*s | %-*s | %-13s | %-14s |%s\n", BLUE, max_title_width, "Title", max_author_width, "Author",
+                max_genre_width, "Genre", "Quantity Rented All", "Quantity Rented Days", RESET);
+    } else {
+        fprintf(out, "%s%-*s | %-*s | %-*s | %-13s | %-13s |%s\n", BLUE, max_title_width, "Title", max_author_width, "Author",
+                max_genre_width, "Genre", "Quantity Sold", "Revenue", RESET);
+    }
+    fprintf(out, "%s", BLUE);
+    for (int i = 0; i < width; i++) {
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n", RESET);
+
+    for (int i = 0; i < count; i++) {
+        const struct ChainBook *book = &chain->books[top[i]];
+        if (rented) {
+            fprintf(out, "%-*s | %-*s | %-*s | %-19d | %-20d |\n", max_title_width, book->title->data, max_author_width,
+                    book->author->data, max_genre_width, book->genre->data, book->rentedAll, book->rentedDays);
+            total += book->rentedDays;
+        } else {
+            fprintf(out, "%-*s | %-*s | %-*s | %-13d | $%-12.2f |\n", max_title_width, book->title->data, max_author_width,
+                    book->author->data, max_genre_width, book->genre->data, book->sold, book->revenue);
+            total += book->revenue;
+        }
+        for (int i = 0; i < width; i++) {
+            fprintf(out, "-");
+        }
+        fprintf(out, "\n");
+    }
+    return total;
+}
+
+/**
+  @brief Generate the sales report of a chain of branches: every branch database is read at once,
+         each on its own thread, and their books are merged by title before taking the top 5.
+  @param session The session running the command.
+  @param list Comma separated database files of the branches; wildcards are expanded.
+  @return True if every branch could be read.
+*/
+bool execChainSalesReport(struct Session *session, const char *list) {
+    FILE *out = session->out;
+    struct Chain chain;
+    struct Branch *branches;
+
+    fprintf(out, "\n%s********* Chain Sales Report *********%s\n\n",PINK,RESET);
+    int count = readChain(out, list, &chain, &branches);
+    if (count == 0) {
+        fprintf(out, "%sNo branch files given.%s\n", RED, RESET);
+        freeChain(&chain, branches, count);
+        return false;
+    }
+
+    fprintf(out, "\n%s********* Top 5 Books *********%s\n",YELLOW,RESET);
+    double totalRevenueTop_5 = printChainTop(out, &chain, false);
+
+    fprintf(out, "\n%s*********** Revenue ***********%s\n\n",YELLOW,RESET);
+    fprintf(out, "Total Revenue of Top 5: %s$%.2f%s\n",GREEN, totalRevenueTop_5,RESET);
+    fprintf(out, "Total Revenue of All:   %s$%.2f%s\n",GREEN, chain.revenue,RESET);
+    printChainTimes(out, &chain, count);
+
+    bool ok = chain.branches == count;
+    freeChain(&chain, branches, count);
+    return ok;
+}
+
+/**
+  @brief Generate the rental report of a chain of branches, read like execChainSalesReport().
+  @param session The session running the command.
+  @param list Comma separated database files of the branches; wildcards are expanded.
+  @return True if every branch could be read.
+*/
+bool execChainRentalReport(struct Session *session, const char *list) {
+    FILE *out = session->out;
+    struct Chain chain;
+    struct Branch *branches;
+
+    fprintf(out, "\n%s******** Chain Rental Report *********%s\n\n",PINK,RESET);
+    int count = readChain(out, list, &chain, &branches);
+    if (count == 0) {
+        fprintf(out, "%sNo branch files given.%s\n", RED, RESET);
+        freeChain(&chain, branches, count);
+        return false;
+    }
+
+    fprintf(out, "\n%s******* Top 5 Rented Books *********%s\n",YELLOW,RESET);
+    double totalDays = printChainTop(out, &chain, true);
+
+    // Copies and days rented by every branch.
+    int rentedAll = 0, rentedDays = 0;
+    for (int i = 0; i < chain.count; i++) {
+        rentedAll += chain.books[i].rentedAll;
+        rentedDays += chain.books[i].rentedDays;
+    }
+    fprintf(out, "\n%s*********** Rentals ***********%s\n\n",YELLOW,RESET);
+    fprintf(out, "Days Rented of Top 5:   %s%.0f%s\n",GREEN, totalDays,RESET);
+    fprintf(out, "Copies Rented of All:   %s%d%s\n",GREEN, rentedAll,RESET);
+    fprintf(out, "Days Rented of All:     %s%d%s\n",GREEN, rentedDays,RESET);
+    printChainTimes(out, &chain, count);
+
+    bool ok = chain.branches == count;
+    freeChain(&chain, branches, count);
+    return ok;
+}
+
+/**
+  @brief Generate the sales and rental reports of a chain of branches.
+  @param None.
+  @return void.
+*/
+void generateChainReport() {
+    struct Arena arena = {0};
+    char request[REQUEST_MAX_LENGTH];
+
+    struct Text *list;
+    do {
+        printf("Enter the branch database files (comma separated, wildcards allowed): ");
+        list = readText(&arena);
+    } while (!validateField(list->data));
+
+    snprintf(request, sizeof(request), "report sales\t%s", list->data);
+    submitRequest(request);
+    snprintf(request, sizeof(request), "report rents\t%s", list->data);
+    submitRequest(request);
+    freeArena(&arena);
+}
+
+/**
+  @brief Generate a report of the books, copies sold and revenue of every genre.
+  @param session The session running the command.
+  @return True on success, false if the catalog could not be read.
+*/
+bool execGenreReport(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    fprintf(out, "\n%s************ Genre Report ************%s\n\n",PINK,RESET);
+
+    if (!readCatalog(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+
+    // Sum every book into the totals of its genre, indexed by genre id.
+    int genres = genreNames.capacity + 1;
+    int *books = calloc(genres, sizeof(int));
+    int *sold = calloc(genres, sizeof(int));
+    double *revenue = calloc(genres, sizeof(double));
+    for (int i = 0; i < catalog.count; i++) {
+        books[catalog.genreIds[i]]++;
+        sold[catalog.genreIds[i]] += catalog.sold[i];
+        revenue[catalog.genreIds[i]] += catalog.prices[i] * catalog.sold[i];
+    }
+
+    int max_genre_width = 5;
+    for (int id = 0; id < genres; id++) {
+        if (books[id] > 0) {
+            max_genre_width = fmax(max_genre_width, (int)strlen(dictionaryName(&genreNames, id)));
+        }
+    }
+
+    // Print column headers.
+    fprintf(out, "%s%-*s | %-8s | %-13s | %-12s |%s\n", BLUE, max_genre_width, "Genre", "Books", "Quantity Sold", "Revenue", RESET);
+    fprintf(out, "%s", BLUE);
+    for (int i = 0; i < (max_genre_width + 46); i++) {
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n", RESET);
+
+    // Print the genres with books, in id order.
+    for (int id = 0; id < genres; id++) {
+        if (books[id] > 0) {
+            fprintf(out, "%-*s | %-8d | %-13d | $%-11.2f |\n", max_genre_width, dictionaryName(&genreNames, id),
+                    books[id], sold[id], revenue[id]);
+        }
+    }
+    releaseCatalog();
+    fprintf(out, "\n");
 
-    sqlite3_finalize(stmt);  // Finalize the statement.
-    sqlite3_close(db);  // Close the database connection.
+    free(books);
+    free(sold);
+    free(revenue);
+    return true;
+}
+
+/**
+  @brief Generate a report of the books, sales and rents of this shop and of every store attached
+         to it, with the totals of all of them, read in place from each database file.
+  @param session The session running the command.
+  @return True if every store could be read.
+*/
+bool execStoreReport(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+    int totalBooks = 0, totalOpen = 0, totalLate = 0;
+    double totalSold = 0, totalRevenue = 0;
+    bool ok = true;
+
+    fprintf(out, "\n%s************ Store Report ************%s\n\n",PINK,RESET);
+
+    int max_store_width = strlen(databaseFile);
+    for (int i = 0; i < storeCount; i++) {
+        max_store_width = fmax(max_store_width, (int)strlen(stores[i].name));
+    }
+
+    // Print column headers.
+    fprintf(out, "%s%-*s | %-8s | %-13s | %-12s | %-10s | %-10s |%s\n", BLUE, max_store_width, "Store", "Books",
+            "Quantity Sold", "Revenue", "Open Rents", "Late Rents", RESET);
+    fprintf(out, "%s", BLUE);
+    for (int i = 0; i < (max_store_width + 72); i++) {
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n", RESET);
+
+    // This shop is the main schema, every store is attached under its own name. The schema name
+    // changes the SQL, so these statements aren't cached.
+    for (int i = -1; i < storeCount; i++) {
+        const char *schema = i < 0 ? "main" : stores[i].name;
+        char sql[512];
+        sqlite3_stmt *stmt = NULL;
+
+        snprintf(sql, sizeof(sql), "SELECT COUNT(*), TOTAL(quantity_sold), TOTAL(quantity_sold * price), "
+                                   "(SELECT COUNT(*) FROM \"%s\".rents), "
+                                   "(SELECT COUNT(*) FROM \"%s\".rents WHERE return_date < date('now', 'localtime')) "
+                                   "FROM \"%s\".books;", schema, schema, schema);
+        const char *label = i < 0 ? databaseFile : schema;
+        if (sqlite3_prepare_v2(database->db, sql, -1, &stmt, NULL) != SQLITE_OK || sqlite3_step(stmt) != SQLITE_ROW) {
+            fprintf(out, "%-*s | %sunavailable: %s%s\n", max_store_width, label, RED, sqlite3_errmsg(database->db), RESET);
+            sqlite3_finalize(stmt);
+            ok = false;
+            continue;
+        }
+
+        fprintf(out, "%-*s | %-8d | %-13.0f | $%-11.2f | %-10d | %-10d |\n", max_store_width, label,
+                sqlite3_column_int(stmt, 0), sqlite3_column_double(stmt, 1), sqlite3_column_double(stmt, 2),
+                sqlite3_column_int(stmt, 3), sqlite3_column_int(stmt, 4));
+        totalBooks += sqlite3_column_int(stmt, 0);
+        totalSold += sqlite3_column_double(stmt, 1);
+        totalRevenue += sqlite3_column_double(stmt, 2);
+        totalOpen += sqlite3_column_int(stmt, 3);
+        totalLate += sqlite3_column_int(stmt, 4);
+        sqlite3_finalize(stmt);
+    }
+
+    // Print the totals of all stores.
+    fprintf(out, "%s", BLUE);
+    for (int i = 0; i < (max_store_width + 72); i++) {
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n", RESET);
+    fprintf(out, "%s%-*s | %-8d | %-13.0f | $%-11.2f | %-10d | %-10d |%s\n\n", GREEN, max_store_width, "Total",
+            totalBooks, totalSold, totalRevenue, totalOpen, totalLate, RESET);
+    return ok;
+}
+
+/**
+ * @brief Prints how often this process had to wait for other tills holding the database lock.
+ * @param session The session running the command.
+ * @return True.
+ */
+bool execShowLocks(struct Session *session) {
+    FILE *out = session->out;
+
+    fprintf(out, "\n%s*********** Lock Waits ***********%s\n\n", YELLOW, RESET);
+    fprintf(out, "Lock waits:          %ld\n", atomic_load(&lockWaits));
+    fprintf(out, "Time waiting:        %.1f ms\n", atomic_load(&lockWaitMicros) / 1000.0);
+    fprintf(out, "Timed out waits:     %ld\n", atomic_load(&lockTimeouts));
+    fprintf(out, "Transaction retries: %ld\n\n", atomic_load(&transactionRetries));
+    return true;
+}
+
+/**
+ * @brief Prints the timings of every SQL statement, the most expensive first.
+ *
+ * @param session The session running the command.
+ *
+ * @return False if profiling is off.
+ */
+bool execShowQueries(struct Session *session) {
+    FILE *out = session->out;
+
+    if (!profiling) {
+        fprintf(out, "%sProfiling is off, set BOOKERY_SLOW_QUERY_MS to enable it.%s\n", RED, RESET);
+        return false;
+    }
+    fprintf(out, "\n%s*********** Statement Profile ***********%s\n\n", YELLOW, RESET);
+    printProfile(out);
+    fprintf(out, "\n");
+    return true;
+}
+
+//***********************************************************************************************************************************
+
+/**
+ * @brief Records a command in the statistics and the audit log.
+ *
+ * @param session   The session that ran the command.
+ * @param record    What the command did.
+ * @param committed False if the transaction of a successful command failed to commit, which
+ *                  records it as failed.
+ */
+void finishRecord(struct Session *session, const struct CommandRecord *record, bool committed) {
+    bool ok = record->ok && committed;
+
+    recordCommand(record->command, ok, record->micros, committed ? record->rows : 0, record->steps, record->fullScanSteps);
+    pushAudit(session, record->command, record->target,
+              record->outcome == AUDIT_OK && !committed ? AUDIT_FAILED : record->outcome, record->micros);
+}
+
+/**
+ * @brief Runs one protocol request against a database connection.
+ *
+ * @details Requests are tab separated lines whose first field is the advanced CLI command name,
+ *          followed by the values the interactive prompts would have collected. The local CLI,
+ *          the server and the client mode all go through this function.
+ *
+ * @param session The session running the command, whose connection and output stream are used.
+ * @param request The request line.
+ *
+ * @return True if the command succeeded, false otherwise.
+ */
+bool handleRequest(struct Session *session, const char *request) {
+    FILE *out = session->out;
+    char *argv[REQUEST_MAX_ARGS];
+
+    // Split a copy of the request kept in the session, so the caller's line stays intact.
+    snprintf(session->line, sizeof(session->line), "%s", request);
+    int argc = splitRequest(session->line, argv, REQUEST_MAX_ARGS);
+    bool ok = false;
+
+    if (argc <= 0) {
+        fprintf(out, "%sInvalid request.%s\n", RED, RESET);
+        return false;
+    }
+
+    const char *command = argv[0];
+    const char *statsName = command;
+    struct Book book;
+    struct Rent rent;
+    struct User user;
+    memset(&book, 0, sizeof(book));
+    memset(&rent, 0, sizeof(rent));
+    memset(&user, 0, sizeof(user));
+
+    // Measure the command: wall time, rows changed and SQLite steps.
+    long fullScanSteps;
+    collectSteps(session->database, &fullScanSteps);
+    sqlite3_int64 changes = sqlite3_total_changes64(session->database->db);
+    double start = monotonicMicros();
+    currentCommand = command;
+    session->denied = false;
+
+    if (strcmp(command, "login") == 0 && argc == 3) {
+        ok = execLogin(session, argv[1], argv[2]);
+
+    } else if (strcmp(command, "resume") == 0 && argc == 2) {
+        ok = execResume(session, argv[1]);
+
+    } else if (strcmp(command, "new token") == 0 && argc == 1) {
+        ok = execNewToken(session);
+
+    } else if (strcmp(command, "logout") == 0 && argc == 2) {
+        ok = execLogout(session, argv[1]);
+
+    } else if (strcmp(command, "whoami") == 0 && argc == 1) {
+        ok = execWhoami(session);
+
+    } else if (strcmp(command, "add book") == 0 && argc == 6) {
+        book.title = arenaText(&session->arena, argv[1]);
+        book.author = arenaText(&session->arena, argv[2]);
+        book.genre = arenaText(&session->arena, argv[3]);
+        book.price = atof(argv[4]);
+        book.quantity_available = atoi(argv[5]);
+        ok = execAddBook(session, &book);
+
+    } else if (strcmp(command, "update book") == 0 && argc == 7) {
+        book.title = arenaText(&session->arena, argv[2]);
+        book.author = arenaText(&session->arena, argv[3]);
+        book.genre = arenaText(&session->arena, argv[4]);
+        book.price = atof(argv[5]);
+        book.quantity_available = atoi(argv[6]);
+        ok = execUpdateBook(session, argv[1], &book);
+
+    } else if (strcmp(command, "sell book") == 0 && argc == 3) {
+        ok = execSellBook(session, argv[1], atoi(argv[2]));
+
+    } else if (strcmp(command, "del book") == 0 && argc == 2) {
+        ok = execDelBook(session, argv[1]);
+
+    } else if (strcmp(command, "del allbooks") == 0 && argc == 1) {
+        ok = execDelBook(session, NULL);
+
+    } else if (strcmp(command, "show books") == 0 && argc == 1) {
+        ok = execShowBooks(session);
+
+    } else if (strcmp(command, "search book") == 0 && argc == 2) {
+        ok = execSearchBook(session, argv[1]);
+
+    } else if (strcmp(command, "rent book") == 0 && argc == 5) {
+        rent.title = arenaText(&session->arena, argv[1]);
+        rent.customer_name = arenaText(&session->arena, argv[2]);
+        rent.customer_phone = arenaText(&session->arena, argv[3]);
+        rent.rented_for_days = atoi(argv[4]);
+        ok = execRentBook(session, &rent);
+
+    } else if (strcmp(command, "rent recall") == 0 && argc == 2) {
+        ok = execRentRecall(session, atoi(argv[1]));
+
+    } else if (strcmp(command, "rent late") == 0 && argc == 1) {
+        ok = execRentLate(session);
+
+    } else if (strcmp(command, "rent due") == 0 && argc == 2) {
+        ok = execRentDue(session, atoi(argv[1]));
+
+    } else if (strcmp(command, "show rents") == 0 && argc == 1) {
+        ok = execShowRents(session);
+
+    } else if (strcmp(command, "search rent") == 0 && argc == 2) {
+        ok = execSearchRent(session, argv[1]);
+
+    } else if (strcmp(command, "add user") == 0 && argc == 5) {
+        snprintf(user.username, sizeof(user.username), "%s", argv[1]);
+        snprintf(user.password, sizeof(user.password), "%s", argv[2]);
+        snprintf(user.email, sizeof(user.email), "%s", argv[3]);
+        user.role = atoi(argv[4]);
+        ok = execAddUser(session, &user);
+
+    } else if (strcmp(command, "update user") == 0 && argc == 5) {
+        snprintf(user.username, sizeof(user.username), "%s", argv[2]);
+        snprintf(user.email, sizeof(user.email), "%s", argv[3]);
+        user.role = atoi(argv[4]);
+        ok = execUpdateUser(session, argv[1], &user);
+
+    } else if (strcmp(command, "del user") == 0 && argc == 2) {
+        ok = execDelUser(session, argv[1]);
+
+    } else if (strcmp(command, "show users") == 0 && argc == 1) {
+        ok = execShowUsers(session);
+
+    } else if (strcmp(command, "report sales") == 0 && argc == 1) {
+        ok = execSalesReport(session);
+
+    } else if (strcmp(command, "report rents") == 0 && argc == 1) {
+        ok = execRentalReport(session);
+
+    } else if (strcmp(command, "report sales") == 0 && argc == 2) {
+        ok = execChainSalesReport(session, argv[1]);
+
+    } else if (strcmp(command, "report rents") == 0 && argc == 2) {
+        ok = execChainRentalReport(session, argv[1]);
+
+    } else if (strcmp(command, "report genres") == 0 && argc == 1) {
+        ok = execGenreReport(session);
+
+    } else if (strcmp(command, "report stores") == 0 && argc == 1) {
+        ok = execStoreReport(session);
+
+    } else if (strcmp(command, "export changes") == 0 && (argc == 2 || argc == 3)) {
+        ok = execExportChanges(session, atoll(argv[1]), argc == 3 ? atoi(argv[2]) : CHANGES_BATCH);
+
+    } else if (strcmp(command, "prune changes") == 0 && argc == 2) {
+        ok = execPruneChanges(session, atoll(argv[1]));
+
+    } else if (strcmp(command, "show locks") == 0 && argc == 1) {
+        ok = execShowLocks(session);
+
+    } else if (strcmp(command, "import users") == 0 && argc == 2) {
+        ok = execImportUsers(session, argv[1]);
+
+    } else if (strcmp(command, "calibrate hash") == 0 && argc == 2) {
+        ok = execCalibrateHash(session, atoi(argv[1]));
+
+    } else if (strcmp(command, "stats") == 0 && argc == 1) {
+        ok = execStats(session);
+
+    } else if (strcmp(command, "show queries") == 0 && argc == 1) {
+        ok = execShowQueries(session);
+
+    } else if (strcmp(command, "mem") == 0 && argc == 1) {
+        ok = execMem(session);
+
+    } else {
+        fprintf(out, "%sInvalid request:%s %s\n", RED, RESET, command);
+        statsName = "invalid";
+    }
+
+    struct CommandRecord record;
+    record.micros = monotonicMicros() - start;
+    record.steps = collectSteps(session->database, &record.fullScanSteps);
+    record.rows = sqlite3_total_changes64(session->database->db) - changes;
+    currentCommand = NULL;
+
+    // Tokens are secrets, everything else is recorded with its first argument.
+    bool secret = strcmp(command, "resume") == 0 || strcmp(command, "logout") == 0;
+    record.command = statsName;
+    record.target = argc > 1 && !secret ? argv[1] : NULL;
+    record.ok = ok;
+    record.outcome = session->denied ? AUDIT_DENIED : ok ? AUDIT_OK : AUDIT_FAILED;
+
+    // The writer records its requests once it knows whether their group committed.
+    if (session->deferRecord) {
+        session->record = record;
+    } else {
+        finishRecord(session, &record, true);
+    }
+
+    // Release any read transaction a statement may still hold, and the records of the command.
+    resetStatements(session->database);
+    resetArena(&session->arena);
+    return ok;
 }
 
 
@@ -348,6 +1033,14 @@ void advancedCLI() {
             // Call function to login.
             authenticateUser();
 
+        } else if (strcmp(command, "logout") == 0) {
+            // Call function to forget the saved login and exit.
+            logout();
+
+        } else if (strcmp(command, "help logout") == 0) {
+            // Display help for logout command.
+            help("logout");
+
         } else if (strcmp(command, "update book") == 0) {
             // Call function to update book.
             updateBook();
@@ -383,6 +1076,10 @@ void advancedCLI() {
         } else if (strcmp(command, "rent late") == 0){
             // Call function to recall rented books.
             rentLate();   
+
+        } else if (strcmp(command, "rent due") == 0){
+            // Call function to display the rents coming due.
+            rentDue();
         } 
         else if (strcmp(command, "show rents") == 0){
             // Call function to display rents.
@@ -396,6 +1093,30 @@ void advancedCLI() {
             // Call function to display all users.
             displayUsers();
 
+        } else if (strcmp(command, "show queries") == 0) {
+            // Call function to display the statement profile.
+            submitRequest("show queries");
+
+        } else if (strcmp(command, "mem") == 0) {
+            // Call function to display memory use.
+            submitRequest("mem");
+
+        } else if (strcmp(command, "help mem") == 0) {
+            // Display help for mem command.
+            help("mem");
+
+        } else if (strcmp(command, "stats") == 0) {
+            // Call function to display command statistics.
+            submitRequest("stats");
+
+        } else if (strcmp(command, "help stats") == 0) {
+            // Display help for stats command.
+            help("stats");
+
+        } else if (strcmp(command, "show locks") == 0) {
+            // Call function to display lock contention counters.
+            submitRequest("show locks");
+
         } else if (strcmp(command, "search rent") == 0){
             // Call function to search rented books.
             searchRent();
@@ -412,10 +1133,46 @@ void advancedCLI() {
             // Call function to generate rental report.
             generateRentalReport();
 
+        } else if (strcmp(command, "report genres") == 0) {
+            // Call function to generate the genre report.
+            submitRequest("report genres");
+
+        } else if (strcmp(command, "report stores") == 0) {
+            // Call function to generate the report of every store.
+            submitRequest("report stores");
+
+        } else if (strcmp(command, "report chain") == 0) {
+            // Call function to generate the reports of a chain of branches.
+            generateChainReport();
+
+        } else if (strcmp(command, "export changes") == 0) {
+            // Call function to export the change log.
+            exportChanges();
+
+        } else if (strcmp(command, "prune changes") == 0) {
+            // Call function to remove the changes head office loaded.
+            pruneChanges();
+
         } else if (strcmp(command, "whoami") == 0) {
             // Call function to display current user information.
             whoami();
 
+        } else if (strcmp(command, "import users") == 0) {
+            // Call function to add the users of a CSV file.
+            importUsers();
+
+        } else if (strcmp(command, "help import") == 0) {
+            // Display help for import command.
+            help("import");
+
+        } else if (strcmp(command, "calibrate hash") == 0) {
+            // Call function to calibrate the password hashing cost.
+            calibrateHash();
+
+        } else if (strcmp(command, "help calibrate") == 0) {
+            // Display help for calibrate command.
+            help("calibrate");
+
         } else if (strcmp(command, "help add") == 0) {
             // Display help for add commands.
             help("add");
@@ -527,11 +1284,6 @@ void advancedCLI() {
  */
 void friendlyCLI() {
     printf("\033c"); // Clear the screen.
-    
-    // Initialize database.
-    if (initializeDatabase() != 0) {
-        fprintf(stderr, "Failed to initialize database.\n");
-    }
 
     int choice;
     bool validInput;
@@ -604,11 +1356,81 @@ void friendlyCLI() {
 
 
 int bms() {
-    login();
+    // A saved login skips the password prompt.
+    if (!resumeSession()) {
+        login();
+    }
     friendlyCLI();
 }
 
-int main(){
+#ifndef BOOKERY_NO_MAIN
+/**
+ * @brief Entry point.
+ *
+ * @details Without arguments the CLI runs against the local database file.
+ *          "--server [socket]" serves the database to many tills over a Unix domain socket,
+ *          "--client [socket]" runs the CLI against such a server and "--report [snapshot]" runs
+ *          it read-only, for reports and searches, on the database or a snapshot copy of it.
+ *          In front of the mode, "--memory" runs on a copy of the database in memory, written back
+ *          to the file periodically and at exit, "--db <file>" names the database file and
+ *          "--store <name>=<file>" attaches the store of another branch.
+ */
+int main(int argc, char *argv[]){
+    atexit(dumpStats);
+    setMemoryBudget();
+    setReminderSchedule();
+
+    // Where the data lives: configuration file and environment, then the flags in front of the mode.
+    if (!readConfig()) {
+        return 1;
+    }
+    while (argc >= 2 && strncmp(argv[1], "--", 2) == 0) {
+        if (strcmp(argv[1], "--memory") == 0) {
+            useMemoryDatabase();
+        } else if (strcmp(argv[1], "--db") == 0 && argc >= 3) {
+            setDatabaseFile(argv[2]);
+            argc--;
+            argv++;
+        } else if (strcmp(argv[1], "--store") == 0 && argc >= 3) {
+            if (!addStoreSpec(argv[2])) {
+                return 1;
+            }
+            argc--;
+            argv++;
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--server") == 0) {
+        if (openShop() != 0) {
+            return 1;
+        }
+        statsToStderr = true;
+        startAudit();
+        return runServer(argc >= 3 ? argv[2] : SOCKET_FILE);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--client") == 0) {
+        if (connectServer(argc >= 3 ? argv[2] : SOCKET_FILE) != 0) {
+            return 1;
+        }
+    } else if (argc >= 2 && strcmp(argv[1], "--report") == 0) {
+        if (openReport(argc >= 3 ? argv[2] : NULL) != 0) {
+            return 1;
+        }
+        openSession(&localSession, &shopDatabase, stdout);
+        startAudit();
+    } else if (openShop() != 0) {
+        return 1;
+    } else {
+        openSession(&localSession, &shopDatabase, stdout);
+        startAudit();
+    }
+
     bms();
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,128 @@
+/*
+ * File:          arena.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the bump arena commands allocate their records from, and the
+ *                length-prefixed strings stored in it. Allocating moves a pointer; everything a
+ *                command allocated is released at once when it ends.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define ARENA_BLOCK_SIZE 4096            // Bytes of a block; larger allocations get a block of their own.
+
+// Define structure for one block of an arena.
+struct ArenaBlock {
+    struct ArenaBlock *next;             // Block allocated before this one.
+    size_t size;                         // Bytes of data.
+    size_t used;                         // Bytes handed out.
+    char data[];
+};
+
+// Define structure for an arena, empty when zeroed.
+struct Arena {
+    struct ArenaBlock *blocks;           // Blocks, the current one first.
+};
+
+// Define structure for a length-prefixed string. The text is NUL terminated as well, so it can be
+// handed to C and SQLite functions as it is.
+struct Text {
+    unsigned int length;                 // Bytes of text, without the terminating NUL.
+    char data[];
+};
+
+/**
+ * @brief Allocates memory from an arena, aligned for any record.
+ *
+ * @param arena The arena.
+ * @param size  Bytes needed.
+ *
+ * @return The memory, valid until the arena is reset.
+ */
+void *arenaAlloc(struct Arena *arena, size_t size) {
+    struct ArenaBlock *block = arena->blocks;
+
+    size = (size + 7) & ~(size_t)7;
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(*block) + blockSize);
+        block->next = arena->blocks;
+        block->size = blockSize;
+        block->used = 0;
+        arena->blocks = block;
+    }
+
+    void *memory = block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+/**
+ * @brief Copies a string into an arena.
+ *
+ * @return The copy, valid until the arena is reset.
+ */
+struct Text *arenaText(struct Arena *arena, const char *text) {
+    size_t length = strlen(text);
+    struct Text *copy = arenaAlloc(arena, sizeof(struct Text) + length + 1);
+
+    copy->length = length;
+    memcpy(copy->data, text, length + 1);
+    return copy;
+}
+
+/**
+ * @brief Reads a line of standard input of any length into an arena, skipping leading white space
+ *        like scanf(" %[^\n]") does.
+ *
+ * @return The line without its newline, valid until the arena is reset.
+ */
+struct Text *readText(struct Arena *arena) {
+    char *line = NULL;
+    size_t size = 0;
+    int c;
+
+    while ((c = getchar()) != EOF && isspace(c)) {
+    }
+    if (c != EOF) {
+        ungetc(c, stdin);
+    }
+    ssize_t length = getline(&line, &size, stdin);
+    if (length > 0 && line[length - 1] == '\n') {
+        line[length - 1] = '\0';
+    }
+
+    struct Text *text = arenaText(arena, length > 0 ? line : "");
+    free(line);
+    return text;
+}
+
+/**
+ * @brief Releases everything allocated from an arena at once. The first block is kept for the
+ *        next command, so a command that fits in it doesn't call malloc() at all.
+ */
+void resetArena(struct Arena *arena) {
+    struct ArenaBlock *block = arena->blocks;
+
+    while (block != NULL && (block->next != NULL || block->size != ARENA_BLOCK_SIZE)) {
+        struct ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    if (block != NULL) {
+        block->used = 0;
+    }
+    arena->blocks = block;
+}
+
+/**
+ * @brief Frees every block of an arena.
+ */
+void freeArena(struct Arena *arena) {
+    resetArena(arena);
+    free(arena->blocks);
+    arena->blocks = NULL;
+}
@@ -0,0 +1,357 @@
+/*
+ * File:          audit.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the audit log: one JSON line per command with its time, user, outcome
+ *                and latency, handed through a lock-free ring buffer to a writer thread that rotates
+ *                the file by size.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define AUDIT_FILE "bookery.log"
+#define AUDIT_RING 4096                  // Records buffered for the writer, a power of two.
+#define AUDIT_MAX_BYTES (10L * 1024 * 1024)
+#define AUDIT_KEEP 3                     // Rotated files kept: bookery.log.1 to bookery.log.3.
+#define AUDIT_FLUSH_MS 50                // Writer sleep when the buffer is empty.
+#define AUDIT_RETRY_MS 1000              // Writer sleep between attempts to reopen a lost log.
+#define AUDIT_EVENT_MS 1000              // Period at which the event thread checks for due events.
+
+// Outcomes of a command.
+enum AuditOutcome { AUDIT_OK, AUDIT_FAILED, AUDIT_DENIED };
+
+// Define structure for one audit record, a slot of the ring buffer.
+struct AuditRecord {
+    atomic_size_t sequence;              // Position the slot is ready for; see pushAudit().
+    struct timespec time;                // Wall clock time the command finished.
+    char user[50];                       // Logged in user, empty if none.
+    char origin[32];                     // Where the user connects from.
+    char command[32];                    // Command name.
+    char target[64];                     // First argument of the command, e.g. the book title.
+    enum AuditOutcome outcome;
+    double micros;                       // Latency of the command.
+};
+
+struct AuditRecord auditRing[AUDIT_RING];
+atomic_size_t auditHead;                 // Next position producers claim.
+size_t auditTail;                        // Next position the writer reads, only used by the writer.
+atomic_long auditDropped;                // Records lost because the buffer was full.
+atomic_bool auditStopping;
+bool auditing = false;
+pthread_t auditThread;
+
+// Audit log file, its path, size and rotation threshold, owned by the writer thread.
+FILE *auditFile;
+const char *auditPath;
+long auditBytes;
+long auditMaxBytes;
+
+// Periodic events (memory use, rental reminders) come from a thread of their own, so they are
+// due whether or not there is an audit log; they are handed to the writer, or go to stderr.
+pthread_t eventThread;
+pthread_mutex_t eventLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t eventStop = PTHREAD_COND_INITIALIZER;
+bool eventStopping = false;
+char *auditEvents;                       // Event lines waiting for the writer, NULL if none.
+size_t auditEventBytes;
+
+/**
+ * @brief Queues one audit record without blocking.
+ *
+ * A bounded multi-producer queue: every slot carries a sequence number telling producers whether
+ * it is free for their position and the writer whether it has been filled, so claiming a slot is
+ * one compare-and-swap and nobody ever waits for a lock. A full buffer drops the record.
+ *
+ * @param session The session that ran the command.
+ * @param command Command name.
+ * @param target  First argument of the command, or NULL.
+ * @param outcome How the command ended.
+ * @param micros  Latency of the command.
+ */
+void pushAudit(const struct Session *session, const char *command, const char *target,
+               enum AuditOutcome outcome, double micros) {
+    if (!auditing) {
+        return;
+    }
+
+    struct AuditRecord *record;
+    size_t position = atomic_load_explicit(&auditHead, memory_order_relaxed);
+    while (true) {
+        record = &auditRing[position & (AUDIT_RING - 1)];
+        intptr_t lag = (intptr_t)atomic_load_explicit(&record->sequence, memory_order_acquire) - (intptr_t)position;
+        if (lag == 0) {
+            if (atomic_compare_exchange_weak_explicit(&auditHead, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (lag < 0) {
+            // The writer hasn't consumed this slot yet.
+            atomic_fetch_add(&auditDropped, 1);
+            return;
+        } else {
+            position = atomic_load_explicit(&auditHead, memory_order_relaxed);
+        }
+    }
+
+    clock_gettime(CLOCK_REALTIME, &record->time);
+    snprintf(record->user, sizeof(record->user), "%s", session->authenticated ? session->userName : "");
+    snprintf(record->origin, sizeof(record->origin), "%s", session->origin);
+    snprintf(record->command, sizeof(record->command), "%s", command);
+    snprintf(record->target, sizeof(record->target), "%s", target != NULL ? target : "");
+    record->outcome = outcome;
+    record->micros = micros;
+    atomic_store_explicit(&record->sequence, position + 1, memory_order_release);
+}
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ */
+int writeJsonString(FILE *file, const char *text) {
+    int length = fprintf(file, "\"");
+    for (const unsigned char *c = (const unsigned char *)text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            length += fprintf(file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            length += fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+            length++;
+        }
+    }
+    return length + fprintf(file, "\"");
+}
+
+/**
+ * @brief Formats a time as an ISO 8601 UTC timestamp with milliseconds.
+ */
+void formatAuditTime(const struct timespec *time, char *stamp, size_t size) {
+    struct tm utc;
+
+    gmtime_r(&time->tv_sec, &utc);
+    size_t length = strftime(stamp, size, "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(stamp + length, size - length, ".%03ldZ", time->tv_nsec / 1000000);
+}
+
+/**
+ * @brief Writes one record as a JSON line.
+ *
+ * @return Number of bytes written.
+ */
+int writeAudit(FILE *file, const struct AuditRecord *record) {
+    static const char *outcomes[] = {"ok", "failed", "denied"};
+    char stamp[32];
+
+    formatAuditTime(&record->time, stamp, sizeof(stamp));
+    int length = fprintf(file, "{\"time\":\"%s\",\"user\":", stamp);
+    length += writeJsonString(file, record->user);
+    length += fprintf(file, ",\"origin\":");
+    length += writeJsonString(file, record->origin);
+    length += fprintf(file, ",\"command\":");
+    length += writeJsonString(file, record->command);
+    if (record->target[0] != '\0') {
+        length += fprintf(file, ",\"target\":");
+        length += writeJsonString(file, record->target);
+    }
+    length += fprintf(file, ",\"outcome\":\"%s\",\"ms\":%.3f}\n", outcomes[record->outcome], record->micros / 1000);
+    return length;
+}
+
+/**
+ * @brief Moves bookery.log to bookery.log.1, shifting older files up to AUDIT_KEEP, and reopens it.
+ *        If it can't be reopened, auditFile is left NULL for the writer to retry.
+ */
+void rotateAudit() {
+    char from[512], to[512];
+
+    fclose(auditFile);
+    for (int i = AUDIT_KEEP - 1; i >= 1; i--) {
+        snprintf(from, sizeof(from), "%s.%d", auditPath, i);
+        snprintf(to, sizeof(to), "%s.%d", auditPath, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", auditPath);
+    rename(auditPath, to);
+
+    auditFile = fopen(auditPath, "a");
+    if (auditFile == NULL) {
+        fprintf(stderr, "%sCan't reopen audit log %s: %s. Retrying; records are dropped meanwhile.%s\n",
+                RED, auditPath, strerror(errno), RESET);
+    }
+    auditBytes = 0;
+}
+
+/**
+ * @brief Writer thread: drains the ring buffer into the log until auditing stops.
+ *
+ * While the log can't be reopened after a rotation, the writer keeps trying every AUDIT_RETRY_MS;
+ * producers drop what doesn't fit in the buffer meanwhile, and the count of dropped records is
+ * written once the log is back.
+ */
+void *auditWriter(void *arg) {
+    long reportedDrops = 0;
+
+    while (true) {
+        if (auditFile == NULL) {
+            if (atomic_load(&auditStopping)) {
+                break;
+            }
+            usleep(AUDIT_RETRY_MS * 1000);
+            if ((auditFile = fopen(auditPath, "a")) == NULL) {
+                continue;
+            }
+            fprintf(stderr, "%sAudit log %s reopened.%s\n", GREEN, auditPath, RESET);
+        }
+
+        int written = 0;
+        while (true) {
+            struct AuditRecord *record = &auditRing[auditTail & (AUDIT_RING - 1)];
+            if (atomic_load_explicit(&record->sequence, memory_order_acquire) != auditTail + 1) {
+                break;
+            }
+            auditBytes += writeAudit(auditFile, record);
+            atomic_store_explicit(&record->sequence, auditTail + AUDIT_RING, memory_order_release);
+            auditTail++;
+            written++;
+        }
+
+        long dropped = atomic_load(&auditDropped);
+        if (dropped != reportedDrops) {
+            auditBytes += fprintf(auditFile, "{\"dropped\":%ld}\n", dropped - reportedDrops);
+            reportedDrops = dropped;
+            written++;
+        }
+
+        // Periodic events handed over by the event thread.
+        pthread_mutex_lock(&eventLock);
+        char *events = auditEvents;
+        size_t eventBytes = auditEventBytes;
+        auditEvents = NULL;
+        auditEventBytes = 0;
+        pthread_mutex_unlock(&eventLock);
+        if (events != NULL) {
+            fwrite(events, 1, eventBytes, auditFile);
+            auditBytes += eventBytes;
+            written++;
+            free(events);
+        }
+
+        if (written > 0) {
+            fflush(auditFile);
+            if (auditBytes >= auditMaxBytes) {
+                rotateAudit();
+            }
+        } else if (atomic_load(&auditStopping)) {
+            break;
+        } else {
+            usleep(AUDIT_FLUSH_MS * 1000);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Event thread: every AUDIT_EVENT_MS writes the periodic events that are due, the memory
+ *        use and the rental reminders, to the audit log through its writer, or to stderr when
+ *        there is no audit log.
+ */
+void *eventWriter(void *arg) {
+    pthread_mutex_lock(&eventLock);
+    while (!eventStopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += AUDIT_EVENT_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        if (pthread_cond_timedwait(&eventStop, &eventLock, &deadline) != ETIMEDOUT) {
+            continue;
+        }
+        pthread_mutex_unlock(&eventLock);
+
+        struct timespec now;
+        char stamp[32], *events = NULL;
+        size_t size = 0;
+        clock_gettime(CLOCK_REALTIME, &now);
+        formatAuditTime(&now, stamp, sizeof(stamp));
+        FILE *buffer = open_memstream(&events, &size);
+        writeMemoryEvent(buffer, stamp);
+        writeReminderEvent(buffer, stamp);
+        fclose(buffer);
+
+        pthread_mutex_lock(&eventLock);
+        if (size > 0 && auditing) {
+            auditEvents = realloc(auditEvents, auditEventBytes + size);
+            memcpy(auditEvents + auditEventBytes, events, size);
+            auditEventBytes += size;
+        } else if (size > 0) {
+            fwrite(events, 1, size, stderr);
+        }
+        free(events);
+    }
+    pthread_mutex_unlock(&eventLock);
+    return NULL;
+}
+
+/**
+ * @brief Stops the event thread, at exit, before the writer so its last events are written.
+ */
+void stopEvents() {
+    pthread_mutex_lock(&eventLock);
+    eventStopping = true;
+    pthread_cond_signal(&eventStop);
+    pthread_mutex_unlock(&eventLock);
+    pthread_join(eventThread, NULL);
+}
+
+/**
+ * @brief Writes the records still buffered and stops the writer, at exit.
+ */
+void stopAudit() {
+    atomic_store(&auditStopping, true);
+    pthread_join(auditThread, NULL);
+    if (auditFile != NULL) {
+        fclose(auditFile);
+    }
+    auditing = false;
+}
+
+/**
+ * @brief Opens the audit log, $BOOKERY_AUDIT_LOG or bookery.log, and starts its writer, then the
+ *        thread of the periodic events, which runs with or without the log.
+ *
+ * An empty $BOOKERY_AUDIT_LOG turns the log off. $BOOKERY_AUDIT_MAX_BYTES sets the rotation size.
+ */
+void startAudit() {
+    const char *maxBytes = getenv("BOOKERY_AUDIT_MAX_BYTES");
+
+    auditPath = getenv("BOOKERY_AUDIT_LOG") != NULL ? getenv("BOOKERY_AUDIT_LOG") : AUDIT_FILE;
+    auditMaxBytes = maxBytes != NULL ? atol(maxBytes) : AUDIT_MAX_BYTES;
+    if (auditPath[0] != '\0' && (auditFile = fopen(auditPath, "a")) == NULL) {
+        fprintf(stderr, "%sCan't open audit log %s; periodic events go to stderr.%s\n", RED, auditPath, RESET);
+    }
+
+    if (auditFile != NULL) {
+        fseek(auditFile, 0, SEEK_END);
+        auditBytes = ftell(auditFile);
+
+        // Slot i is free for position i.
+        for (size_t i = 0; i < AUDIT_RING; i++) {
+            atomic_init(&auditRing[i].sequence, i);
+        }
+        auditing = true;
+        pthread_create(&auditThread, NULL, auditWriter, NULL);
+        atexit(stopAudit);
+    }
+
+    // Registered after stopAudit(), so it runs before it at exit.
+    pthread_create(&eventThread, NULL, eventWriter, NULL);
+    atexit(stopEvents);
+}
@@ -2,14 +2,14 @@
  * File:          book.h
  * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
  * Date:          May 09, 2024
- * Description:   File contains functions for managing the books inventory. 
+ * Description:   File contains functions for managing the books inventory.
  */
- 
+
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdbool.h> 
+#include <stdbool.h>
 #include <sqlite3.h>
 #include <math.h>
 #include <time.h>
@@ -17,70 +17,107 @@
 #include <openssl/evp.h>
 
 #include "const.h"
+#include "db.h"
+#include "session.h"
+#include "catalog.h"
+#include "rentals.h"
 
 
-// Define structure for a book.
+// Define structure for a book; its strings live in the arena of the command.
 struct Book {
-    char title[MAX_TITLE_LENGTH];
-    char author[MAX_AUTHOR_LENGTH];
-    char genre[MAX_GENRE_LENGTH];
+    struct Text *title;
+    struct Text *author;
+    struct Text *genre;
     float price;
     int quantity_available;
     int quantity_rented;
     int quantity_sold;
 };
 
+// Define structure for a rent; its strings live in the arena of the command.
 struct Rent {
     int id;
-    char title[MAX_TITLE_LENGTH];
-    char customer_name[MAX_AUTHOR_LENGTH];
-    char customer_phone[MAX_AUTHOR_LENGTH];
+    struct Text *title;
+    struct Text *customer_name;
+    struct Text *customer_phone;
     int quantity_rented;
     int rented_for_days;
-    char rented_date[MAX_AUTHOR_LENGTH];
-    char return_date[MAX_AUTHOR_LENGTH];
+    struct Text *rented_date;
+    struct Text *return_date;
 };
 
 
 //************************************************************************************************************************************************
 
 /**
- * @brief Adds a new book to the database.
+ * @brief Inserts a new book into the database.
  *
- * Prompts the user to input details for a new book (title, author, genre, price, quantity available),
- * validates the input, and inserts the new book into the database.
+ * @param session  The session running the command.
+ * @param book     Details of the new book.
+ *
+ * @return True if the book was added, false otherwise.
  */
-void addBook() {
-    sqlite3 *db;            ///< SQLite database object.
-    char *errMsg = 0;       ///< Error message string.
+bool execAddBook(struct Session *session, const struct Book *book) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
     int return_code;        ///< Return code from SQLite functions.
 
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Ids of the author and genre, added to their tables if new.
+    int authorId = internName(database, &authorNames, book->author->data);
+    int genreId = internName(database, &genreNames, book->genre->data);
+
+    sqlite3_stmt *stmt = prepareStatement(database, "INSERT INTO books (title, author_id, genre_id, price, quantity_available, quantity_rented, quantity_sold, quantity_rented_all,quantity_rented_days) VALUES (?, ?, ?, ?, ?, ?, ?, 0, 0);");
+    if (authorId == 0 || genreId == 0 || stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
+    sqlite3_bind_text(stmt, 1, book->title->data, book->title->length, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, authorId);
+    sqlite3_bind_int(stmt, 3, genreId);
+    sqlite3_bind_double(stmt, 4, book->price);
+    sqlite3_bind_int(stmt, 5, book->quantity_available);
+    sqlite3_bind_int(stmt, 6, book->quantity_rented);
+    sqlite3_bind_int(stmt, 7, book->quantity_sold);
+
+    return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    fprintf(out, "%sBook added successfully.\n%s", GREEN, RESET);
+    return true;
+}
+
+/**
+ * @brief Adds a new book to the database.
+ *
+ * Prompts the user to input details for a new book (title, author, genre, price, quantity available),
+ * validates the input, and inserts the new book into the database.
+ */
+void addBook() {
     struct Book newBook;    ///< Structure to store details of the new book.
+    struct Arena arena = {0};   ///< Holds the strings typed in.
 
     // Input validation loop for title.
     do {
         printf("Enter title: ");
-        scanf(" %[^\n]", newBook.title);
-    } while (!validateTitle(newBook.title));
+        newBook.title = readText(&arena);
+    } while (!validateTitle(newBook.title->data));
 
     // Input validation loop for author.
     do {
         printf("Enter author: ");
-        scanf(" %[^\n]", newBook.author);
-    } while (!validateAuthor(newBook.author));
+        newBook.author = readText(&arena);
+    } while (!validateAuthor(newBook.author->data));
 
     // Input validation loop for genre.
     do {
         printf("Enter genre: ");
-        scanf(" %[^\n]", newBook.genre);
-    } while (!validateGenre(newBook.genre));
+        newBook.genre = readText(&arena);
+    } while (!validateGenre(newBook.genre->data));
 
     // Input validation loop for price.
     do {
@@ -93,37 +130,12 @@ void addBook() {
         printf("Enter quantity available: ");
         scanf("%d", &newBook.quantity_available);
     } while (!validateQuantity(newBook.quantity_available));
-    newBook.quantity_rented = 0;
-    newBook.quantity_sold = 0;
-
-    char sql[1000]; ///< SQL query string.  
-    sprintf(sql, "INSERT INTO books (title, author, genre, price, quantity_available, quantity_rented, quantity_sold, quantity_rented_all,quantity_rented_days) VALUES (?, ?, ?, ?, ?, ?, ?, 0, 0);");
-
-    sqlite3_stmt *stmt;
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
-    sqlite3_bind_text(stmt, 1, newBook.title, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, newBook.author, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, newBook.genre, -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 4, newBook.price);
-    sqlite3_bind_int(stmt, 5, newBook.quantity_available);
-    sqlite3_bind_int(stmt, 6, newBook.quantity_rented);
-    sqlite3_bind_int(stmt, 7, newBook.quantity_sold);
-
-    return_code = sqlite3_step(stmt);
-    if (return_code != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-    } else {
-        printf("%sBook added successfully.\n%s", GREEN, RESET);
-    }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "add book\t%s\t%s\t%s\t%f\t%d",
+             newBook.title->data, newBook.author->data, newBook.genre->data, newBook.price, newBook.quantity_available);
+    freeArena(&arena);
+    submitRequest(request);
 }
 
 
@@ -133,65 +145,46 @@ void addBook() {
 
 /**
  * @brief Display the list of books from the database.
- * 
+ *
  * This function retrieves book information from the database.
  * and prints it in a formatted table.
+ *
+ * @param session The session running the command.
+ *
+ * @return True on success, false if the query failed.
  */
-void displayBooks() {
-    sqlite3 *db; // SQLite database connection.
-    sqlite3_stmt *stmt; // SQLite statement.
-    int return_code; // Return code for SQLite operations.
+bool execShowBooks(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
-    // Open the SQLite database.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
-    printf("\n********** List of Books **************\n");
+    fprintf(out, "\n********** List of Books **************\n");
 
-    // SQL query to select book information.
-    const char *sql = "SELECT title, author, genre, price, quantity_available, quantity_rented, quantity_sold FROM books;";
-
-    // Prepare the SQL statement.
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Read the books from the resident catalog.
+    if (!readCatalog(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Calculate maximum widths for each column.
     int max_title_width = 6;
     int max_author_width = 6;
     int max_genre_width = 0;
-    double max_price = 0.0;
-    int max_qty_available = 0;
-    int max_qty_rented = 0;
-    int max_qty_sold = 0;
 
-    // Iterate through the result set to find maximum widths.
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 0)));
-        max_author_width = fmax(max_author_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        max_genre_width = fmax(max_genre_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
-        max_price = fmax(max_price, sqlite3_column_double(stmt, 3));
-        max_qty_available = fmax(max_qty_available, sqlite3_column_int(stmt, 4));
-        max_qty_rented = fmax(max_qty_rented, sqlite3_column_int(stmt, 5));
-        max_qty_sold = fmax(max_qty_sold, sqlite3_column_int(stmt, 6));
+    for (int i = 0; i < catalog.count; i++) {
+        max_title_width = fmax(max_title_width, (int)strlen(catalogTitle(i)));
+        max_author_width = fmax(max_author_width, (int)strlen(catalogAuthor(i)));
+        max_genre_width = fmax(max_genre_width, (int)strlen(catalogGenre(i)));
     }
 
     // Print separator line.
-    printf("%s",BLUE);
+    fprintf(out, "%s",BLUE);
     for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n",RESET);
+    fprintf(out, "%s\n",RESET);
 
     // Print column headers.
-    printf("%s%-*s | %-*s | %-*s | %-10s | %-15s | %-18s | %s |%s\n",
+    fprintf(out, "%s%-*s | %-*s | %-*s | %-10s | %-15s | %-18s | %s |%s\n",
         BLUE,
         max_title_width, "Title",
         max_author_width, "Author",
@@ -203,36 +196,38 @@ void displayBooks() {
         RESET);
 
     // Print separator line.
-    printf("%s",BLUE);
+    fprintf(out, "%s",BLUE);
     for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n",RESET);
-
-    // Reset the statement to re-execute.
-    sqlite3_reset(stmt);
+    fprintf(out, "%s\n",RESET);
 
     // Print book data.
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        printf("%-*s | %-*s | %-*s | $%-9.2f | %-18d | %-18d | %-13d |\n",
-            max_title_width, (const char *)sqlite3_column_text(stmt, 0),
-            max_author_width, (const char *)sqlite3_column_text(stmt, 1),
-            max_genre_width, (const char *)sqlite3_column_text(stmt, 2),
-            sqlite3_column_double(stmt, 3),
-            sqlite3_column_int(stmt, 4),
-            sqlite3_column_int(stmt, 5),
-            sqlite3_column_int(stmt, 6));
+    for (int i = 0; i < catalog.count; i++) {
+        fprintf(out, "%-*s | %-*s | %-*s | $%-9.2f | %-18d | %-18d | %-13d |\n",
+            max_title_width, catalogTitle(i),
+            max_author_width, catalogAuthor(i),
+            max_genre_width, catalogGenre(i),
+            catalog.prices[i],
+            catalog.available[i],
+            catalog.rented[i],
+            catalog.sold[i]);
         // Print separator line.
         for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
     }
 
-    // Finalize the statement.
-    sqlite3_finalize(stmt);
-    // Close the database connection.
-    sqlite3_close(db);
+    releaseCatalog();
+    return true;
+}
+
+/**
+ * @brief Display the list of books from the database.
+ */
+void displayBooks() {
+    submitRequest("show books");
 }
 
 
@@ -242,76 +237,54 @@ void displayBooks() {
 
     /**
  * @brief Search for books in the database based on a search term (title, author, or genre).
- * 
+ *
  * This function retrieves book information from a SQLite database based on a user-provided search term
  * and prints the search results in a formatted table.
+ *
+ * @param session    The session running the command.
+ * @param searchTerm Term matched against title, author and genre.
+ *
+ * @return True on success, false if the query failed.
  */
-void searchBook() {
-    sqlite3 *db; // SQLite database connection.
-    sqlite3_stmt *stmt; // SQLite statement.
-    int return_code; // Return code for SQLite operations.
-
-    // Open the SQLite database.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
-    char searchTerm[MAX_TITLE_LENGTH];
-    printf("Enter search term (title, author, or genre): ");
-    scanf(" %[^\n]s", searchTerm);
-
-    // SQL query to search for books based on the search term.
-    const char *sql = "SELECT title, author, genre, price, quantity_available, quantity_rented,\
-        quantity_sold FROM books WHERE title LIKE ? OR author LIKE ? OR genre LIKE ?;";
-
-    // Prepare the SQL statement.
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+bool execSearchBook(struct Session *session, const char *searchTerm) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    // Search the resident catalog, matching the term like SQL's LIKE would. Authors and genres are
+    // matched once per name, books then only compare their ids.
+    if (!readCatalog(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    bool *authorMatches = matchNames(&authorNames, searchTerm);
+    bool *genreMatches = matchNames(&genreNames, searchTerm);
 
     // Calculate maximum widths for each column.
     int max_title_width = 0;
     int max_author_width = 0;
     int max_genre_width = 0;
-    double max_price = 0.0;
-    int max_qty_available = 0;
-    int max_qty_rented = 0;
-    int max_qty_sold = 0;
 
-    // Bind search term to the prepared statement.
-    sqlite3_bind_text(stmt, 1, searchTerm, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, searchTerm, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, searchTerm, -1, SQLITE_STATIC);
-
-    // Fetch data to calculate maximum widths.
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 0)));
-        max_author_width = fmax(max_author_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        max_genre_width = fmax(max_genre_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
-        max_price = fmax(max_price, sqlite3_column_double(stmt, 3));
-        max_qty_available = fmax(max_qty_available, sqlite3_column_int(stmt, 4));
-        max_qty_rented = fmax(max_qty_rented, sqlite3_column_int(stmt, 5));
-        max_qty_sold = fmax(max_qty_sold, sqlite3_column_int(stmt, 6));
+    // Find the matches to calculate maximum widths.
+    for (int i = 0; i < catalog.count; i++) {
+        const char *title = catalogTitle(i);
+        const char *author = catalogAuthor(i);
+        const char *genre = catalogGenre(i);
+        if (authorMatches[catalog.authorIds[i]] || genreMatches[catalog.genreIds[i]] || likeMatch(searchTerm, title)) {
+            max_title_width = fmax(max_title_width, (int)strlen(title));
+            max_author_width = fmax(max_author_width, (int)strlen(author));
+            max_genre_width = fmax(max_genre_width, (int)strlen(genre));
+        }
     }
 
-    // Reset the statement to re-execute.
-    sqlite3_reset(stmt);
-
-    printf("\n***** Search Results ******\n");
-    printf("%s",BLUE);
+    fprintf(out, "\n***** Search Results ******\n");
+    fprintf(out, "%s",BLUE);
     for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n",RESET);
+    fprintf(out, "%s\n",RESET);
 
     // Print column headers.
-    printf("%s%-*s | %-*s | %-*s | %-10s | %-15s | %-18s | %s | %s\n",
+    fprintf(out, "%s%-*s | %-*s | %-*s | %-10s | %-15s | %-18s | %s | %s\n",
         BLUE,
         max_title_width, "Title",
         max_author_width, "Author",
@@ -322,135 +295,176 @@ void searchBook() {
         "Quantity Sold",
         RESET);
 
-    printf("%s",BLUE);
+    fprintf(out, "%s",BLUE);
     for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n",RESET);
-    
+    fprintf(out, "%s\n",RESET);
+
     // Print search results with aligned columns.
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        if(strcasestr((const char *)sqlite3_column_text(stmt,0),searchTerm) != NULL){
-            printf("%s%-*s %s| %-*s | %-*s | $%-9.2f | %-18d | %-18d | %-13d |\n",
-                GREEN,max_title_width, (const char *)sqlite3_column_text(stmt, 0),RESET,
-                max_author_width, (const char *)sqlite3_column_text(stmt, 1),
-                max_genre_width, (const char *)sqlite3_column_text(stmt, 2),
-                sqlite3_column_double(stmt, 3),
-                sqlite3_column_int(stmt, 4),
-                sqlite3_column_int(stmt, 5),
-                sqlite3_column_int(stmt, 6));
+    for (int i = 0; i < catalog.count; i++) {
+        const char *title = catalogTitle(i);
+        const char *author = catalogAuthor(i);
+        const char *genre = catalogGenre(i);
+        if (!authorMatches[catalog.authorIds[i]] && !genreMatches[catalog.genreIds[i]] && !likeMatch(searchTerm, title)) {
+            continue;
+        }
+        if(strcasestr(title,searchTerm) != NULL){
+            fprintf(out, "%s%-*s %s| %-*s | %-*s | $%-9.2f | %-18d | %-18d | %-13d |\n",
+                GREEN,max_title_width, title,RESET,
+                max_author_width, author,
+                max_genre_width, genre,
+                catalog.prices[i],
+                catalog.available[i],
+                catalog.rented[i],
+                catalog.sold[i]);
         for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
         }
-        else if(strcasestr((const char *)sqlite3_column_text(stmt,1),searchTerm) != NULL){
-            printf("%-*s | %s%-*s %s| %-*s | $%-9.2f | %-18d | %-18d | %-13d |\n",
-                max_title_width, (const char *)sqlite3_column_text(stmt, 0),
-                GREEN,max_author_width, (const char *)sqlite3_column_text(stmt, 1),RESET,
-                max_genre_width, (const char *)sqlite3_column_text(stmt, 2),
-                sqlite3_column_double(stmt, 3),
-                sqlite3_column_int(stmt, 4),
-                sqlite3_column_int(stmt, 5),
-                sqlite3_column_int(stmt, 6));
+        else if(strcasestr(author,searchTerm) != NULL){
+            fprintf(out, "%-*s | %s%-*s %s| %-*s | $%-9.2f | %-18d | %-18d | %-13d |\n",
+                max_title_width, title,
+                GREEN,max_author_width, author,RESET,
+                max_genre_width, genre,
+                catalog.prices[i],
+                catalog.available[i],
+                catalog.rented[i],
+                catalog.sold[i]);
 
         for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
         }
-        else if(strcasestr((const char *)sqlite3_column_text(stmt,2),searchTerm) != NULL){
-            printf("%-*s | %-*s | %s%-*s %s| $%-9.2f | %-18d | %-18d | %-13d | \n",
-                max_title_width, (const char *)sqlite3_column_text(stmt, 0),
-                max_author_width, (const char *)sqlite3_column_text(stmt, 1),
-                GREEN,max_genre_width, (const char *)sqlite3_column_text(stmt, 2),RESET,
-                sqlite3_column_double(stmt, 3),
-                sqlite3_column_int(stmt, 4),
-                sqlite3_column_int(stmt, 5),
-                sqlite3_column_int(stmt, 6));
+        else if(strcasestr(genre,searchTerm) != NULL){
+            fprintf(out, "%-*s | %-*s | %s%-*s %s| $%-9.2f | %-18d | %-18d | %-13d | \n",
+                max_title_width, title,
+                max_author_width, author,
+                GREEN,max_genre_width, genre,RESET,
+                catalog.prices[i],
+                catalog.available[i],
+                catalog.rented[i],
+                catalog.sold[i]);
 
         for(int i =0;i < (max_title_width + max_author_width + max_genre_width + 79);i++){
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
         }
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    releaseCatalog();
+    free(authorMatches);
+    free(genreMatches);
+    return true;
+}
+
+/**
+ * @brief Prompts for a search term and searches the books by title, author or genre.
+ */
+void searchBook() {
+    struct Arena arena = {0};
+    struct Text *searchTerm;
+    do {
+        printf("Enter search term (title, author, or genre): ");
+        searchTerm = readText(&arena);
+    } while (!validateField(searchTerm->data));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "search book\t%s", searchTerm->data);
+    freeArena(&arena);
+    submitRequest(request);
 }
 
 //*******************************************************************************************************************************************
 
 
+/**
+ * @brief Update details of a book in the database.
+ *
+ * @param session     The session running the command.
+ * @param searchTitle Title of the book to update.
+ * @param book        New details of the book.
+ *
+ * @return True if the update succeeded, false otherwise.
+ */
+bool execUpdateBook(struct Session *session, const char *searchTitle, const struct Book *book) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    int return_code; // Return code for SQLite operations.
+
+    // Ids of the author and genre, added to their tables if new.
+    int authorId = internName(database, &authorNames, book->author->data);
+    int genreId = internName(database, &genreNames, book->genre->data);
+
+    sqlite3_stmt *stmt = prepareStatement(database, "UPDATE books SET title=?, author_id=?, genre_id=?, price=?, quantity_available=? WHERE title=?;");
+    if (authorId == 0 || genreId == 0 || stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    // Bind values to the prepared statement.
+    sqlite3_bind_text(stmt, 1, book->title->data, book->title->length, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, authorId);
+    sqlite3_bind_int(stmt, 3, genreId);
+    sqlite3_bind_double(stmt, 4, book->price);
+    sqlite3_bind_int(stmt, 5, book->quantity_available);
+    sqlite3_bind_text(stmt, 6, searchTitle, -1, SQLITE_STATIC);
+
+    // Execute the SQL statement.
+    return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    fprintf(out, "%sBook details updated successfully.\n%s", GREEN, RESET);
+    return true;
+}
 
     /**
  * @brief Update details of a book in the database.
- * 
+ *
  * This function allows the user to update details of a book such as title, author, genre, price,
  * and quantity available in the database.
  */
 void updateBook() {
-    sqlite3 *db; // SQLite database connection.
-    char *errMsg = 0; // Error message for SQLite operations.
-    int return_code; // Return code for SQLite operations.
-
-    // Open the SQLite database.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
-    char searchTitle[MAX_TITLE_LENGTH];
+    struct Arena arena = {0};
+    struct Text *searchTitle;
     // Loop until a valid title is entered.
     do {
         printf("Enter the title of the book to update: ");
-        scanf(" %[^\n]s", searchTitle);
-    } while (!validateTitle(searchTitle));
+        searchTitle = readText(&arena);
+    } while (!validateTitle(searchTitle->data));
 
     struct Book updatedBook;
 
     // Loop until a valid title is entered.
     do {
         printf("Enter new title: ");
-        scanf(" %[^\n]s", updatedBook.title);
-    } while (!validateTitle(updatedBook.title));
+        updatedBook.title = readText(&arena);
+    } while (!validateTitle(updatedBook.title->data));
 
-    printf("Enter new author: ");
-    scanf(" %[^\n]s", updatedBook.author);
-    printf("Enter new genre: ");
-    scanf(" %[^\n]s", updatedBook.genre);
+    do {
+        printf("Enter new author: ");
+        updatedBook.author = readText(&arena);
+    } while (!validateField(updatedBook.author->data));
+    do {
+        printf("Enter new genre: ");
+        updatedBook.genre = readText(&arena);
+    } while (!validateField(updatedBook.genre->data));
     printf("Enter new price: ");
     scanf("%f", &updatedBook.price);
     printf("Enter new quantity available: ");
     scanf("%d", &updatedBook.quantity_available);
 
-    char sql[1000];
-    sprintf(sql, "UPDATE books SET title=?, author=?, genre=?, price=?, quantity_available=? WHERE title=?;");
-
-    sqlite3_stmt *stmt;
-    // Prepare the SQL statement.
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    // Bind values to the prepared statement.
-    sqlite3_bind_text(stmt, 1, updatedBook.title, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, updatedBook.author, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 3, updatedBook.genre, -1, SQLITE_STATIC);
-    sqlite3_bind_double(stmt, 4, updatedBook.price);
-    sqlite3_bind_int(stmt, 5, updatedBook.quantity_available);
-    sqlite3_bind_text(stmt, 6, searchTitle, -1, SQLITE_STATIC);
-
-    // Execute the SQL statement.
-    return_code = sqlite3_step(stmt);
-    if (return_code != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-    } else {
-        printf("%sBook details updated successfully.\n%s", GREEN, RESET);
-    }
-
-    sqlite3_finalize(stmt); // Finalize the prepared statement.
-    sqlite3_close(db); // Close the database connection.
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "update book\t%s\t%s\t%s\t%s\t%f\t%d", searchTitle->data, updatedBook.title->data,
+             updatedBook.author->data, updatedBook.genre->data, updatedBook.price, updatedBook.quantity_available);
+    freeArena(&arena);
+    submitRequest(request);
 }
 
 
@@ -460,48 +474,26 @@ void updateBook() {
 
  /**
  * @brief Sell a specified quantity of a book from the database.
- * 
- * This function allows the user to sell a specified quantity of a book from the database.
- * It updates the quantity sold and quantity available for the specified book.
+ *
+ * This function updates the quantity sold and quantity available for the specified book.
+ *
+ * @param session   The session running the command.
+ * @param sellTitle Title of the book to sell.
+ * @param quantity  Number of copies sold.
+ *
+ * @return True if the sale was recorded, false otherwise.
  */
-void sellBook() {
-    sqlite3 *db; // SQLite database connection.
-    char *errMsg = 0; // Error message for SQLite operations.
-    int return_code; // Return code for SQLite operations.
-
-    // Open the SQLite database.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
+bool execSellBook(struct Session *session, const char *sellTitle, int quantity) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
-    char sellTitle[MAX_TITLE_LENGTH];
-    // Loop until a valid title is entered.
-    do {
-        printf("Enter the title of the book to sell: ");
-        scanf(" %[^\n]s", sellTitle);
-    } while (!validateTitle(sellTitle));
-    
-    int quantity;
-    // Loop until a valid quantity is entered.
-    do {
-        printf("Enter quantity to sell: ");
-        scanf("%d", &quantity);
-    } while (!validateQuantity(quantity));
-
-    char sql[1000];
-    // Construct SQL statement to check if enough books are available.
-    sprintf(sql, "SELECT quantity_available FROM books WHERE title=?;");
+    int return_code; // Return code for SQLite operations.
 
-    // Prepare the SQL statement.
-    sqlite3_stmt *stmt;
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Prepare the SQL statement to check if enough books are available.
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT quantity_available FROM books WHERE title=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind the title parameter to the prepared statement.
@@ -511,31 +503,22 @@ void sellBook() {
     return_code = sqlite3_step(stmt);
     if (return_code == SQLITE_ROW) {
         int available_quantity = sqlite3_column_int(stmt, 0);
+        sqlite3_reset(stmt);
         if (available_quantity < quantity) {
-            printf("%sNot enough books available to sell.%s\n",RED,RESET);
-            sqlite3_finalize(stmt);
-            sqlite3_close(db);
-            return;
+            fprintf(out, "%sNot enough books available to sell.%s\n",RED,RESET);
+            return false;
         }
     } else {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        return;
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        sqlite3_reset(stmt);
+        return false;
     }
 
-    // Finalize the statement.
-    sqlite3_finalize(stmt);
-
-    // Construct SQL statement to update quantity sold and available.
-    sprintf(sql, "UPDATE books SET quantity_sold = quantity_sold + ?, quantity_available = quantity_available - ? WHERE title=?;");
-
-    // Prepare the SQL statement.
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Prepare the SQL statement to update quantity sold and available.
+    stmt = prepareStatement(database, "UPDATE books SET quantity_sold = quantity_sold + ?, quantity_available = quantity_available - ? WHERE title=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind the parameters to the prepared statement.
@@ -545,277 +528,298 @@ void sellBook() {
 
     // Execute the prepared statement.
     return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (return_code != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-    } else {
-        printf("%sSale successful.\n%s", GREEN, RESET);
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    fprintf(out, "%sSale successful.\n%s", GREEN, RESET);
+    return true;
+}
 
-    // Finalize the statement and close the database connection.
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+ /**
+ * @brief Sell a specified quantity of a book from the database.
+ *
+ * This function allows the user to sell a specified quantity of a book from the database.
+ * It updates the quantity sold and quantity available for the specified book.
+ */
+void sellBook() {
+    struct Arena arena = {0};
+    struct Text *sellTitle;
+    // Loop until a valid title is entered.
+    do {
+        printf("Enter the title of the book to sell: ");
+        sellTitle = readText(&arena);
+    } while (!validateTitle(sellTitle->data));
+
+    int quantity;
+    // Loop until a valid quantity is entered.
+    do {
+        printf("Enter quantity to sell: ");
+        scanf("%d", &quantity);
+    } while (!validateQuantity(quantity));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "sell book\t%s\t%d", sellTitle->data, quantity);
+    freeArena(&arena);
+    submitRequest(request);
 }
 
 
 
 /**
  * @brief Delete book(s) from the database.
- * 
+ *
+ * Deletes a single book when a title is given, or all books when title is NULL.
+ *
+ * @param session  The session running the command.
+ * @param title    Title of the book to delete, or NULL to delete all books.
+ *
+ * @return True if the deletion succeeded, false otherwise.
+ */
+bool execDelBook(struct Session *session, const char *title) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    if (session->userRole != 0) {
+        fprintf(out, "%sYou don't have permission for this action!\n This incident will be reported.\n%s", RED, RESET);
+        session->denied = true;
+        return false;
+    }
+
+    int return_code; // Return code for SQLite operations.
+    sqlite3_stmt *stmt;
+
+    if (title != NULL) {
+        // Prepare the SQL statement to delete a single book.
+        stmt = prepareStatement(database, "DELETE FROM books WHERE title=?;");
+        if (stmt == NULL) {
+            fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+            return false;
+        }
+        // Bind the book title to the prepared statement.
+        sqlite3_bind_text(stmt, 1, title, -1, SQLITE_STATIC);
+    } else {
+        // Prepare the SQL statement to delete all books.
+        stmt = prepareStatement(database, "DELETE FROM books;");
+        if (stmt == NULL) {
+            fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+            return false;
+        }
+    }
+
+    // Execute the SQL statement.
+    return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    if (title == NULL) {
+        // SQLite truncates the table without reporting each row to the update hook.
+        invalidateCatalog();
+    }
+    if (title != NULL) {
+        fprintf(out, "%sBook deleted successfully.\n%s", GREEN, RESET);
+    } else {
+        fprintf(out, "%sAll books deleted successfully.\n%s", GREEN, RESET);
+    }
+    return true;
+}
+
+/**
+ * @brief Delete book(s) from the database.
+ *
  * This function allows the user to delete a single book or all books from the database.
  * The mode parameter determines whether to delete a single book (mode = 1) or all books (mode = 0).
  */
 void delBook(int mode) {
-    if (userRole != 0) {
-        printf("%sYou don't have permission for this action!\n This incident will be reported.\n%s", RED, RESET);
-    } else {
-        sqlite3 *db; // SQLite database connection.
-        char *errMsg = 0; // Error message for SQLite operations.
-        int return_code; // Return code for SQLite operations.
-
-        // Open the SQLite database.
-        return_code = sqlite3_open(DATABASE_FILE, &db);
-        if (return_code) {
-            fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-            sqlite3_close(db);
-            return;
+    if (mode == 1) {
+        struct Arena arena = {0};
+        struct Text *del_book;
+        // Loop until a valid book title is entered.
+        do {
+            printf("Enter the book to delete: ");
+            del_book = readText(&arena);
+        } while (!validateUsername(del_book->data));
+
+        char request[REQUEST_MAX_LENGTH];
+        snprintf(request, sizeof(request), "del book\t%s", del_book->data);
+        freeArena(&arena);
+        submitRequest(request);
+    } else if (mode == 0) {
+        char choice[10];
+        printf("%sDelete all books(yes/no): %s", YELLOW, RESET);
+        fgets(choice, sizeof(choice), stdin);
+
+        // Remove newline character if present.
+        if (strlen(choice) > 0 && choice[strlen(choice) - 1] == '\n') {
+            choice[strlen(choice) - 1] = '\0';
         }
-        if (mode == 1) {
-            
-            char del_book[MAX_TITLE_LENGTH];
-            // Loop until a valid book title is entered.
-            do {
-                printf("Enter the book to delete: ");
-                scanf(" %[^\n]s", del_book);
-            } while (!validateUsername(del_book));
-
-            char sql[1000];
-            // Construct SQL statement to delete a single book.
-            sprintf(sql, "DELETE FROM books WHERE title=?;");
-            
-            sqlite3_stmt *stmt;
-            // Prepare the SQL statement.
-            sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-            // Bind the book title to the prepared statement.
-            sqlite3_bind_text(stmt, 1, del_book, -1, SQLITE_STATIC);
-
-            // Execute the SQL statement.
-            return_code = sqlite3_step(stmt);
-            if (return_code != SQLITE_DONE) {
-                fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-            } else {
-                printf("%sBook deleted successfully.\n%s", GREEN, RESET);
-            } 
-
-            sqlite3_finalize(stmt); // Finalize the prepared statement.
-            sqlite3_close(db); // Close the database connection.
-        } else if (mode == 0) {
-            char choice[10];
-            printf("%sDelete all books(yes/no): %s", YELLOW, RESET);
-            fgets(choice, sizeof(choice), stdin); 
-            
-            // Remove newline character if present.
-            if (strlen(choice) > 0 && choice[strlen(choice) - 1] == '\n') {
-                choice[strlen(choice) - 1] = '\0';
-            }
-
-            if (strcmp(choice, "yes") == 0) {
-                char sql[1000];
-                // Construct SQL statement to delete all books.
-                sprintf(sql, "DELETE FROM books;");
-                
-                sqlite3_stmt *stmt;
-                // Prepare the SQL statement.
-                sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-
-                // Execute the SQL statement.
-                return_code = sqlite3_step(stmt);
-                if (return_code != SQLITE_DONE) {
-                    fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-                } else {
-                    printf("%sAll books deleted successfully.\n%s", GREEN, RESET);
-                }
-                sqlite3_finalize(stmt); // Finalize the prepared statement.
-                sqlite3_close(db); // Close the database connection.
-            } else {
-                printf("%sDeletion aborted.\n%s", RED, RESET);
-            }
+
+        if (strcmp(choice, "yes") == 0) {
+            submitRequest("del allbooks");
+        } else {
+            printf("%sDeletion aborted.\n%s", RED, RESET);
         }
     }
 }
 
 
 //****************************************************************************************************************************************
-    
+
 /**
  * @brief Function to rent a book and update the database accordingly.
- * 
- * This function connects to the SQLite database, prompts the user to enter information about the book rental,
- * validates the input, calculates the return date based on the current date and rental duration,
- * updates the database with the rental details, and closes the database connection.
- * 
- * @return void
+ *
+ * Checks availability, calculates the return date based on the current date and rental duration,
+ * and updates the books and rents tables.
+ *
+ * @param session  The session running the command.
+ * @param newRent  Title, customer name, phone and rental duration of the new rental.
+ *
+ * @return True if the book was rented, false otherwise.
  */
-void rentBook() {
-    sqlite3 *db; // SQLite database pointer
-    char *errMsg = 0; // Error message pointer
-    int return_code; // Return code from SQLite functions
-    int quantity = 1;   
-
-    // Open the SQLite database
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        // If opening the database fails, print error message, close the database, and return
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
+bool execRentBook(struct Session *session, struct Rent *newRent) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
-    // Structure to hold information about the new rental
-    struct Rent newRent;
+    int return_code; // Return code from SQLite functions
+    int quantity = 1;
 
     // Get the current date
     char current_date[11]; // 10 characters for the date + 1 for the null terminator
     time_t t = time(NULL);
-    struct tm *today = localtime(&t);
-    strftime(current_date, sizeof(current_date), "%Y-%m-%d", today); // Format as YYYY-MM-DD
+    struct tm today;
+    localtime_r(&t, &today);
+    strftime(current_date, sizeof(current_date), "%Y-%m-%d", &today); // Format as YYYY-MM-DD
 
     // Set the rented date to the current date
-    strcpy(newRent.rented_date, current_date);
-
-    // Prompt user to enter the title of the book to rent and validate it
-    do {
-        printf("Enter the title of the book to rent: ");
-        scanf(" %[^\n]s", newRent.title);
-    } while (!validateTitle(newRent.title));
-    char sql[1000];
-    // Construct SQL statement to check if enough books are available.
-    sprintf(sql, "SELECT quantity_available FROM books WHERE title=?;");
+    newRent->rented_date = arenaText(&session->arena, current_date);
 
-    // Prepare the SQL statement.
-    sqlite3_stmt *stmt;
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // Prepare the SQL statement to check if enough books are available.
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT quantity_available FROM books WHERE title=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind the title parameter to the prepared statement.
-    sqlite3_bind_text(stmt, 1, newRent.title, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 1, newRent->title->data, newRent->title->length, SQLITE_STATIC);
 
     // Execute the prepared statement.
     return_code = sqlite3_step(stmt);
     if (return_code == SQLITE_ROW) {
         int available_quantity = sqlite3_column_int(stmt, 0);
+        sqlite3_reset(stmt);
         if (available_quantity < quantity) {
-            printf("%sNot enough books available to rent.%s\n",RED,RESET);
-            sqlite3_finalize(stmt);
-            sqlite3_close(db);
-            return;
+            fprintf(out, "%sNot enough books available to rent.%s\n",RED,RESET);
+            return false;
         }
     } else {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        return;
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        sqlite3_reset(stmt);
+        return false;
     }
 
-    // Finalize the statement.
-    sqlite3_finalize(stmt);
-
-    // Prompt user to enter the name of the customer and validate it
-    do {
-        printf("Enter name of the customer: ");
-        clearInputBuffer();
-        fgets(newRent.customer_name, sizeof(newRent.customer_name), stdin); 
-        
-        // Remove newline character if present.
-        if (strlen(newRent.customer_name) > 0 && newRent.customer_name[strlen(newRent.customer_name) - 1] == '\n') {
-            newRent.customer_name[strlen(newRent.customer_name ) - 1] = '\0';
-        }
-    } while (!validateUsername(newRent.customer_name));
-
-    // Prompt user to enter the phone number of the customer
-    do{
-        printf("Enter phone number of customer: ");
-        scanf("%s", newRent.customer_phone);
-        if(!validatePhone(newRent.customer_phone)){
-            printf("%sWrong phone number format.\n%s",RED,RESET);  
-        }
-    }while(!validatePhone(newRent.customer_phone));
-
-    
-    // Prompt user to enter the number of days to rent and validate it
-    do {
-        printf("Enter number of days to rent: ");
-        scanf("%d", &newRent.rented_for_days);
-    } while (!validateDays(newRent.rented_for_days));
-
     // Calculate the return date based on the rented date and rental duration
-    today->tm_mday += newRent.rented_for_days;
-    mktime(today);
-    char return_date[11]; 
-    strftime(return_date, sizeof(return_date), "%Y-%m-%d", today); // Format as YYYY-MM-DD
-    strcpy(newRent.return_date, return_date); // Set the return date in the new rental information
-    newRent.quantity_rented = 1; // Set the quantity rented to 1
-
-    // SQL statements to update the books table and insert a new rental record into the rents table
-    char sql1[1000];
-    char sql2[1000];
-    sprintf(sql1, "UPDATE books SET quantity_rented = quantity_rented + 1, quantity_available = quantity_available - 1, quantity_rented_all = quantity_rented_all + 1, quantity_rented_days = quantity_rented_days + ?     WHERE title=?;");
-    sprintf(sql2, "INSERT INTO rents (title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date) VALUES (?, ?, ?, ?, ?, ?, ?);");
-
-    // Prepare the SQL statements
-    sqlite3_stmt *stmt1, *stmt2;
-    return_code = sqlite3_prepare_v2(db, sql1, -1, &stmt1, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    today.tm_mday += newRent->rented_for_days;
+    mktime(&today);
+    char return_date[11];
+    strftime(return_date, sizeof(return_date), "%Y-%m-%d", &today); // Format as YYYY-MM-DD
+    newRent->return_date = arenaText(&session->arena, return_date); // Set the return date in the new rental information
+    newRent->quantity_rented = 1; // Set the quantity rented to 1
+
+    // Prepare the SQL statements to update the books table and insert a new rental record into the rents table
+    sqlite3_stmt *stmt1 = prepareStatement(database, "UPDATE books SET quantity_rented = quantity_rented + 1, quantity_available = quantity_available - 1, quantity_rented_all = quantity_rented_all + 1, quantity_rented_days = quantity_rented_days + ?     WHERE title=?;");
+    if (stmt1 == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
-    return_code = sqlite3_prepare_v2(db, sql2, -1, &stmt2, 0);
-    if (return_code != SQLITE_OK) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt1);
-        sqlite3_close(db);
-        return;
+    sqlite3_stmt *stmt2 = prepareStatement(database, "INSERT INTO rents (title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date) VALUES (?, ?, ?, ?, ?, ?, ?);");
+    if (stmt2 == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind parameters for the first SQL statement
-    sqlite3_bind_int(stmt1, 1, newRent.rented_for_days);
-    sqlite3_bind_text(stmt1, 2, newRent.title, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt1, 1, newRent->rented_for_days);
+    sqlite3_bind_text(stmt1, 2, newRent->title->data, newRent->title->length, SQLITE_STATIC);
 
     // Bind parameters for the second SQL statement
-    sqlite3_bind_text(stmt2, 1, newRent.title, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt2, 2, newRent.customer_name, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt2, 3, newRent.customer_phone, -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt2, 4, newRent.quantity_rented);
-    sqlite3_bind_int(stmt2, 5, newRent.rented_for_days);
-    sqlite3_bind_text(stmt2, 6, newRent.rented_date, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt2, 7, newRent.return_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt2, 1, newRent->title->data, newRent->title->length, SQLITE_STATIC);
+    sqlite3_bind_text(stmt2, 2, newRent->customer_name->data, newRent->customer_name->length, SQLITE_STATIC);
+    sqlite3_bind_text(stmt2, 3, newRent->customer_phone->data, newRent->customer_phone->length, SQLITE_STATIC);
+    sqlite3_bind_int(stmt2, 4, newRent->quantity_rented);
+    sqlite3_bind_int(stmt2, 5, newRent->rented_for_days);
+    sqlite3_bind_text(stmt2, 6, newRent->rented_date->data, newRent->rented_date->length, SQLITE_STATIC);
+    sqlite3_bind_text(stmt2, 7, newRent->return_date->data, newRent->return_date->length, SQLITE_STATIC);
 
     // Execute the prepared SQL statements
     return_code = sqlite3_step(stmt1);
+    sqlite3_reset(stmt1);
     if (return_code != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt1);
-        sqlite3_finalize(stmt2);
-        sqlite3_close(db);
-        return;
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     return_code = sqlite3_step(stmt2);
+    sqlite3_reset(stmt2);
     if (return_code != SQLITE_DONE) {
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-    } else {
-        printf("%sBook rented successfully for %d days.\n%s", GREEN, newRent.rented_for_days, RESET);
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    noteRental(sqlite3_last_insert_rowid(database->db));
+    fprintf(out, "%sBook rented successfully for %d days.\n%s", GREEN, newRent->rented_for_days, RESET);
+    return true;
+}
 
-    // Finalize the statements and close the database connection
-    sqlite3_finalize(stmt1);
-    sqlite3_finalize(stmt2);
-    sqlite3_close(db);
+/**
+ * @brief Function to rent a book and update the database accordingly.
+ *
+ * This function prompts the user to enter information about the book rental,
+ * validates the input and submits the rental.
+ *
+ * @return void
+ */
+void rentBook() {
+    // Structure to hold information about the new rental
+    struct Rent newRent;
+    struct Arena arena = {0};
+
+    // Prompt user to enter the title of the book to rent and validate it
+    do {
+        printf("Enter the title of the book to rent: ");
+        newRent.title = readText(&arena);
+    } while (!validateTitle(newRent.title->data));
+
+    // Prompt user to enter the name of the customer and validate it
+    do {
+        printf("Enter name of the customer: ");
+        newRent.customer_name = readText(&arena);
+    } while (!validateUsername(newRent.customer_name->data));
+
+    // Prompt user to enter the phone number of the customer
+    do{
+        printf("Enter phone number of customer: ");
+        newRent.customer_phone = readText(&arena);
+        if(!validatePhone(newRent.customer_phone->data)){
+            printf("%sWrong phone number format.\n%s",RED,RESET);
+        }
+    }while(!validatePhone(newRent.customer_phone->data));
+
+
+    // Prompt user to enter the number of days to rent and validate it
+    do {
+        printf("Enter number of days to rent: ");
+        scanf("%d", &newRent.rented_for_days);
+    } while (!validateDays(newRent.rented_for_days));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "rent book\t%s\t%s\t%s\t%d",
+             newRent.title->data, newRent.customer_name->data, newRent.customer_phone->data, newRent.rented_for_days);
+    freeArena(&arena);
+    submitRequest(request);
 }
 
 
@@ -823,51 +827,29 @@ void rentBook() {
 //**********************************************************************************************************************
 
 /**
- * @brief Function to display the list of rented books.
- * 
- * This function connects to the SQLite database, retrieves the list of rented books from the rents table,
- * calculates the maximum widths for each column, prints column headers and rent data,
- * and closes the database connection.
- * 
- * @return void
+ * @brief Prints rent rows of a prepared statement in a formatted table.
+ *
+ * The statement must select id, title, Name, Phone, quantity_rented, rented_for_days, rent_date
+ * and return_date, in that order.
+ *
+ * @param out        Stream receiving the table.
+ * @param stmt       The prepared and bound statement.
+ * @param highlight  Term highlighted in green in the matching column, or NULL.
+ * @param lateColor  Color of the return date column, or NULL.
  */
-void displayRent() {
-    sqlite3 *db; // SQLite database pointer
-    sqlite3_stmt *stmt; // SQLite statement pointer
+void printRents(FILE *out, sqlite3_stmt *stmt, const char *highlight, const char *lateColor) {
     int return_code; // Return code from SQLite functions
 
-    // Open the SQLite database
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code != SQLITE_OK) {
-        // If opening the database fails, print error message, close the database, and return
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
-    printf("\n********** List of Rents **************\n");
-
-    // SQL query to select rent information
-    const char *sql = "SELECT id, title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date FROM rents;";
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        // If preparing the SQL statement fails, print error message, close the database, and return
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
     // Calculate maximum widths for each column
     int max_title_width = 0;
     int max_name_width = 0;
     int max_phone_width = 0;
     int max_qty_rented = 0;
-    int max_rfd_width = 17; // Assuming "Rented for Days" width is fixed
     int max_rentdate_width = 0;
     int max_returndate_width = 0;
 
     // Iterate through the result set to calculate maximum widths
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {  
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
         max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
         max_name_width = fmax(max_name_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
         max_phone_width = fmax(max_phone_width, (int)strlen((const char *)sqlite3_column_text(stmt, 3)));
@@ -877,14 +859,14 @@ void displayRent() {
     }
 
     // Print horizontal line separator
-    printf("%s", BLUE);
+    fprintf(out, "%s", BLUE);
     for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n", RESET);
+    fprintf(out, "%s\n", RESET);
 
     // Print column headers
-    printf("%s %-7s | %-*s | %-*s | %-*s | %-6s | %-15s | %-18s | %s |%s\n",
+    fprintf(out, "%s %-7s | %-*s | %-*s | %-*s | %-6s | %-15s | %-18s | %s |%s\n",
         BLUE,"Id",
         max_title_width, "Title",
         max_name_width, "Name",
@@ -896,37 +878,78 @@ void displayRent() {
             RESET);
 
     // Print horizontal line separator
-    printf("%s", BLUE);
+    fprintf(out, "%s", BLUE);
     for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-        printf("-");
+        fprintf(out, "-");
     }
-    printf("%s\n", RESET);
+    fprintf(out, "%s\n", RESET);
 
     // Print rent data
     sqlite3_reset(stmt); // Reset the statement to re-execute
     while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        printf("%-8d | %-*s | %-*s | %-*s | %-15d | %-15d | %-18s | %-11s |\n",
+        const char *title = (const char *)sqlite3_column_text(stmt, 1);
+        const char *name = (const char *)sqlite3_column_text(stmt, 2);
+        const char *phone = (const char *)sqlite3_column_text(stmt, 3);
+
+        // Print the matching column in green when searching
+        bool titleMatch = highlight != NULL && strcmp(title, highlight) == 0;
+        bool nameMatch = highlight != NULL && !titleMatch && strcmp(name, highlight) == 0;
+        bool phoneMatch = highlight != NULL && !titleMatch && !nameMatch && strcmp(phone, highlight) == 0;
+
+        fprintf(out, "%-8d | %s%-*s %s| %s%-*s %s| %s%-*s %s| %-15d | %-15d | %-18s | %s%-11s%s |\n",
             sqlite3_column_int(stmt, 0),
-            max_title_width, (const char *)sqlite3_column_text(stmt, 1),
-            max_name_width, (const char *)sqlite3_column_text(stmt, 2),
-            max_phone_width, (const char *)sqlite3_column_text(stmt, 3),
+            titleMatch ? GREEN : "", max_title_width, title, titleMatch ? RESET : "",
+            nameMatch ? GREEN : "", max_name_width, name, nameMatch ? RESET : "",
+            phoneMatch ? GREEN : "", max_phone_width, phone, phoneMatch ? RESET : "",
             sqlite3_column_int(stmt, 4),
             sqlite3_column_int(stmt, 5),
             sqlite3_column_text(stmt, 6),
-            sqlite3_column_text(stmt, 7));
-            
+            lateColor != NULL ? lateColor : "",
+            sqlite3_column_text(stmt, 7),
+            lateColor != NULL ? RESET : "");
+
         // Print horizontal line separator
         for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-            printf("-");
+            fprintf(out, "-");
         }
-        printf("\n");
+        fprintf(out, "\n");
+    }
+
+    sqlite3_reset(stmt);
+}
+
+/**
+ * @brief Function to display the list of rented books.
+ *
+ * @param session The session running the command.
+ *
+ * @return True on success, false if the query failed.
+ */
+bool execShowRents(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
+    fprintf(out, "\n********** List of Rents **************\n");
+
+    // SQL query to select rent information
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT id, title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date FROM rents;");
+    if (stmt == NULL) {
+        // If preparing the SQL statement fails, print error message and return
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
-    // Finalize the SQLite statement
-    sqlite3_finalize(stmt);
-    // Close the database connection
-    sqlite3_close(db);
+    printRents(out, stmt, NULL, NULL);
+    return true;
+}
+
+/**
+ * @brief Function to display the list of rented books.
+ *
+ * @return void
+ */
+void displayRent() {
+    submitRequest("show rents");
 }
 
 //*******************************************************************************************************************
@@ -935,142 +958,55 @@ void displayRent() {
 
 /**
  * @brief Function to search for rented books by title, customer name, or phone number.
- * 
- * This function connects to the SQLite database, prompts the user for a search term,
- * performs a search based on title, customer name, or phone number using a LIKE query,
- * prints the search results with aligned columns, and closes the database connection.
- * 
- * @return void
+ *
+ * Performs a search based on title, customer name, or phone number using a LIKE query
+ * and prints the search results with aligned columns.
+ *
+ * @param session    The session running the command.
+ * @param searchTerm Term matched against title, name and phone.
+ *
+ * @return True on success, false if the query failed.
  */
-void searchRent() {
-    sqlite3 *db; // SQLite database pointer
-    sqlite3_stmt *stmt; // SQLite statement pointer
-    int return_code; // Return code from SQLite functions
-
-    // Open the SQLite database
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        // If opening the database fails, print error message, close the database, and return
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
-
-    char searchTerm[MAX_TITLE_LENGTH]; // Array to store search term
-    printf("Enter search term (title, name, or phone): ");
-    scanf(" %[^\n]s", searchTerm); // Prompt user for search term
+bool execSearchRent(struct Session *session, const char *searchTerm) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
     // SQL query to select rent information based on title, name, or phone
-    const char *sql = "SELECT id, title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date FROM rents WHERE title LIKE ? OR Name LIKE ? OR Phone LIKE ?;";
-    
-    // Prepare the SQL statement
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        // If preparing the SQL statement fails, print error message, close the database, and return
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT id, title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date FROM rents WHERE title LIKE ? OR Name LIKE ? OR Phone LIKE ?;");
+    if (stmt == NULL) {
+        // If preparing the SQL statement fails, print error message and return
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
-    // Calculate maximum widths for each column
-    int max_title_width = 0;
-    int max_name_width = 0;
-    int max_phone_width = 0;
-    int max_qty_rented = 0;
-    int max_rfd_width = 17; // Assuming "Rented for Days" width is fixed
-    int max_rentdate_width = 0;
-    int max_returndate_width = 0;
-
     // Bind search term to the prepared statement
     sqlite3_bind_text(stmt, 1, searchTerm, -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, searchTerm, -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 3, searchTerm, -1, SQLITE_STATIC);
 
-    // Fetch data to calculate maximum widths
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        max_name_width = fmax(max_name_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
-        max_phone_width = fmax(max_phone_width, (int)strlen((const char *)sqlite3_column_text(stmt, 3)));
-        max_qty_rented = fmax(max_qty_rented, sqlite3_column_int(stmt, 4));
-        max_rentdate_width = fmax(max_rentdate_width, (int)strlen((const char *)sqlite3_column_text(stmt, 6)));
-        max_returndate_width = fmax(max_returndate_width, (int)strlen((const char *)sqlite3_column_text(stmt, 7)));
-    }
-
-    // Reset the statement to re-execute
-    sqlite3_reset(stmt);
-
     // Print search results header
-    printf("\n***** Search Results ******\n");
-    printf("%s", BLUE);
-    for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-        printf("-");
-    }
-    printf("%s\n", RESET);
-
-    // Print column headers
-    printf("%s %-7s | %-*s | %-*s | %-*s | %-6s | %-15s | %-18s | %s |%s\n",
-        BLUE,"Id",
-        max_title_width, "Title",
-        max_name_width, "Name",
-        max_phone_width, "Phone",
-        "Quantity Rented",
-        "Rented for Days",
-        "Rent Date",
-        "Return Date",
-            RESET);
-
-    printf("%s", BLUE);
-    for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-        printf("-");
-    }
-    printf("%s\n", RESET);
-    
-    // Print search results with aligned columns    
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        // Print search results based on the matching column
-        if(strcmp((const char *)sqlite3_column_text(stmt,1),searchTerm) == 0){
-            printf("%-8d | %s%-*s %s| %-*s | %-*s | %-15d | %-15d | %-18s | %-11s |\n",
-                sqlite3_column_int(stmt, 0),
-                GREEN,max_title_width, (const char *)sqlite3_column_text(stmt, 1),RESET,
-                max_name_width, (const char *)sqlite3_column_text(stmt, 2),
-                max_phone_width, (const char *)sqlite3_column_text(stmt, 3),
-                sqlite3_column_int(stmt, 4),
-                sqlite3_column_int(stmt, 5),
-                sqlite3_column_text(stmt, 6),
-                sqlite3_column_text(stmt, 7));
-                
-        } else if(strcmp((const char *)sqlite3_column_text(stmt,2),searchTerm) == 0){
-            printf("%-8d | %-*s | %s%-*s %s| %-*s | %-15d | %-15d | %-18s | %-11s |\n",
-                sqlite3_column_int(stmt,0),
-                max_title_width, (const char *)sqlite3_column_text(stmt, 1),
-                GREEN,max_name_width, (const char *)sqlite3_column_text(stmt, 2),RESET,
-                max_phone_width, (const char *)sqlite3_column_text(stmt, 3),
-                sqlite3_column_int(stmt, 4),
-                sqlite3_column_int(stmt, 5),
-                sqlite3_column_text(stmt, 6),
-                sqlite3_column_text(stmt, 7));
-        } else if(strcmp((const char *)sqlite3_column_text(stmt,3),searchTerm) == 0){
-            printf("%-8d | %-*s | %-*s | %s%-*s %s| %-15d | %-15d | %-18s | %-11s | \n",
-                sqlite3_column_int(stmt,0),
-                max_title_width, (const char *)sqlite3_column_text(stmt, 1),
-                max_name_width, (const char *)sqlite3_column_text(stmt, 2),
-                GREEN,max_phone_width, (const char *)sqlite3_column_text(stmt, 3),RESET,
-                sqlite3_column_int(stmt, 4),
-                sqlite3_column_int(stmt, 5),
-                sqlite3_column_text(stmt, 6),
-                sqlite3_column_text(stmt, 7));
-        }
-        // Print horizontal line separator
-        for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-            printf("-");
-        }
-        printf("\n");
-    }
+    fprintf(out, "\n***** Search Results ******\n");
+    printRents(out, stmt, searchTerm, NULL);
+    return true;
+}
 
-    // Finalize the SQLite statement
-    sqlite3_finalize(stmt);
-    // Close the database connection
-    sqlite3_close(db);
+/**
+ * @brief Function to search for rented books by title, customer name, or phone number.
+ *
+ * @return void
+ */
+void searchRent() {
+    struct Arena arena = {0};
+    struct Text *searchTerm;
+    do {
+        printf("Enter search term (title, name, or phone): ");
+        searchTerm = readText(&arena); // Prompt user for search term
+    } while (!validateField(searchTerm->data));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "search rent\t%s", searchTerm->data);
+    freeArena(&arena);
+    submitRequest(request);
 }
 
     //************************************************************************************************************
@@ -1080,48 +1016,27 @@ void searchRent() {
 
     /**
  * @brief Function to recall a rented book by its ID.
- * 
- * This function connects to the SQLite database, prompts the user for the ID of the rent to recall,
- * retrieves the title of the rented book corresponding to the given ID, updates the book's quantity_rented
- * and quantity_available in the books table, deletes the rent record from the rents table, and closes the
- * database connection.
- * 
- * @return void
+ *
+ * Retrieves the title of the rented book corresponding to the given ID, updates the book's quantity_rented
+ * and quantity_available in the books table and deletes the rent record from the rents table.
+ *
+ * @param session  The session running the command.
+ * @param id       ID of the rent to recall.
+ *
+ * @return True if the rent was recalled, false otherwise.
  */
-void rentRecall() {
-    sqlite3 *db; // SQLite database pointer
-    sqlite3_stmt *stmt; // SQLite statement pointer
-    char *errMsg = 0; // Error message pointer
-    int return_code; // Return code from SQLite functions
-    int id; // ID of the rent to recall
-    char title[MAX_TITLE_LENGTH]; // Array to store the title of the rented book
-
-    // Open the SQLite database
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
-        // If opening the database fails, print error message, close the database, and return
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
+bool execRentRecall(struct Session *session, int id) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
-    // Prompt the user for the ID of the rent to recall
-    do {
-        printf("Enter the id of the rent to recall: ");
-        scanf("%d", &id);
-    } while (!validateID(id)); // Assume validateID validates against valid ID range in the database
+    int return_code; // Return code from SQLite functions
+    struct Text *title; // Title of the rented book
 
-    char sql[1000]; // Array to store SQL query
     // SQL query to select the title of the rented book corresponding to the given ID
-    sprintf(sql, "SELECT title FROM rents WHERE id=?;");
-
-    // Prepare the SQL statement
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        // If preparing the SQL statement fails, print error message, close the database, and return
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT title FROM rents WHERE id=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind the ID parameter to the prepared statement
@@ -1131,57 +1046,43 @@ void rentRecall() {
     return_code = sqlite3_step(stmt);
     if (return_code == SQLITE_ROW) {
         // If a row is fetched, copy the title of the rented book
-        strcpy(title, (const char *)sqlite3_column_text(stmt, 0));
+        title = arenaText(&session->arena, (const char *)sqlite3_column_text(stmt, 0));
+        sqlite3_reset(stmt);
     } else {
-        // If no row is fetched, print error message, finalize the statement, close the database, and return
-        fprintf(stderr, "%sNo rent found with id %d%s\n",RED, id, RESET);
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        return;
+        // If no row is fetched, print error message and return
+        fprintf(out, "%sNo rent found with id %d%s\n",RED, id, RESET);
+        sqlite3_reset(stmt);
+        return false;
     }
 
-    // Finalize the statement
-    sqlite3_finalize(stmt);
-
-    char sql2[1000]; // Array to store SQL query for updating book quantity
-    char sql3[1000]; // Array to store SQL query for deleting rent record
     // SQL query to update book quantity_rented and quantity_available
-    sprintf(sql2, "UPDATE books SET quantity_rented = quantity_rented - 1, quantity_available = quantity_available + 1 WHERE title=?;");
-    // SQL query to delete the rent record corresponding to the given ID
-    sprintf(sql3, "DELETE FROM rents WHERE id=?;");
-
-    // Prepare the SQL statements
-    return_code = sqlite3_prepare_v2(db, sql2, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        // If preparing the SQL statement fails, print error message, close the database, and return
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    stmt = prepareStatement(database, "UPDATE books SET quantity_rented = quantity_rented - 1, quantity_available = quantity_available + 1 WHERE title=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind the title parameter to the prepared statement
-    sqlite3_bind_text(stmt, 1, title, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 1, title->data, -1, SQLITE_STATIC);
 
     // Execute the SQL statement to update book quantity
     return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (return_code != SQLITE_DONE) {
-        // If executing the SQL statement fails, print error message, finalize the statement, close the database, and return
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        return;
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    // Keep the rent if its copy can't be put back, rather than lose track of it.
+    if (sqlite3_changes(database->db) == 0) {
+        fprintf(out, "%sNo book titled '%s' to return the rent to.%s\n", RED, title->data, RESET);
+        return false;
     }
 
-    // Finalize the statement
-    sqlite3_finalize(stmt);
-
-    // Prepare the SQL statement
-    return_code = sqlite3_prepare_v2(db, sql3, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        // If preparing the SQL statement fails, print error message, close the database, and return
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+    // SQL query to delete the rent record corresponding to the given ID
+    stmt = prepareStatement(database, "DELETE FROM rents WHERE id=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
     // Bind the ID parameter to the prepared statement
@@ -1189,120 +1090,152 @@ void rentRecall() {
 
     // Execute the SQL statement to delete the rent record
     return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
     if (return_code != SQLITE_DONE) {
-        // If executing the SQL statement fails, print error message, finalize the statement, close the database, and return
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        return;
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
-
-    // Finalize the statement
-    sqlite3_finalize(stmt);
+    noteRental(id);
 
     // Print success message
-    printf("%sRent recalled successfully.\n%s", GREEN, RESET);
-
-    // Close the database connection
-    sqlite3_close(db);
+    fprintf(out, "%sRent recalled successfully.\n%s", GREEN, RESET);
+    return true;
 }
 
-void rentLate() {
-    sqlite3 *db; // SQLite database pointer
-    sqlite3_stmt *stmt; // SQLite statement pointer
-    int return_code; // Return code from SQLite functions
+    /**
+ * @brief Function to recall a rented book by its ID.
+ *
+ * This function prompts the user for the ID of the rent to recall and submits the recall.
+ *
+ * @return void
+ */
+void rentRecall() {
+    int id; // ID of the rent to recall
 
-    // Open the SQLite database
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code != SQLITE_OK) {
-        // If opening the database fails, print error message, close the database, and return
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
-    }
+    // Prompt the user for the ID of the rent to recall
+    do {
+        printf("Enter the id of the rent to recall: ");
+        scanf("%d", &id);
+    } while (!validateID(id)); // Assume validateID validates against valid ID range in the database
 
-    printf("\n********** Late Rents **************\n\n"); 
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "rent recall\t%d", id);
+    submitRequest(request);
+}
 
-    // SQL query to select late rent information
-    const char *sql = "SELECT id, title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date FROM rents WHERE date(return_date) < date('now');";
-    return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (return_code != SQLITE_OK) {
-        // If preparing the SQL statement fails, print error message, close the database, and return
-        fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
-        return;
+/**
+ * @brief Prints the rents of a list of ids in a formatted table, in the order of the list.
+ *
+ * @param session   The session running the command.
+ * @param ids       Rent ids.
+ * @param count     Number of ids.
+ * @param lateColor Color of the return date column, or NULL.
+ *
+ * @return True on success, false if the query failed.
+ */
+bool printRentIds(struct Session *session, const int *ids, int count, const char *lateColor) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    // The ids go in as one JSON array, and each row is looked up by id in the order of the list.
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT rents.id, title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date FROM json_each(?) AS due CROSS JOIN rents ON rents.id = due.value;");
+    if (stmt == NULL) {
+        // If preparing the SQL statement fails, print error message and return
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
 
-    // Calculate maximum widths for each column
-    int max_title_width = 0;
-    int max_name_width = 0;
-    int max_phone_width = 0;
-    int max_qty_rented = 0;
-    int max_rfd_width = 17; // Assuming "Rented for Days" width is fixed
-    int max_rentdate_width = 0;
-    int max_returndate_width = 0;
+    char *list = NULL;
+    size_t size = 0;
+    FILE *buffer = open_memstream(&list, &size);
+    writeRentIds(buffer, ids, count);
+    fclose(buffer);
 
-    // Iterate through the result set to calculate maximum widths
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        max_title_width = fmax(max_title_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        max_name_width = fmax(max_name_width, (int)strlen((const char *)sqlite3_column_text(stmt, 2)));
-        max_phone_width = fmax(max_phone_width, (int)strlen((const char *)sqlite3_column_text(stmt, 3)));
-        max_qty_rented = fmax(max_qty_rented, sqlite3_column_int(stmt, 4));
-        max_rentdate_width = fmax(max_rentdate_width, (int)strlen((const char *)sqlite3_column_text(stmt, 6)));
-        max_returndate_width = fmax(max_returndate_width, (int)strlen((const char *)sqlite3_column_text(stmt, 7)));
-    }
+    sqlite3_bind_text(stmt, 1, list, size, SQLITE_TRANSIENT);
+    free(list);
+    printRents(out, stmt, NULL, lateColor);
+    return true;
+}
 
-    // Print horizontal line separator
-    printf("%s", BLUE);
-    for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-        printf("-");
+/**
+ * @brief Function to display the rents whose return date has passed.
+ *
+ * The overdue rents are the top of the rental queue, so finding them doesn't depend on the
+ * number of open rentals.
+ *
+ * @param session The session running the command.
+ *
+ * @return True on success, false if the query failed.
+ */
+bool execRentLate(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+    int *ids;
+
+    fprintf(out, "\n********** Late Rents **************\n\n");
+
+    if (!readRentals(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
-    printf("%s\n", RESET);
+    int count = dueRentals(0, dayFromToday(0), &ids);
+    releaseRentals();
 
-    // Print column headers
-    printf("%s %-7s | %-*s | %-*s | %-*s | %-6s | %-15s | %-18s | %s |%s\n",
-        BLUE,"Id",
-        max_title_width, "Title",
-        max_name_width, "Name",
-        max_phone_width, "Phone",
-        "Quantity Rented",
-        "Rented for Days",
-        "Rent Date",
-        "Return Date",
-            RESET);
+    bool ok = printRentIds(session, ids, count, RED);
+    free(ids);
+    return ok;
+}
 
-    // Print horizontal line separator
-    printf("%s", BLUE);
-    for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-        printf("-");
+void rentLate() {
+    submitRequest("rent late");
+}
+
+/**
+ * @brief Function to display the rents coming due from today up to a number of days ahead.
+ *
+ * @param session The session running the command.
+ * @param days    Days ahead, 0 for the rents due today.
+ *
+ * @return True on success, false if the days are negative or the query failed.
+ */
+bool execRentDue(struct Session *session, int days) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+    int *ids;
+
+    if (days < 0) {
+        fprintf(out, "%sThe number of days can't be negative.%s\n", RED, RESET);
+        return false;
     }
-    printf("%s\n", RESET);
 
-    // Print late rent data
-    sqlite3_reset(stmt); // Reset the statement to re-execute
-    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-        printf("%-8d | %-*s | %-*s | %-*s | %-15d | %-15d | %-18s | %s%-11s%s |\n",
-            sqlite3_column_int(stmt, 0),
-            max_title_width, (const char *)sqlite3_column_text(stmt, 1),
-            max_name_width, (const char *)sqlite3_column_text(stmt, 2),
-            max_phone_width, (const char *)sqlite3_column_text(stmt, 3),
-            sqlite3_column_int(stmt, 4),
-            sqlite3_column_int(stmt, 5),
-            sqlite3_column_text(stmt, 6),RED,
-            sqlite3_column_text(stmt, 7),RESET);
-            
-        // Print horizontal line separator
-        for(int i =0;i < (max_title_width + max_name_width + max_phone_width + 90);i++){
-            printf("-");
-        }
-        printf("\n");
+    fprintf(out, "\n********** Rents Due in %d Days **************\n\n", days);
 
+    if (!readRentals(database)) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    int count = dueRentals(dayFromToday(0), dayFromToday(days) + 1, &ids);
+    releaseRentals();
+
+    bool ok = printRentIds(session, ids, count, YELLOW);
+    free(ids);
+    return ok;
+}
+
+/**
+ * @brief Function to display the rents coming due in the next days.
+ *
+ * @return void
+ */
+void rentDue() {
+    int days; // Days ahead
+
+    printf("Enter the number of days ahead: ");
+    scanf("%d", &days);
 
-    // Finalize the SQLite statement
-    sqlite3_finalize(stmt);
-    // Close the database connection
-    sqlite3_close(db);
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "rent due\t%d", days);
+    submitRequest(request);
 }
 
 
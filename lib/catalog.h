@@ -0,0 +1,464 @@
+/*
+ * File:          catalog.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the resident book catalog: every book kept in memory column by column,
+ *                with the titles in one arena and authors and genres as ids into their dictionaries,
+ *                so listings, searches and reports scan contiguous arrays instead of the B-tree. An
+ *                update hook keeps it in step with the database.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#include "dictionary.h"
+
+#define CATALOG_PENDING_MAX 1024         // Changed books refreshed one by one; more reload everything.
+
+// Define structure for the catalog, one array per column, ordered by book id.
+struct Catalog {
+    int count;                           // Books in the catalog.
+    int capacity;                        // Allocated length of the arrays.
+    sqlite3_int64 *ids;                  // Row ids, ascending.
+    double *prices;
+    int *available;                      // Quantity available.
+    int *rented;                         // Quantity rented.
+    int *sold;                           // Quantity sold.
+    int *rentedAll;                      // Copies ever rented.
+    int *rentedDays;                     // Days ever rented.
+    unsigned int *titles;                // Offsets of the titles in the arena.
+    int *authorIds;                      // Ids in authorNames.
+    int *genreIds;                       // Ids in genreNames.
+    char *arena;                         // NUL terminated titles of all books.
+    size_t arenaUsed;
+    size_t arenaSize;
+    size_t arenaGarbage;                 // Bytes of strings that were replaced or deleted.
+    bool loaded;
+    sqlite3_int64 version;               // data_version of the watched connection at the last load.
+};
+
+struct Catalog catalog;
+pthread_rwlock_t catalogLock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Connection whose changes to books are tracked, and its statement reading the data version.
+struct Database *catalogWatched;
+sqlite3_stmt *catalogVersion;
+
+// Books changed on the watched connection since the catalog last caught up with it.
+sqlite3_int64 catalogPending[CATALOG_PENDING_MAX];
+int catalogPendingCount;
+bool catalogStale;                       // Changes not tracked row by row: reload everything.
+pthread_mutex_t catalogPendingLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Returns the title of a book.
+ */
+const char *catalogTitle(int index) {
+    return catalog.arena + catalog.titles[index];
+}
+
+/**
+ * @brief Returns the author of a book.
+ */
+const char *catalogAuthor(int index) {
+    return dictionaryName(&authorNames, catalog.authorIds[index]);
+}
+
+/**
+ * @brief Returns the genre of a book.
+ */
+const char *catalogGenre(int index) {
+    return dictionaryName(&genreNames, catalog.genreIds[index]);
+}
+
+/**
+ * @brief Copies a string into the arena.
+ *
+ * @return Offset of the copy.
+ */
+unsigned int storeText(const char *text) {
+    size_t length = strlen(text != NULL ? text : "") + 1;
+
+    if (catalog.arenaUsed + length > catalog.arenaSize) {
+        catalog.arenaSize = (catalog.arenaSize + length) * 2;
+        catalog.arena = realloc(catalog.arena, catalog.arenaSize);
+    }
+    memcpy(catalog.arena + catalog.arenaUsed, text != NULL ? text : "", length);
+    catalog.arenaUsed += length;
+    return catalog.arenaUsed - length;
+}
+
+/**
+ * @brief Replaces the title of a book, keeping the arena untouched when it didn't change.
+ */
+void replaceTitle(int index, const char *title) {
+    const char *old = catalogTitle(index);
+
+    if (strcmp(old, title != NULL ? title : "") != 0) {
+        catalog.arenaGarbage += strlen(old) + 1;
+        catalog.titles[index] = storeText(title);
+    }
+}
+
+/**
+ * @brief Rebuilds the arena with only the strings still in use, once most of it is garbage.
+ */
+void compactArena() {
+    if (catalog.arenaGarbage < 4096 || catalog.arenaGarbage < catalog.arenaUsed / 2) {
+        return;
+    }
+
+    char *old = catalog.arena;
+    catalog.arena = NULL;
+    catalog.arenaUsed = catalog.arenaSize = catalog.arenaGarbage = 0;
+    for (int i = 0; i < catalog.count; i++) {
+        catalog.titles[i] = storeText(old + catalog.titles[i]);
+    }
+    free(old);
+}
+
+/**
+ * @brief Moves count books of every column from one position to another.
+ */
+void moveBooks(int to, int from, int count) {
+    memmove(catalog.ids + to, catalog.ids + from, count * sizeof(*catalog.ids));
+    memmove(catalog.prices + to, catalog.prices + from, count * sizeof(*catalog.prices));
+    memmove(catalog.available + to, catalog.available + from, count * sizeof(int));
+    memmove(catalog.rented + to, catalog.rented + from, count * sizeof(int));
+    memmove(catalog.sold + to, catalog.sold + from, count * sizeof(int));
+    memmove(catalog.rentedAll + to, catalog.rentedAll + from, count * sizeof(int));
+    memmove(catalog.rentedDays + to, catalog.rentedDays + from, count * sizeof(int));
+    memmove(catalog.titles + to, catalog.titles + from, count * sizeof(unsigned int));
+    memmove(catalog.authorIds + to, catalog.authorIds + from, count * sizeof(int));
+    memmove(catalog.genreIds + to, catalog.genreIds + from, count * sizeof(int));
+}
+
+/**
+ * @brief Makes room for one more book in every column.
+ */
+void growCatalog() {
+    if (catalog.count < catalog.capacity) {
+        return;
+    }
+    catalog.capacity = catalog.capacity ? catalog.capacity * 2 : 256;
+    catalog.ids = realloc(catalog.ids, catalog.capacity * sizeof(*catalog.ids));
+    catalog.prices = realloc(catalog.prices, catalog.capacity * sizeof(*catalog.prices));
+    catalog.available = realloc(catalog.available, catalog.capacity * sizeof(int));
+    catalog.rented = realloc(catalog.rented, catalog.capacity * sizeof(int));
+    catalog.sold = realloc(catalog.sold, catalog.capacity * sizeof(int));
+    catalog.rentedAll = realloc(catalog.rentedAll, catalog.capacity * sizeof(int));
+    catalog.rentedDays = realloc(catalog.rentedDays, catalog.capacity * sizeof(int));
+    catalog.titles = realloc(catalog.titles, catalog.capacity * sizeof(unsigned int));
+    catalog.authorIds = realloc(catalog.authorIds, catalog.capacity * sizeof(int));
+    catalog.genreIds = realloc(catalog.genreIds, catalog.capacity * sizeof(int));
+}
+
+/**
+ * @brief Finds the position of a book by id.
+ *
+ * @param id       The book id.
+ * @param position Set to the position of the book, or to where it would be inserted.
+ *
+ * @return True if the book is in the catalog.
+ */
+bool findCatalogBook(sqlite3_int64 id, int *position) {
+    int low = 0, high = catalog.count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (catalog.ids[middle] < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *position = low;
+    return low < catalog.count && catalog.ids[low] == id;
+}
+
+/**
+ * @brief Stores the current row of a statement selecting id, title, author_id, genre_id, price,
+ *        quantity_available, quantity_rented, quantity_sold, quantity_rented_all and
+ *        quantity_rented_days, in that order, adding the book if it is new.
+ *
+ * @return False if the name of a new author or genre could not be read.
+ */
+bool storeCatalogBook(struct Database *database, sqlite3_stmt *stmt) {
+    sqlite3_int64 id = sqlite3_column_int64(stmt, 0);
+    const char *title = (const char *)sqlite3_column_text(stmt, 1);
+    int position;
+
+    if (findCatalogBook(id, &position)) {
+        replaceTitle(position, title);
+    } else {
+        growCatalog();
+        moveBooks(position + 1, position, catalog.count - position);
+        catalog.count++;
+        catalog.ids[position] = id;
+        catalog.titles[position] = storeText(title);
+    }
+    catalog.authorIds[position] = sqlite3_column_int(stmt, 2);
+    catalog.genreIds[position] = sqlite3_column_int(stmt, 3);
+    catalog.prices[position] = sqlite3_column_double(stmt, 4);
+    catalog.available[position] = sqlite3_column_int(stmt, 5);
+    catalog.rented[position] = sqlite3_column_int(stmt, 6);
+    catalog.sold[position] = sqlite3_column_int(stmt, 7);
+    catalog.rentedAll[position] = sqlite3_column_int(stmt, 8);
+    catalog.rentedDays[position] = sqlite3_column_int(stmt, 9);
+    return resolveName(database, &authorNames, &catalog.authorIds[position]) &&
+           resolveName(database, &genreNames, &catalog.genreIds[position]);
+}
+
+/**
+ * @brief Reads every book into the catalog. Must be called with catalogLock held for writing.
+ *
+ * @param database Connection to read with.
+ *
+ * @return True on success.
+ */
+bool loadCatalog(struct Database *database) {
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT id, title, author_id, genre_id, price, quantity_available, quantity_rented, quantity_sold, quantity_rented_all, quantity_rented_days FROM books ORDER BY id;");
+    if (stmt == NULL || !loadNames(database, &authorNames) || !loadNames(database, &genreNames)) {
+        return false;
+    }
+
+    catalog.count = 0;
+    catalog.arenaUsed = catalog.arenaGarbage = 0;
+    int return_code;
+    bool named = true;
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+        // Rows come in id order, so every book is appended.
+        named = storeCatalogBook(database, stmt) && named;
+    }
+    sqlite3_reset(stmt);
+    catalog.loaded = return_code == SQLITE_DONE && named;
+    return catalog.loaded;
+}
+
+/**
+ * @brief Reads one book again, removing it from the catalog if it was deleted.
+ *        Must be called with catalogLock held for writing.
+ */
+bool refreshCatalogBook(struct Database *database, sqlite3_int64 id) {
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT id, title, author_id, genre_id, price, quantity_available, quantity_rented, quantity_sold, quantity_rented_all, quantity_rented_days FROM books WHERE id=?;");
+    if (stmt == NULL) {
+        return false;
+    }
+
+    sqlite3_bind_int64(stmt, 1, id);
+    int return_code = sqlite3_step(stmt);
+    int position;
+    bool named = true;
+    if (return_code == SQLITE_ROW) {
+        named = storeCatalogBook(database, stmt);
+    } else if (return_code == SQLITE_DONE && findCatalogBook(id, &position)) {
+        catalog.arenaGarbage += strlen(catalogTitle(position)) + 1;
+        moveBooks(position, position + 1, catalog.count - position - 1);
+        catalog.count--;
+    }
+    sqlite3_reset(stmt);
+    return (return_code == SQLITE_ROW || return_code == SQLITE_DONE) && named;
+}
+
+/**
+ * @brief Update hook of the watched connection, noting every changed book.
+ */
+void catalogChanged(void *arg, int operation, const char *database, const char *table, sqlite3_int64 id) {
+    if (strcmp(table, "books") != 0) {
+        return;
+    }
+    pthread_mutex_lock(&catalogPendingLock);
+    if (catalogPendingCount < CATALOG_PENDING_MAX) {
+        catalogPending[catalogPendingCount++] = id;
+    } else {
+        catalogStale = true;
+    }
+    pthread_mutex_unlock(&catalogPendingLock);
+}
+
+/**
+ * @brief Marks the whole catalog for reloading, for changes the update hook doesn't report,
+ *        such as deleting every book at once.
+ */
+void invalidateCatalog() {
+    pthread_mutex_lock(&catalogPendingLock);
+    catalogStale = true;
+    pthread_mutex_unlock(&catalogPendingLock);
+}
+
+/**
+ * @brief Tracks the changes made to books through a connection, which must be the one every
+ *        change of this process goes through.
+ */
+void watchCatalog(struct Database *database) {
+    catalogWatched = database;
+    sqlite3_prepare_v2(database->db, "PRAGMA data_version;", -1, &catalogVersion, NULL);
+    sqlite3_update_hook(database->db, catalogChanged, NULL);
+}
+
+/**
+ * @brief Returns the data version of the watched connection, which changes when another
+ *        connection, possibly of another process, commits.
+ */
+sqlite3_int64 catalogDataVersion() {
+    sqlite3_int64 version = -1;
+
+    if (sqlite3_step(catalogVersion) == SQLITE_ROW) {
+        version = sqlite3_column_int64(catalogVersion, 0);
+    }
+    sqlite3_reset(catalogVersion);
+    return version;
+}
+
+/**
+ * @brief Returns whether the caller is the watched connection outside a transaction with
+ *        changes of its own still to read into the catalog.
+ */
+bool catalogBehind(struct Database *database) {
+    if (database != catalogWatched || !sqlite3_get_autocommit(database->db)) {
+        return false;
+    }
+    pthread_mutex_lock(&catalogPendingLock);
+    bool behind = catalogPendingCount > 0 || catalogStale;
+    pthread_mutex_unlock(&catalogPendingLock);
+    return behind;
+}
+
+/**
+ * @brief Brings the catalog up to date before it is read.
+ *
+ * Books changed on the watched connection are read again once it has committed them: here when
+ * the caller is that connection outside a transaction, otherwise by the writer calling this
+ * after its commit. A commit by another connection, which the data version of the watched
+ * connection shows, reloads everything. Other callers step that version only here, after their
+ * own data version told them something was committed.
+ *
+ * @param database Connection of the caller.
+ *
+ * @return False if the catalog could not be read.
+ */
+bool syncCatalog(struct Database *database) {
+    bool ok = true;
+    sqlite3_int64 seen = dataVersion(database);
+
+    pthread_rwlock_wrlock(&catalogLock);
+    bool own = database == catalogWatched && sqlite3_get_autocommit(database->db);
+    sqlite3_int64 version = database == catalogWatched ? seen : catalogDataVersion();
+
+    pthread_mutex_lock(&catalogPendingLock);
+    sqlite3_int64 pending[CATALOG_PENDING_MAX];
+    int count = own ? catalogPendingCount : 0;
+    bool stale = own && catalogStale;
+    memcpy(pending, catalogPending, count * sizeof(*pending));
+    if (own) {
+        catalogPendingCount = 0;
+        catalogStale = false;
+    }
+    pthread_mutex_unlock(&catalogPendingLock);
+
+    if (!catalog.loaded || stale || version != catalog.version) {
+        ok = loadCatalog(database);
+        catalog.version = version;
+    } else {
+        for (int i = 0; i < count && ok; i++) {
+            ok = refreshCatalogBook(database, pending[i]);
+        }
+        compactArena();
+    }
+    if (!ok) {
+        catalog.loaded = false;
+    } else {
+        database->catalogSeen = seen;
+    }
+    pthread_rwlock_unlock(&catalogLock);
+    return ok;
+}
+
+/**
+ * @brief Brings the catalog up to date and locks it for reading; release it with releaseCatalog().
+ *
+ * As long as nothing was committed since the caller last found the catalog current, it is read
+ * under the shared lock alone, so readers run side by side.
+ *
+ * @return False if the catalog could not be read, in which case it is not locked.
+ */
+bool readCatalog(struct Database *database) {
+    sqlite3_int64 seen = dataVersion(database);
+
+    pthread_rwlock_rdlock(&catalogLock);
+    if (catalog.loaded && seen == database->catalogSeen && !catalogBehind(database)) {
+        return true;
+    }
+    pthread_rwlock_unlock(&catalogLock);
+
+    if (!syncCatalog(database)) {
+        return false;
+    }
+    pthread_rwlock_rdlock(&catalogLock);
+    return true;
+}
+
+/**
+ * @brief Releases the catalog after readCatalog().
+ */
+void releaseCatalog() {
+    pthread_rwlock_unlock(&catalogLock);
+}
+
+/**
+ * @brief Finds the books with the highest values of a column, ties in id order.
+ *        Must be called with the catalog read.
+ *
+ * @param column  One of the quantity arrays of the catalog.
+ * @param top     Receives the positions of the books, highest first.
+ * @param limit   Most books returned.
+ *
+ * @return Number of books in top.
+ */
+int topCatalogBooks(const int *column, int *top, int limit) {
+    int count = 0;
+
+    for (int i = 0; i < catalog.count; i++) {
+        int j = count < limit ? count++ : limit;
+        while (j > 0 && column[top[j - 1]] < column[i]) {
+            if (j < limit) {
+                top[j] = top[j - 1];
+            }
+            j--;
+        }
+        if (j < limit) {
+            top[j] = i;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Finds the id of an author or genre for a book being added or changed, adding the name to
+ *        its table if it is new.
+ *
+ * @param database   Connection of the caller, in its write transaction.
+ * @param dictionary authorNames or genreNames.
+ * @param name       The name.
+ *
+ * @return The id, or 0 on error.
+ */
+int internName(struct Database *database, struct Dictionary *dictionary, const char *name) {
+    pthread_rwlock_rdlock(&catalogLock);
+    int id = findName(dictionary, name);
+    pthread_rwlock_unlock(&catalogLock);
+
+    return id != 0 ? id : storeName(database, dictionary, name);
+}
+
+/**
+ * @brief Returns the memory held by the catalog and its dictionaries, in bytes.
+ *        Must be called with catalogLock held.
+ */
+size_t catalogBytes() {
+    return catalog.capacity * (sizeof(sqlite3_int64) + sizeof(double) + 7 * sizeof(int) + sizeof(unsigned int)) +
+           catalog.arenaSize + dictionaryBytes(&authorNames) + dictionaryBytes(&genreNames);
+}
@@ -0,0 +1,253 @@
+/*
+ * File:          chain.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the chain-wide reports: the database files of many branches read at
+ *                once, each by its own thread on its own read-only connection, and their books merged
+ *                by title into the totals and top 5 of the whole chain.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <math.h>
+#include <glob.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#define CHAIN_BRANCHES_MAX 256           // Branch files one report reads.
+
+// Define structure for the sales and rentals of one book, in one branch or in the whole chain.
+struct ChainBook {
+    struct Text *title;
+    struct Text *author;
+    struct Text *genre;
+    double price;                        // Price in the first branch listing the book.
+    double revenue;                      // Copies sold times the price of each branch.
+    int sold;                            // Quantity sold.
+    int rentedAll;                       // Copies ever rented.
+    int rentedDays;                      // Days ever rented.
+};
+
+// Define structure for one branch read by a report.
+struct Branch {
+    const char *path;                    // Database file of the branch.
+    pthread_t thread;
+    struct Arena arena;                  // Strings of books, freed with the branch.
+    struct ChainBook *books;
+    int count;
+    int capacity;
+    double millis;                       // Time the branch took.
+    char error[256];                     // Why the branch could not be read, empty if it was.
+};
+
+// Define structure for the merged books of every branch, with a hash table of them by title.
+struct Chain {
+    struct ChainBook *books;
+    int count;
+    int capacity;
+    int *slots;                          // Index + 1 of the books by title, 0 for a free slot.
+    int slotCount;                       // Length of slots, a power of two.
+    double revenue;                      // Revenue of all books of all branches.
+    int branches;                        // Branches read.
+    double slowest;                      // Time of the slowest branch.
+    double sum;                          // Time of all branches one after another.
+};
+
+/**
+ * @brief Thread reading the books of one branch, on a read-only connection of its own.
+ */
+void *readBranch(void *arg) {
+    struct Branch *branch = arg;
+    struct Database database;
+    char uri[1024];
+    double start = monotonicMicros();
+
+    databaseUri(uri, sizeof(uri), branch->path, "mode=ro");
+    if (openDatabase(&database, uri, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI) != SQLITE_OK) {
+        snprintf(branch->error, sizeof(branch->error), "can't open the database");
+        return NULL;
+    }
+    sqlite3_exec(database.db, "PRAGMA query_only=1;", 0, 0, 0);
+
+    sqlite3_stmt *stmt = prepareStatement(&database, "SELECT books.title, authors.name, genres.name, books.price, books.quantity_sold, "
+                                                     "books.quantity_rented_all, books.quantity_rented_days FROM books "
+                                                     "JOIN authors ON authors.id = books.author_id "
+                                                     "LEFT JOIN genres ON genres.id = books.genre_id;");
+    int return_code = SQLITE_ERROR;
+    if (stmt != NULL) {
+        while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+            if (branch->count == branch->capacity) {
+                branch->capacity = branch->capacity ? branch->capacity * 2 : 256;
+                branch->books = realloc(branch->books, branch->capacity * sizeof(struct ChainBook));
+            }
+            struct ChainBook *book = &branch->books[branch->count++];
+            book->title = arenaText(&branch->arena, (const char *)sqlite3_column_text(stmt, 0));
+            book->author = arenaText(&branch->arena, (const char *)sqlite3_column_text(stmt, 1));
+            book->genre = arenaText(&branch->arena, sqlite3_column_type(stmt, 2) != SQLITE_NULL ? (const char *)sqlite3_column_text(stmt, 2) : "");
+            book->price = sqlite3_column_double(stmt, 3);
+            book->sold = sqlite3_column_int(stmt, 4);
+            book->rentedAll = sqlite3_column_int(stmt, 5);
+            book->rentedDays = sqlite3_column_int(stmt, 6);
+            book->revenue = book->price * book->sold;
+        }
+        sqlite3_reset(stmt);
+    }
+    if (return_code != SQLITE_DONE) {
+        snprintf(branch->error, sizeof(branch->error), "%s", sqlite3_errmsg(database.db));
+    }
+    closeDatabase(&database);
+    branch->millis = (monotonicMicros() - start) / 1000;
+    return NULL;
+}
+
+/**
+ * @brief Adds the books of a branch to the chain, summing the books of the same title.
+ */
+void mergeBranch(struct Chain *chain, const struct Branch *branch) {
+    for (int i = 0; i < branch->count; i++) {
+        const struct ChainBook *book = &branch->books[i];
+
+        // Keep the hash table at most half full.
+        if (chain->count * 2 >= chain->slotCount) {
+            free(chain->slots);
+            chain->slotCount = chain->slotCount ? chain->slotCount * 2 : 1024;
+            chain->slots = calloc(chain->slotCount, sizeof(int));
+            for (int j = 0; j < chain->count; j++) {
+                unsigned int slot = hashName(chain->books[j].title->data);
+                while (chain->slots[slot & (chain->slotCount - 1)] != 0) {
+                    slot++;
+                }
+                chain->slots[slot & (chain->slotCount - 1)] = j + 1;
+            }
+        }
+
+        unsigned int slot = hashName(book->title->data);
+        int *found;
+        while (*(found = &chain->slots[slot & (chain->slotCount - 1)]) != 0 &&
+               strcmp(chain->books[*found - 1].title->data, book->title->data) != 0) {
+            slot++;
+        }
+        if (*found == 0) {
+            if (chain->count == chain->capacity) {
+                chain->capacity = chain->capacity ? chain->capacity * 2 : 256;
+                chain->books = realloc(chain->books, chain->capacity * sizeof(struct ChainBook));
+            }
+            chain->books[chain->count] = *book;
+            *found = ++chain->count;
+        } else {
+            struct ChainBook *merged = &chain->books[*found - 1];
+            merged->revenue += book->revenue;
+            merged->sold += book->sold;
+            merged->rentedAll += book->rentedAll;
+            merged->rentedDays += book->rentedDays;
+        }
+        chain->revenue += book->revenue;
+    }
+}
+
+/**
+ * @brief Reads every branch of a list at once and merges their books.
+ *
+ * @param out   Stream receiving the branches that could not be read.
+ * @param list  Comma separated database files, each possibly a wildcard pattern.
+ * @param chain Receives the merged books; release it with freeChain().
+ * @param branches Receives the branches, which hold the strings of the books; release them
+ *                 with freeChain().
+ *
+ * @return Number of branches, 0 if the list names no files.
+ */
+int readChain(FILE *out, const char *list, struct Chain *chain, struct Branch **branches) {
+    glob_t files = {0};
+    char *copy = strdup(list), *state;
+
+    for (char *pattern = strtok_r(copy, ",", &state); pattern != NULL; pattern = strtok_r(NULL, ",", &state)) {
+        pattern = trimSpace(pattern);
+        if (pattern[0] != '\0') {
+            // A file that doesn't exist stays in the list, so it is reported like any other failure.
+            glob(pattern, GLOB_NOCHECK | (files.gl_pathc > 0 ? GLOB_APPEND : 0), NULL, &files);
+        }
+    }
+    free(copy);
+
+    int count = files.gl_pathc < CHAIN_BRANCHES_MAX ? files.gl_pathc : CHAIN_BRANCHES_MAX;
+    if (files.gl_pathc > CHAIN_BRANCHES_MAX) {
+        fprintf(out, "%sOnly the first %d branches are read.%s\n", YELLOW, CHAIN_BRANCHES_MAX, RESET);
+    }
+    *branches = calloc(count > 0 ? count : 1, sizeof(struct Branch));
+    for (int i = 0; i < count; i++) {
+        (*branches)[i].path = strdup(files.gl_pathv[i]);
+        pthread_create(&(*branches)[i].thread, NULL, readBranch, &(*branches)[i]);
+    }
+    globfree(&files);
+
+    // Merge in list order, so ties between books come out the same every time.
+    memset(chain, 0, sizeof(*chain));
+    for (int i = 0; i < count; i++) {
+        struct Branch *branch = &(*branches)[i];
+        pthread_join(branch->thread, NULL);
+        chain->sum += branch->millis;
+        chain->slowest = fmax(chain->slowest, branch->millis);
+        if (branch->error[0] != '\0') {
+            fprintf(out, "%sBranch %s left out: %s%s\n", RED, branch->path, branch->error, RESET);
+            continue;
+        }
+        mergeBranch(chain, branch);
+        chain->branches++;
+    }
+    return count;
+}
+
+/**
+ * @brief Frees the merged books and the branches of readChain().
+ */
+void freeChain(struct Chain *chain, struct Branch *branches, int count) {
+    for (int i = 0; i < count; i++) {
+        free((char *)branches[i].path);
+        free(branches[i].books);
+        freeArena(&branches[i].arena);
+    }
+    free(branches);
+    free(chain->books);
+    free(chain->slots);
+}
+
+/**
+ * @brief Finds the books of the chain with the highest values of a field, ties in the order the
+ *        books were first met.
+ *
+ * @param chain  The chain.
+ * @param offset Offset of the int field in struct ChainBook, e.g. offsetof(struct ChainBook, sold).
+ * @param top    Receives the indexes of the books, highest first.
+ * @param limit  Most books returned.
+ *
+ * @return Number of books in top.
+ */
+int topChainBooks(const struct Chain *chain, size_t offset, int *top, int limit) {
+    int count = 0;
+
+    for (int i = 0; i < chain->count; i++) {
+        int value = *(const int *)((const char *)&chain->books[i] + offset);
+        int j = count < limit ? count++ : limit;
+        while (j > 0 && *(const int *)((const char *)&chain->books[top[j - 1]] + offset) < value) {
+            if (j < limit) {
+                top[j] = top[j - 1];
+            }
+            j--;
+        }
+        if (j < limit) {
+            top[j] = i;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Prints how many branches a chain report read and how long they took.
+ */
+void printChainTimes(FILE *out, const struct Chain *chain, int count) {
+    fprintf(out, "Branches read:          %d of %d in %.1f ms (%.1f ms one after another)\n\n", chain->branches,
+            count, chain->slowest, chain->sum);
+}
@@ -0,0 +1,198 @@
+/*
+ * File:          changes.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the change log: every insert, update and delete of books, rents and
+ *                users is recorded by triggers under an increasing sequence number, in the same
+ *                transaction as the change, and exported from a given sequence number on, so head
+ *                office copies only what changed since its last export.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sqlite3.h>
+
+#define CHANGES_BATCH 1000               // Changes exported by one request unless asked otherwise.
+#define CHANGES_BATCH_MAX 100000         // Most changes exported by one request.
+
+// Change log table and its triggers. AUTOINCREMENT keeps sequence numbers increasing even once the
+// newest changes were pruned. Rows are stored as JSON: the row after an insert or update, the row
+// removed by a delete. Users are logged without their password hash, salt and cost, and changing
+// only those (a new password, or a rehash at login) is not logged.
+const char *sql_changes = "CREATE TABLE IF NOT EXISTS changes ("
+                          "seq INTEGER PRIMARY KEY AUTOINCREMENT,"
+                          "at TEXT NOT NULL DEFAULT (datetime('now')),"
+                          "tbl TEXT NOT NULL,"
+                          "op TEXT NOT NULL,"
+                          "row INTEGER NOT NULL,"
+                          "data TEXT NOT NULL"
+                          ");"
+                          "CREATE TRIGGER IF NOT EXISTS books_insert_change AFTER INSERT ON books BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('books', 'insert', NEW.id, json_object("
+                          "'id', NEW.id, 'title', NEW.title, 'author', (SELECT name FROM authors WHERE id = NEW.author_id),"
+                          "'genre', (SELECT name FROM genres WHERE id = NEW.genre_id), 'price', NEW.price,"
+                          "'quantity_available', NEW.quantity_available, 'quantity_rented', NEW.quantity_rented,"
+                          "'quantity_sold', NEW.quantity_sold, 'quantity_rented_all', NEW.quantity_rented_all,"
+                          "'quantity_rented_days', NEW.quantity_rented_days)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS books_update_change AFTER UPDATE ON books BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('books', 'update', NEW.id, json_object("
+                          "'id', NEW.id, 'title', NEW.title, 'author', (SELECT name FROM authors WHERE id = NEW.author_id),"
+                          "'genre', (SELECT name FROM genres WHERE id = NEW.genre_id), 'price', NEW.price,"
+                          "'quantity_available', NEW.quantity_available, 'quantity_rented', NEW.quantity_rented,"
+                          "'quantity_sold', NEW.quantity_sold, 'quantity_rented_all', NEW.quantity_rented_all,"
+                          "'quantity_rented_days', NEW.quantity_rented_days)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS books_delete_change AFTER DELETE ON books BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('books', 'delete', OLD.id, json_object("
+                          "'id', OLD.id, 'title', OLD.title, 'author', (SELECT name FROM authors WHERE id = OLD.author_id),"
+                          "'genre', (SELECT name FROM genres WHERE id = OLD.genre_id), 'price', OLD.price,"
+                          "'quantity_available', OLD.quantity_available, 'quantity_rented', OLD.quantity_rented,"
+                          "'quantity_sold', OLD.quantity_sold, 'quantity_rented_all', OLD.quantity_rented_all,"
+                          "'quantity_rented_days', OLD.quantity_rented_days)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS rents_insert_change AFTER INSERT ON rents BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('rents', 'insert', NEW.id, json_object("
+                          "'id', NEW.id, 'title', NEW.title, 'name', NEW.Name, 'phone', NEW.Phone,"
+                          "'quantity_rented', NEW.quantity_rented, 'rented_for_days', NEW.rented_for_days,"
+                          "'rent_date', NEW.rent_date, 'return_date', NEW.return_date)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS rents_update_change AFTER UPDATE ON rents BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('rents', 'update', NEW.id, json_object("
+                          "'id', NEW.id, 'title', NEW.title, 'name', NEW.Name, 'phone', NEW.Phone,"
+                          "'quantity_rented', NEW.quantity_rented, 'rented_for_days', NEW.rented_for_days,"
+                          "'rent_date', NEW.rent_date, 'return_date', NEW.return_date)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS rents_delete_change AFTER DELETE ON rents BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('rents', 'delete', OLD.id, json_object("
+                          "'id', OLD.id, 'title', OLD.title, 'name', OLD.Name, 'phone', OLD.Phone,"
+                          "'quantity_rented', OLD.quantity_rented, 'rented_for_days', OLD.rented_for_days,"
+                          "'rent_date', OLD.rent_date, 'return_date', OLD.return_date)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS users_insert_change AFTER INSERT ON users BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('users', 'insert', NEW.id, json_object("
+                          "'id', NEW.id, 'username', NEW.username, 'email', NEW.email, 'role', NEW.role)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS users_update_change AFTER UPDATE OF username, email, role ON users BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('users', 'update', NEW.id, json_object("
+                          "'id', NEW.id, 'username', NEW.username, 'email', NEW.email, 'role', NEW.role)); END;"
+                          "CREATE TRIGGER IF NOT EXISTS users_delete_change AFTER DELETE ON users BEGIN "
+                          "INSERT INTO changes (tbl, op, row, data) VALUES ('users', 'delete', OLD.id, json_object("
+                          "'id', OLD.id, 'username', OLD.username, 'email', OLD.email, 'role', OLD.role)); END;";
+
+/**
+ * @brief Creates the change log and the triggers filling it, if they do not exist.
+ *
+ * @return SQLITE_OK on success, an SQLite error code otherwise.
+ */
+int createChangeLog(sqlite3 *db) {
+    char *errMsg = 0;
+
+    int return_code = sqlite3_exec(db, sql_changes, 0, 0, &errMsg);
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", errMsg);
+        sqlite3_free(errMsg);
+    }
+    return return_code;
+}
+
+/**
+ * @brief Writes the changes after a sequence number, oldest first, one JSON object per line:
+ *        {"seq":..,"at":..,"table":..,"op":..,"id":..,"row":{..}}. Nothing else is written, so the
+ *        output can be fed to a loader as it is.
+ *
+ * @param session The session running the command; only admins may export.
+ * @param after   Last sequence number already received, 0 for everything.
+ * @param limit   Most changes written; fewer means the log was read to its end.
+ *
+ * @return True on success, false if denied or the log could not be read.
+ */
+bool execExportChanges(struct Session *session, sqlite3_int64 after, int limit) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    if (session->userRole != 0) {
+        fprintf(out, "%sYou don't have permission for this action! This incident will be reported.%s\n",RED,RESET);
+        session->denied = true;
+        return false;
+    }
+    if (limit <= 0 || limit > CHANGES_BATCH_MAX) {
+        limit = limit <= 0 ? CHANGES_BATCH : CHANGES_BATCH_MAX;
+    }
+
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT json_object('seq', seq, 'at', at, 'table', tbl, 'op', op, 'id', row, "
+                                                    "'row', json(data)) FROM changes WHERE seq > ? ORDER BY seq LIMIT ?;");
+    if (stmt == NULL) {
+        fprintf(out, "Failed to prepare statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, after);
+    sqlite3_bind_int(stmt, 2, limit);
+
+    int return_code;
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+        fprintf(out, "%s\n", sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Interactive export of the change log.
+ */
+void exportChanges() {
+    long long after;
+
+    printf("Enter the last sequence number received (0 for all): ");
+    scanf("%lld", &after);
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "export changes\t%lld", after);
+    submitRequest(request);
+}
+
+/**
+ * @brief Removes the changes up to a sequence number, once head office has loaded them.
+ *
+ * @param session The session running the command; only admins may prune.
+ * @param upTo    Last sequence number to remove.
+ *
+ * @return True on success, false if denied or the delete failed.
+ */
+bool execPruneChanges(struct Session *session, sqlite3_int64 upTo) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    if (session->userRole != 0) {
+        fprintf(out, "%sYou don't have permission for this action! This incident will be reported.%s\n",RED,RESET);
+        session->denied = true;
+        return false;
+    }
+
+    sqlite3_stmt *stmt = prepareStatement(database, "DELETE FROM changes WHERE seq <= ?;");
+    if (stmt == NULL) {
+        fprintf(out, "Failed to prepare statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, upTo);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    fprintf(out, "%sRemoved %d changes.%s\n", GREEN, sqlite3_changes(database->db), RESET);
+    return true;
+}
+
+/**
+ * @brief Interactive pruning of the change log.
+ */
+void pruneChanges() {
+    long long upTo;
+
+    printf("Enter the last sequence number head office loaded: ");
+    scanf("%lld", &upTo);
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "prune changes\t%lld", upTo);
+    submitRequest(request);
+}
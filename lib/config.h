@@ -0,0 +1,245 @@
+/*
+ * File:          config.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains where the data lives: the database file of the shop and the named
+ *                stores of other branches attached next to it, set by command line flags, the
+ *                environment or a configuration file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <sqlite3.h>
+
+#define CONFIG_FILE "bookery.conf"
+#define STORES_MAX 10                    // SQLite attaches at most 10 databases to a connection.
+#define STORE_NAME_LENGTH 32
+
+// Define structure for a named store, the database of another branch.
+struct Store {
+    char name[STORE_NAME_LENGTH];        // Schema name the store is attached as.
+    char *path;                          // Database file of the store.
+    bool reported;                       // Whether a failure to attach it was reported.
+};
+
+// Database file of the shop, and the name every connection opens: the file itself or, in memory
+// mode, the copy of it in memory that all connections of the process share.
+const char *databaseFile = DATABASE_FILE;
+const char *databaseName = DATABASE_FILE;
+bool memoryMode = false;
+
+// Stores attached to every connection, read-only.
+struct Store stores[STORES_MAX];
+int storeCount;
+
+/**
+ * @brief Sets the database file of the shop.
+ */
+void setDatabaseFile(const char *path) {
+    databaseFile = strdup(path);
+    if (!memoryMode) {
+        databaseName = databaseFile;
+    }
+}
+
+/**
+ * @brief Adds a named store, replacing one of the same name. The name must be a plain identifier
+ *        other than "main" and "temp", since it becomes the schema name of the store.
+ *
+ * @return True if the store was added.
+ */
+bool addStore(const char *name, const char *path) {
+    bool valid = name[0] != '\0' && strlen(name) < STORE_NAME_LENGTH && !isdigit((unsigned char)name[0]) &&
+                 strcasecmp(name, "main") != 0 && strcasecmp(name, "temp") != 0;
+    for (const char *c = name; *c != '\0'; c++) {
+        valid = valid && (isalnum((unsigned char)*c) || *c == '_');
+    }
+    if (!valid || path[0] == '\0') {
+        fprintf(stderr, "%sInvalid store \"%s\": use a name of letters, digits and _ and a file.%s\n", RED, name, RESET);
+        return false;
+    }
+
+    int i = 0;
+    while (i < storeCount && strcasecmp(stores[i].name, name) != 0) {
+        i++;
+    }
+    if (i == STORES_MAX) {
+        fprintf(stderr, "%sToo many stores, %s not added: at most %d.%s\n", RED, name, STORES_MAX, RESET);
+        return false;
+    }
+    if (i == storeCount) {
+        storeCount++;
+    } else {
+        free(stores[i].path);
+    }
+    snprintf(stores[i].name, sizeof(stores[i].name), "%s", name);
+    stores[i].path = strdup(path);
+    return true;
+}
+
+/**
+ * @brief Adds a store given as "name=path".
+ *
+ * @return True if the store was added.
+ */
+bool addStoreSpec(const char *spec) {
+    char name[STORE_NAME_LENGTH + 1];
+    const char *equals = strchr(spec, '=');
+
+    if (equals == NULL || equals - spec > STORE_NAME_LENGTH) {
+        fprintf(stderr, "%sInvalid store \"%s\": use name=path.%s\n", RED, spec, RESET);
+        return false;
+    }
+    snprintf(name, sizeof(name), "%.*s", (int)(equals - spec), spec);
+    return addStore(name, equals + 1);
+}
+
+/**
+ * @brief Removes the white space around a string in place.
+ */
+char *trimSpace(char *text) {
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+    char *end = text + strlen(text);
+    while (end > text && isspace((unsigned char)end[-1])) {
+        *--end = '\0';
+    }
+    return text;
+}
+
+/**
+ * @brief Reads a configuration file of "key = value" lines; '#' starts a comment.
+ *
+ * Keys are "database", the database file of the shop, and "store.<name>", a store.
+ *
+ * @param path     The file.
+ * @param required Whether a missing file is an error.
+ *
+ * @return False if the file could not be read or has an error.
+ */
+bool readConfigFile(const char *path, bool required) {
+    char line[1024];
+    int number = 0;
+    bool ok = true;
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        if (required) {
+            fprintf(stderr, "%sCan't read configuration %s.%s\n", RED, path, RESET);
+        }
+        return !required;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        line[strcspn(line, "#\n")] = '\0';
+        char *equals = strchr(line, '=');
+        if (trimSpace(line)[0] == '\0') {
+            continue;
+        }
+        if (equals == NULL) {
+            fprintf(stderr, "%s%s:%d: expected key = value.%s\n", RED, path, number, RESET);
+            ok = false;
+            continue;
+        }
+
+        *equals = '\0';
+        char *key = trimSpace(line), *value = trimSpace(equals + 1);
+        if (strcmp(key, "database") == 0) {
+            setDatabaseFile(value);
+        } else if (strncmp(key, "store.", 6) == 0) {
+            ok = addStore(key + 6, value) && ok;
+        } else {
+            fprintf(stderr, "%s%s:%d: unknown key %s.%s\n", RED, path, number, key, RESET);
+            ok = false;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+/**
+ * @brief Reads the configuration: $BOOKERY_CONFIG or bookery.conf in the working directory, then
+ *        $BOOKERY_DB and $BOOKERY_STORES (comma separated name=path), which take precedence.
+ *        Command line flags are applied after this and take precedence over both.
+ *
+ * @return False if the configuration has an error.
+ */
+bool readConfig() {
+    const char *config = getenv("BOOKERY_CONFIG");
+    const char *database = getenv("BOOKERY_DB");
+    const char *list = getenv("BOOKERY_STORES");
+    bool ok = readConfigFile(config != NULL ? config : CONFIG_FILE, config != NULL);
+
+    if (database != NULL && database[0] != '\0') {
+        setDatabaseFile(database);
+    }
+    if (list != NULL) {
+        char *copy = strdup(list), *state;
+        for (char *spec = strtok_r(copy, ",", &state); spec != NULL; spec = strtok_r(NULL, ",", &state)) {
+            ok = addStoreSpec(trimSpace(spec)) && ok;
+        }
+        free(copy);
+    }
+    return ok;
+}
+
+/**
+ * @brief Makes an SQLite URI of a file path, escaping the characters with a meaning in URIs.
+ *
+ * @param uri   Buffer receiving the URI.
+ * @param size  Size of the buffer.
+ * @param path  The file.
+ * @param query Query parameters, e.g. "mode=ro".
+ */
+void databaseUri(char *uri, size_t size, const char *path, const char *query) {
+    size_t length = snprintf(uri, size, "file:");
+    for (const char *c = path; *c != '\0' && length + 4 < size; c++) {
+        if (strchr("?#%", *c) != NULL) {
+            length += snprintf(uri + length, size - length, "%%%02X", *c);
+        } else {
+            uri[length++] = *c;
+            uri[length] = '\0';
+        }
+    }
+    snprintf(uri + length, size - length, "?%s", query);
+}
+
+/**
+ * @brief Attaches every store to a connection, read-only, under its name. A store that can't be
+ *        opened is reported and left out.
+ *
+ * @param db Connection opened with SQLITE_OPEN_URI.
+ *
+ * @return Number of stores attached.
+ */
+int attachStores(sqlite3 *db) {
+    int attached = 0;
+
+    for (int i = 0; i < storeCount; i++) {
+        char uri[1024], sql[STORE_NAME_LENGTH + 32];
+        sqlite3_stmt *stmt;
+
+        databaseUri(uri, sizeof(uri), stores[i].path, "mode=ro");
+        snprintf(sql, sizeof(sql), "ATTACH DATABASE ? AS \"%.*s\";", STORE_NAME_LENGTH - 1, stores[i].name);
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+            fprintf(stderr, "%sCan't attach store %s: %s%s\n", RED, stores[i].name, sqlite3_errmsg(db), RESET);
+            return attached;
+        }
+        sqlite3_bind_text(stmt, 1, uri, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            attached++;
+        } else if (!stores[i].reported) {
+            // Every connection attaches the stores; say it once.
+            fprintf(stderr, "%sCan't attach store %s (%s): %s%s\n", RED, stores[i].name, stores[i].path,
+                    sqlite3_errmsg(db), RESET);
+            stores[i].reported = true;
+        }
+        sqlite3_finalize(stmt);
+    }
+    return attached;
+}
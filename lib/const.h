@@ -31,18 +31,57 @@ char *RESET = "\033[0m";
 #define MAX_AUTHOR_LENGTH 100
 #define MAX_GENRE_LENGTH 50
 #define SHA256_DIGEST_LENGTH 32
-
-
-int userRole;
-char userName[50];
+#define PASSWORD_HASH_LENGTH 32
+#define PASSWORD_SALT_LENGTH 16
+#define PASSWORD_COST_DEFAULT 100000
+#define PASSWORD_COST_MIN 1000
+#define PASSWORD_COST_MAX 100000000
+#define PASSWORD_TARGET_MS 100
+#define SESSION_TOKEN_LENGTH 32
+#define SESSION_TOKEN_LIFETIME (8 * 60 * 60)
+#define SESSION_TOKEN_FILE ".bookery_token"
+#define SOCKET_FILE "bookery.sock"
+#define REQUEST_MAX_LENGTH 1024
+#define REQUEST_MAX_ARGS 8
+
+
+// Sends a tab separated request to the server, or runs it locally when not connected to one.
+bool submitRequest(const char *request);
+bool submitRequestTo(const char *request, FILE *out);
+
+// Hands a write to the server's writer thread, which runs apply(connection, request, output) in its
+// next group commit. Returns false when no writer thread runs.
+struct Database;
+struct Session;
+bool queueWrite(bool (*apply)(struct Database *database, void *data, FILE *out), const char *request);
+
+// Commits a write on the writer thread when called on a read worker, else in its own transaction.
+bool commitWrite(struct Session *session, bool (*apply)(struct Database *database, void *data, FILE *out), void *data);
+
+// Writes a memory event to the audit log when one is due.
+int writeMemoryEvent(FILE *file, const char *stamp);
 
 void clearInputBuffer() {
     int c;
     while ((c = getchar()) != '\n' && c != EOF);
 }
+// Function to validate text sent to the server. Requests separate their arguments by tabs and
+// end at a newline, so either one would split the text into extra arguments.
+bool validateField(const char *text) {
+
+    if (strpbrk(text, "\t\n") != NULL) {
+        printf("%sTabs and line breaks are not allowed. Please try again.\n%s",RED,RESET);
+        return false;
+    }
+    return true;
+}
+
 // Function to validate title
 bool validateTitle(const char *title) {
 
+    if (!validateField(title)) {
+        return false;
+    }
     if (title[0] == '\0' || strlen(title) > MAX_TITLE_LENGTH) {
         printf("%sTitle was in wrong format. Please try again.\n%s", RED,RESET);
         return false;
@@ -53,6 +92,9 @@ bool validateTitle(const char *title) {
 // Function to validate author
 bool validateAuthor(const char *author) {
 
+    if (!validateField(author)) {
+        return false;
+    }
     if (author[0] == '\0' || strlen(author) > MAX_AUTHOR_LENGTH) {
         printf("%sWrong input, please try again.\n%s",RED,RESET);
         return false;
@@ -63,6 +105,9 @@ bool validateAuthor(const char *author) {
 // Function to validate genre
 bool validateGenre(const char *genre) {
 
+    if (!validateField(genre)) {
+        return false;
+    }
     if (genre[0] == '\0' || strlen(genre) > MAX_GENRE_LENGTH) {
         printf("%sWrong genre format. Please try again.\n%s",RED,RESET);
         return false;
@@ -109,6 +154,9 @@ bool validateID(int id) {
 }
 // Validate Username
 bool validateUsername(const char *username) {
+    if (!validateField(username)) {
+        return false;
+    }
     // Username must not be empty and must have at least 4 characters
     if (strlen(username) <= 3   ) {
         printf("%sUsername must be at least 4 characters.\n%s",RED,RESET);
@@ -118,6 +166,9 @@ bool validateUsername(const char *username) {
 }
 
 bool validatePassword(const char *password) {
+    if (!validateField(password)) {
+        return false;
+    }
     // Password must not be empty and must have at least 5 characters
     if (strlen(password) <= 4) {
         printf("%sPassword is too short, Please try again.\n%s",RED,RESET);
@@ -129,6 +180,9 @@ bool validatePassword(const char *password) {
 
 
 bool validatePhone(const char *phone) {
+    if (!validateField(phone)) {
+        return false;
+    }
     // Phone number must not be empty and must have at least 10 characters
     if (strlen(phone) < 10) {
         return false;
@@ -155,6 +209,9 @@ int callback_count(void *data, int argc, char **argv, char **azColName){
 
 
 bool validateEmail(const char *email) {
+    if (!validateField(email)) {
+        return false;
+    }
     // Basic email format validation (not comprehensive)
     int at_count = 0;
     int dot_count = 0;
@@ -257,13 +314,17 @@ void help(const char *command) {
         printf("Usage: login \n");
         printf("Description: Login to another account.\n");
 
+    } else if (strcmp(command, "logout") == 0) {
+        printf("Usage: logout \n");
+        printf("Description: Forget the saved login of this account and exit.\n");
+
     } else if (strcmp(command, "update") == 0) {
         printf("Usage: update [book/user] \n");
         printf("Description: Update the details of a book or a user.\n");
     }
     else if (strcmp(command, "show") == 0) {
-        printf("Usage: show [users/books/rents]\n");
-        printf("Description: Display all books, users or rent records.\n");
+        printf("Usage: show [users/books/rents/locks/queries]\n");
+        printf("Description: Display all books, users, rent records, lock wait counters or the SQL statement profile.\n");
 
     }else if (strcmp(command, "search") == 0) {
         printf("Usage: search [book/rent]\n");
@@ -274,17 +335,35 @@ void help(const char *command) {
         printf("Description: Sell a book.\n");
     }
     else if (strcmp(command, "rent") == 0) {
-        printf("Usage: rent [book/recall/late]\n");
-        printf("Description: Rent or recall a book.\n");
+        printf("Usage: rent [book/recall/late/due]\n");
+        printf("Description: Rent or recall a book, or display the late rents or those coming due.\n");
     }
     else if (strcmp(command, "report") == 0) {
-        printf("Usage: report [sales/rents]\n");
-        printf("Description:  Generate report for sales or rents.\n");
+        printf("Usage: report [sales/rents/genres/stores]\n");
+        printf("Description:  Generate report for sales or rents, per genre or per store.\n");
+        printf("              report chain asks for branch database files and reports the sales and\n");
+        printf("              rents of all of them, each branch read at once on its own thread.\n");
 
     }else if (strcmp(command, "whoami") == 0) {
         printf("Usage: whoami\n");
         printf("Description:  Display the username and role.\n");
 
+    }else if (strcmp(command, "import") == 0) {
+        printf("Usage: import [users]\n");
+        printf("Description:  Add the users of a CSV file (username,email,role,password), all or none.\n");
+
+    }else if (strcmp(command, "calibrate") == 0) {
+        printf("Usage: calibrate [hash]\n");
+        printf("Description:  Pick the password hashing cost for a target login time.\n");
+
+    }else if (strcmp(command, "mem") == 0) {
+        printf("Usage: mem\n");
+        printf("Description:  Display the memory used by SQLite, its page caches and bookery, and the memory budget.\n");
+
+    }else if (strcmp(command, "stats") == 0) {
+        printf("Usage: stats\n");
+        printf("Description:  Display latency percentiles, rows changed and SQLite steps of every command.\n");
+
     }else if (strcmp(command, "clear") == 0) {
         printf("Usage: clear\n");
         printf("Description:  Clear the screen.\n");
@@ -299,6 +378,10 @@ void help(const char *command) {
         printf("6.    show books      -       Display all books.\n");
         printf("7.    show users      -       Display all users.\n");
         printf("8.    show rents      -       Display all rents.\n");
+        printf("      show locks      -       Display lock wait counters.\n");
+        printf("      stats           -       Display command statistics.\n");
+        printf("      show queries    -       Display the SQL statement profile.\n");
+        printf("      mem             -       Display memory use and the memory budget.\n");
         printf("9.    search book     -       Search for a book.\n");
         printf("10.   search rent     -       Search for a rent record.\n");
         printf("11.   update book     -       Update the details of a book.\n");
@@ -306,12 +389,21 @@ void help(const char *command) {
         printf("13.   rent book       -       Rent a book.\n");
         printf("14.   rent recall     -       Recall a rented book.\n");
         printf("15.   rent late       -       Display Late rent returns.\n");
+        printf("      rent due        -       Display the rents coming due in the next days.\n");
         printf("16.   report sales    -       Generate sales report.\n"); 
         printf("17.   report rents    -       Generate sales report.\n"); 
+        printf("      report genres   -       Generate the books and sales of every genre.\n");
+        printf("      report stores   -       Generate the books, sales and rents of every store.\n");
+        printf("      report chain    -       Generate the sales and rents of many branch databases.\n");
+        printf("      export changes  -       Export the changes of books, rents and users since a sequence number.\n");
+        printf("      prune changes   -       Remove the changes head office has loaded.\n");
         printf("18.   whoami          -       Display the username and role.\n"); 
+        printf("      import users    -       Add the users of a CSV file.\n");
+        printf("      calibrate hash  -       Pick the password hashing cost.\n");
         printf("19.   clear           -       Clear the screen.\n"); 
         printf("20.   back            -       Go back to the previous menu.\n");
         printf("21.   login           -       Login to another account.\n");
+        printf("      logout          -       Forget the saved login and exit.\n");
         printf("22.   help            -       Shows this help message.\n");
         printf("23.   exit            -       Exit the program.\n\n");
     } 
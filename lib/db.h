@@ -0,0 +1,228 @@
+/*
+ * File:          db.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the resident database connection and its prepared statement cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sqlite3.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "profile.h"
+#include "config.h"
+
+#define BUSY_TIMEOUT_MS 5000
+#define BUSY_BACKOFF_MIN_US 1000
+#define BUSY_BACKOFF_MAX_US 100000
+#define TRANSACTION_RETRIES 5
+
+// Define structure for an open database connection.
+struct Database {
+    sqlite3 *db;                 // SQLite connection.
+    int busyTimeout;             // Milliseconds to wait for a lock before giving up.
+    long busyWaited;             // Microseconds waited for the current lock.
+    long busyTimeouts;           // Number of lock waits that gave up on this connection.
+    int cached;                  // Number of statements in the cache.
+    int capacity;                // Allocated size of the cache arrays.
+    const char **cachedSql;      // SQL text of each cached statement.
+    sqlite3_stmt **cachedStmt;   // Prepared statement for each SQL text.
+    struct Database *nextOpen;   // Next connection in openDatabases.
+    sqlite3_int64 catalogSeen;   // data_version at which this connection last found the catalog current.
+    sqlite3_int64 rentalsSeen;   // Same for the queue of open rentals.
+};
+
+// Connection shared by the CLI and the server.
+struct Database shopDatabase;
+
+// Every open connection of the process, for "mem".
+struct Database *openDatabases;
+pthread_mutex_t openDatabasesLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Lock contention counters of the whole process, shown by "show locks".
+atomic_long lockWaits;           // Times a connection had to wait for a lock.
+atomic_long lockWaitMicros;      // Total time spent waiting for locks.
+atomic_long lockTimeouts;        // Waits that gave up after the busy timeout.
+atomic_long transactionRetries;  // Transactions started again after losing a lock race.
+
+/**
+ * @brief Busy handler sleeping with bounded exponential backoff while another process holds a lock.
+ *
+ * @param arg      The connection waiting for the lock.
+ * @param attempts Number of times the handler was already called for this lock.
+ *
+ * @return Non-zero to retry, 0 to give up and let SQLite return SQLITE_BUSY.
+ */
+int busyHandler(void *arg, int attempts) {
+    struct Database *database = arg;
+
+    if (attempts == 0) {
+        database->busyWaited = 0;
+        atomic_fetch_add(&lockWaits, 1);
+    }
+    if (database->busyWaited >= database->busyTimeout * 1000L) {
+        database->busyTimeouts++;
+        atomic_fetch_add(&lockTimeouts, 1);
+        return 0;
+    }
+
+    // Double the delay on every attempt, up to BUSY_BACKOFF_MAX_US.
+    long delay = (long)BUSY_BACKOFF_MIN_US << (attempts < 16 ? attempts : 16);
+    if (delay > BUSY_BACKOFF_MAX_US) {
+        delay = BUSY_BACKOFF_MAX_US;
+    }
+    usleep(delay);
+    database->busyWaited += delay;
+    atomic_fetch_add(&lockWaitMicros, delay);
+    return 1;
+}
+
+/**
+ * @brief Opens a database connection with an empty statement cache.
+ *
+ * @param database The connection to initialize.
+ * @param path     Path of the database file.
+ * @param flags    SQLITE_OPEN_* flags passed to sqlite3_open_v2().
+ *
+ * @return SQLITE_OK on success, an SQLite error code otherwise.
+ */
+int openDatabase(struct Database *database, const char *path, int flags) {
+    memset(database, 0, sizeof(*database));
+
+    int return_code = sqlite3_open_v2(path, &database->db, flags, NULL);
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(database->db));
+        sqlite3_close(database->db);
+        database->db = NULL;
+        return return_code;
+    }
+
+    // Wait for other tills instead of failing with "database is locked".
+    const char *timeout = getenv("BOOKERY_BUSY_TIMEOUT");
+    database->busyTimeout = timeout != NULL ? atoi(timeout) : BUSY_TIMEOUT_MS;
+    sqlite3_busy_handler(database->db, busyHandler, database);
+    profileConnection(database->db);
+
+    pthread_mutex_lock(&openDatabasesLock);
+    database->nextOpen = openDatabases;
+    openDatabases = database;
+    pthread_mutex_unlock(&openDatabasesLock);
+    return return_code;
+}
+
+/**
+ * @brief Runs a transaction control statement, starting it again while the database stays locked.
+ *
+ * Used for "BEGIN IMMEDIATE;", which takes the write lock up front so the statements of the
+ * transaction can't lose a lock race halfway, and for "COMMIT;", which leaves the transaction
+ * open when it fails with SQLITE_BUSY and can simply be run again.
+ *
+ * @param database The connection.
+ * @param sql      The statement to run.
+ *
+ * @return SQLITE_OK on success, the last error code otherwise.
+ */
+int runLocked(struct Database *database, const char *sql) {
+    int return_code = sqlite3_exec(database->db, sql, 0, 0, 0);
+
+    for (int attempt = 0; (return_code & 0xff) == SQLITE_BUSY && attempt < TRANSACTION_RETRIES; attempt++) {
+        atomic_fetch_add(&transactionRetries, 1);
+        return_code = sqlite3_exec(database->db, sql, 0, 0, 0);
+    }
+    return return_code;
+}
+
+/**
+ * @brief Returns a ready-to-bind statement for the given SQL, preparing it on first use.
+ *
+ * Statements are cached per connection and keyed by their SQL text, so callers pass the same
+ * string literal every time and must only reset (never finalize) the returned statement.
+ *
+ * @param database The connection owning the cache.
+ * @param sql      The SQL text of the statement.
+ *
+ * @return The prepared statement, or NULL if preparation failed.
+ */
+sqlite3_stmt *prepareStatement(struct Database *database, const char *sql) {
+    for (int i = 0; i < database->cached; i++) {
+        if (database->cachedSql[i] == sql || strcmp(database->cachedSql[i], sql) == 0) {
+            sqlite3_reset(database->cachedStmt[i]);
+            sqlite3_clear_bindings(database->cachedStmt[i]);
+            return database->cachedStmt[i];
+        }
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v3(database->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, NULL) != SQLITE_OK) {
+        return NULL;
+    }
+
+    // Grow the cache when it is full.
+    if (database->cached == database->capacity) {
+        database->capacity = database->capacity ? database->capacity * 2 : 32;
+        database->cachedSql = realloc(database->cachedSql, database->capacity * sizeof(*database->cachedSql));
+        database->cachedStmt = realloc(database->cachedStmt, database->capacity * sizeof(*database->cachedStmt));
+    }
+    database->cachedSql[database->cached] = sql;
+    database->cachedStmt[database->cached] = stmt;
+    database->cached++;
+    return stmt;
+}
+
+/**
+ * @brief Returns the data version of a connection, which changes when another connection,
+ *        possibly of another process, commits.
+ *
+ * @return The version, or -1 if it could not be read.
+ */
+sqlite3_int64 dataVersion(struct Database *database) {
+    sqlite3_stmt *stmt = prepareStatement(database, "PRAGMA data_version;");
+    sqlite3_int64 version = -1;
+
+    if (stmt != NULL && sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int64(stmt, 0);
+    }
+    if (stmt != NULL) {
+        sqlite3_reset(stmt);
+    }
+    return version;
+}
+
+/**
+ * @brief Resets every cached statement so no read transaction stays open between commands.
+ *
+ * @param database The connection owning the cache.
+ */
+void resetStatements(struct Database *database) {
+    for (int i = 0; i < database->cached; i++) {
+        sqlite3_reset(database->cachedStmt[i]);
+    }
+}
+
+/**
+ * @brief Finalizes the cached statements and closes the connection.
+ *
+ * @param database The connection to close.
+ */
+void closeDatabase(struct Database *database) {
+    pthread_mutex_lock(&openDatabasesLock);
+    for (struct Database **link = &openDatabases; *link != NULL; link = &(*link)->nextOpen) {
+        if (*link == database) {
+            *link = database->nextOpen;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&openDatabasesLock);
+
+    for (int i = 0; i < database->cached; i++) {
+        sqlite3_finalize(database->cachedStmt[i]);
+    }
+    free(database->cachedSql);
+    free(database->cachedStmt);
+    sqlite3_close(database->db);
+    memset(database, 0, sizeof(*database));
+}
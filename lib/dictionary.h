@@ -0,0 +1,247 @@
+/*
+ * File:          dictionary.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the interning dictionaries of the authors and genres tables: every name
+ *                stored once, found by id through an array and by name through a hash table, so
+ *                books carry small integer ids instead of repeating the text.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <sqlite3.h>
+
+// Define structure for the names of one lookup table, with the statements reading and adding them.
+// Only names read from committed rows are kept, so a rolled back insert never leaves a wrong id behind.
+struct Dictionary {
+    const char *loadSql;                 // Reads every id and name.
+    const char *nameSql;                 // Reads the name of one id.
+    const char *lookupSql;               // Reads the id of one name.
+    const char *insertSql;               // Adds a name.
+    char **names;                        // Names by id, NULL where unknown.
+    int capacity;                        // Length of names.
+    int *slots;                          // Hash table of ids by name, 0 for a free slot.
+    int slotCount;                       // Length of slots, a power of two.
+    int count;                           // Names known.
+    size_t bytes;                        // Bytes of the names.
+};
+
+struct Dictionary authorNames = {
+    "SELECT id, name FROM authors;", "SELECT name FROM authors WHERE id=?;",
+    "SELECT id FROM authors WHERE name=?;", "INSERT INTO authors (name) VALUES (?);"
+};
+struct Dictionary genreNames = {
+    "SELECT id, name FROM genres;", "SELECT name FROM genres WHERE id=?;",
+    "SELECT id FROM genres WHERE name=?;", "INSERT INTO genres (name) VALUES (?);"
+};
+
+/**
+ * @brief Matches a text against an SQL LIKE pattern, as SQLite does: '%' matches any run of
+ *        characters, '_' one character, and ASCII letters match regardless of case.
+ */
+bool likeMatch(const char *pattern, const char *text) {
+    const char *star = NULL, *resume = NULL;
+
+    while (*text != '\0') {
+        if (*pattern == '%') {
+            // Remember where to retry when the rest doesn't match.
+            star = ++pattern;
+            resume = text;
+        } else if (*pattern == '_' || (*pattern != '\0' && tolower((unsigned char)*pattern) == tolower((unsigned char)*text))) {
+            // '_' takes a whole UTF-8 character.
+            if (*pattern == '_') {
+                while (((unsigned char)text[1] & 0xC0) == 0x80) {
+                    text++;
+                }
+            }
+            pattern++;
+            text++;
+        } else if (star != NULL) {
+            pattern = star;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '%') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+/**
+ * @brief FNV-1a hash of a name.
+ */
+unsigned int hashName(const char *name) {
+    unsigned int hash = 2166136261u;
+    for (const char *c = name; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Returns the id of a name, or 0 if the dictionary doesn't know it.
+ */
+int findName(const struct Dictionary *dictionary, const char *name) {
+    if (dictionary->slotCount == 0) {
+        return 0;
+    }
+    for (unsigned int slot = hashName(name);; slot++) {
+        int id = dictionary->slots[slot & (dictionary->slotCount - 1)];
+        if (id == 0 || strcmp(dictionary->names[id], name) == 0) {
+            return id;
+        }
+    }
+}
+
+/**
+ * @brief Returns the name of an id, or an empty string if the dictionary doesn't know it.
+ */
+const char *dictionaryName(const struct Dictionary *dictionary, int id) {
+    return id > 0 && id < dictionary->capacity && dictionary->names[id] != NULL ? dictionary->names[id] : "";
+}
+
+/**
+ * @brief Puts an id in its slot of the hash table.
+ */
+void placeName(struct Dictionary *dictionary, int id) {
+    unsigned int slot = hashName(dictionary->names[id]);
+    while (dictionary->slots[slot & (dictionary->slotCount - 1)] != 0) {
+        slot++;
+    }
+    dictionary->slots[slot & (dictionary->slotCount - 1)] = id;
+}
+
+/**
+ * @brief Adds a name read from the database. Ids never change, so a known id is left alone.
+ */
+void addName(struct Dictionary *dictionary, int id, const char *name) {
+    if (id <= 0 || (id < dictionary->capacity && dictionary->names[id] != NULL)) {
+        return;
+    }
+
+    if (id >= dictionary->capacity) {
+        int capacity = dictionary->capacity ? dictionary->capacity : 64;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        dictionary->names = realloc(dictionary->names, capacity * sizeof(char *));
+        memset(dictionary->names + dictionary->capacity, 0, (capacity - dictionary->capacity) * sizeof(char *));
+        dictionary->capacity = capacity;
+    }
+    dictionary->names[id] = strdup(name != NULL ? name : "");
+    dictionary->bytes += strlen(dictionary->names[id]) + 1;
+    dictionary->count++;
+
+    // Keep the hash table at most half full.
+    if (dictionary->count * 2 > dictionary->slotCount) {
+        free(dictionary->slots);
+        dictionary->slotCount = dictionary->slotCount ? dictionary->slotCount * 2 : 128;
+        dictionary->slots = calloc(dictionary->slotCount, sizeof(int));
+        for (int i = 1; i < dictionary->capacity; i++) {
+            if (dictionary->names[i] != NULL) {
+                placeName(dictionary, i);
+            }
+        }
+    } else {
+        placeName(dictionary, id);
+    }
+}
+
+/**
+ * @brief Reads every name of the table into the dictionary.
+ *
+ * @return True on success.
+ */
+bool loadNames(struct Database *database, struct Dictionary *dictionary) {
+    sqlite3_stmt *stmt = prepareStatement(database, dictionary->loadSql);
+    if (stmt == NULL) {
+        return false;
+    }
+
+    int return_code;
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+        addName(dictionary, sqlite3_column_int(stmt, 0), (const char *)sqlite3_column_text(stmt, 1));
+    }
+    sqlite3_reset(stmt);
+    return return_code == SQLITE_DONE;
+}
+
+/**
+ * @brief Reads the name of an id the dictionary doesn't know yet, e.g. one added since it was loaded.
+ *
+ * @param id The id, set to 0 if no such name exists.
+ *
+ * @return True on success, also when the id doesn't exist.
+ */
+bool resolveName(struct Database *database, struct Dictionary *dictionary, int *id) {
+    if (*id <= 0 || (*id < dictionary->capacity && dictionary->names[*id] != NULL)) {
+        return true;
+    }
+
+    sqlite3_stmt *stmt = prepareStatement(database, dictionary->nameSql);
+    if (stmt == NULL) {
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, *id);
+    int return_code = sqlite3_step(stmt);
+    if (return_code == SQLITE_ROW) {
+        addName(dictionary, *id, (const char *)sqlite3_column_text(stmt, 0));
+    } else {
+        *id = 0;
+    }
+    sqlite3_reset(stmt);
+    return return_code == SQLITE_ROW || return_code == SQLITE_DONE;
+}
+
+/**
+ * @brief Finds the id of a name in the table, adding the name if it is new. Runs in the caller's
+ *        transaction; the dictionary learns the name once the catalog reads the committed row.
+ *
+ * @return The id, or 0 on error.
+ */
+int storeName(struct Database *database, struct Dictionary *dictionary, const char *name) {
+    sqlite3_stmt *stmt = prepareStatement(database, dictionary->lookupSql);
+    if (stmt == NULL) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    int id = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_reset(stmt);
+    if (id != 0) {
+        return id;
+    }
+
+    stmt = prepareStatement(database, dictionary->insertSql);
+    if (stmt == NULL) {
+        return 0;
+    }
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return return_code == SQLITE_DONE ? (int)sqlite3_last_insert_rowid(database->db) : 0;
+}
+
+/**
+ * @brief Matches every name against an SQL LIKE pattern.
+ *
+ * @return Array indexed by id, true where the name matches; free it after use.
+ */
+bool *matchNames(const struct Dictionary *dictionary, const char *pattern) {
+    bool *matches = calloc(dictionary->capacity + 1, sizeof(bool));
+    for (int i = 1; i < dictionary->capacity; i++) {
+        matches[i] = dictionary->names[i] != NULL && likeMatch(pattern, dictionary->names[i]);
+    }
+    return matches;
+}
+
+/**
+ * @brief Returns the memory held by the dictionary, in bytes.
+ */
+size_t dictionaryBytes(const struct Dictionary *dictionary) {
+    return dictionary->capacity * sizeof(char *) + dictionary->slotCount * sizeof(int) + dictionary->bytes;
+}
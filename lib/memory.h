@@ -0,0 +1,173 @@
+/*
+ * File:          memory.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the memory report: what SQLite and its page caches use, what bookery
+ *                itself allocates, and the memory budget that keeps SQLite from pushing a till into swap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sqlite3.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define MEMORY_REPORT_SECONDS 300        // Interval of the memory events in the audit log.
+
+// Define structure for a snapshot of the memory use of the process.
+struct MemoryUsage {
+    sqlite3_int64 sqliteUsed;            // Bytes currently allocated by SQLite.
+    sqlite3_int64 sqlitePeak;            // Most bytes SQLite ever had allocated.
+    sqlite3_int64 pageCache;             // Page caches of all connections.
+    sqlite3_int64 statements;            // Prepared statements of all connections.
+    sqlite3_int64 schema;                // Schemas of all connections.
+    sqlite3_int64 cacheHits;             // Pages found in the page caches.
+    sqlite3_int64 cacheMisses;           // Pages read from the file.
+    int connections;                     // Open connections.
+    sqlite3_int64 heap;                  // Bytes in use on the heap, SQLite included, -1 if unknown.
+    sqlite3_int64 tables;                // Fixed-size tables of bookery: statistics, audit buffer, throttling.
+    sqlite3_int64 catalog;               // Resident book catalog.
+    sqlite3_int64 rentals;               // Queue of open rentals.
+};
+
+// Memory budget in bytes, 0 for none.
+sqlite3_int64 memoryBudget = 0;
+
+// Seconds between memory events in the audit log, 0 for none.
+int memoryInterval = MEMORY_REPORT_SECONDS;
+
+/**
+ * @brief Takes a snapshot of the memory use of the process.
+ *
+ * @param usage Receives the snapshot.
+ */
+void measureMemory(struct MemoryUsage *usage) {
+    sqlite3_int64 current, peak;
+    int used, highwater;
+
+    memset(usage, 0, sizeof(*usage));
+    sqlite3_status64(SQLITE_STATUS_MEMORY_USED, &current, &peak, 0);
+    usage->sqliteUsed = current;
+    usage->sqlitePeak = peak;
+
+    pthread_mutex_lock(&openDatabasesLock);
+    for (struct Database *database = openDatabases; database != NULL; database = database->nextOpen) {
+        sqlite3_db_status(database->db, SQLITE_DBSTATUS_CACHE_USED, &used, &highwater, 0);
+        usage->pageCache += used;
+        sqlite3_db_status(database->db, SQLITE_DBSTATUS_STMT_USED, &used, &highwater, 0);
+        usage->statements += used;
+        sqlite3_db_status(database->db, SQLITE_DBSTATUS_SCHEMA_USED, &used, &highwater, 0);
+        usage->schema += used;
+        sqlite3_db_status(database->db, SQLITE_DBSTATUS_CACHE_HIT, &used, &highwater, 0);
+        usage->cacheHits += used;
+        sqlite3_db_status(database->db, SQLITE_DBSTATUS_CACHE_MISS, &used, &highwater, 0);
+        usage->cacheMisses += used;
+        usage->connections++;
+    }
+    pthread_mutex_unlock(&openDatabasesLock);
+
+#ifdef __GLIBC__
+    struct mallinfo2 heap = mallinfo2();
+    usage->heap = heap.uordblks + heap.hblkhd;
+#else
+    usage->heap = -1;
+#endif
+    usage->tables = sizeof(commandStats) + sizeof(statementProfiles) + sizeof(auditRing) + sizeof(loginFailures);
+    pthread_rwlock_rdlock(&catalogLock);
+    usage->catalog = catalogBytes();
+    pthread_rwlock_unlock(&catalogLock);
+    pthread_rwlock_rdlock(&rentalLock);
+    usage->rentals = rentalBytes();
+    pthread_rwlock_unlock(&rentalLock);
+}
+
+/**
+ * @brief Applies the memory budget from $BOOKERY_MEMORY_LIMIT_MB.
+ *
+ * SQLite starts evicting cached pages at three quarters of the budget, and an allocation that
+ * would exceed it fails, so a huge report ends with "out of memory" instead of swapping.
+ */
+void setMemoryBudget() {
+    const char *limit = getenv("BOOKERY_MEMORY_LIMIT_MB");
+    const char *interval = getenv("BOOKERY_MEMORY_INTERVAL");
+
+    if (interval != NULL) {
+        memoryInterval = atoi(interval);
+    }
+    if (limit == NULL || atol(limit) <= 0) {
+        return;
+    }
+    memoryBudget = (sqlite3_int64)atol(limit) * 1024 * 1024;
+    sqlite3_soft_heap_limit64(memoryBudget / 4 * 3);
+    sqlite3_hard_heap_limit64(memoryBudget);
+}
+
+/**
+ * @brief Writes a memory event to the audit log every memoryInterval seconds.
+ *
+ * Called by the event thread of the audit log every second.
+ *
+ * @param file  The audit log.
+ * @param stamp Current time, formatted like the audit records.
+ *
+ * @return Number of bytes written, 0 if no event was due.
+ */
+int writeMemoryEvent(FILE *file, const char *stamp) {
+    static time_t last = 0;
+    time_t now = time(NULL);
+    struct MemoryUsage usage;
+
+    if (memoryInterval <= 0 || now - last < memoryInterval) {
+        return 0;
+    }
+    last = now;
+    measureMemory(&usage);
+
+    return fprintf(file, "{\"time\":\"%s\",\"event\":\"memory\",\"sqlite_bytes\":%lld,\"page_cache_bytes\":%lld,"
+                         "\"statement_bytes\":%lld,\"heap_bytes\":%lld,\"cache_hits\":%lld,\"cache_misses\":%lld}\n",
+                   stamp, usage.sqliteUsed, usage.pageCache, usage.statements, usage.heap, usage.cacheHits,
+                   usage.cacheMisses);
+}
+
+/**
+ * @brief Prints the memory use of the process and the budget.
+ *
+ * @param session The session running the command.
+ *
+ * @return True.
+ */
+bool execMem(struct Session *session) {
+    FILE *out = session->out;
+    struct MemoryUsage usage;
+
+    measureMemory(&usage);
+    long lookups = usage.cacheHits + usage.cacheMisses;
+
+    fprintf(out, "\n%s*********** Memory ***********%s\n\n", YELLOW, RESET);
+    fprintf(out, "SQLite in use:        %.1f KB (peak %.1f KB)\n", usage.sqliteUsed / 1024.0, usage.sqlitePeak / 1024.0);
+    fprintf(out, "  page caches:        %.1f KB over %d connections\n", usage.pageCache / 1024.0, usage.connections);
+    fprintf(out, "  statements:         %.1f KB\n", usage.statements / 1024.0);
+    fprintf(out, "  schemas:            %.1f KB\n", usage.schema / 1024.0);
+    fprintf(out, "Page cache hits:      %lld of %ld (%.1f%%)\n", usage.cacheHits, lookups,
+            lookups > 0 ? 100.0 * usage.cacheHits / lookups : 100.0);
+    if (usage.heap >= 0) {
+        fprintf(out, "Bookery heap:         %.1f KB\n", (usage.heap - usage.sqliteUsed) / 1024.0);
+    }
+    fprintf(out, "Bookery tables:       %.1f KB\n", usage.tables / 1024.0);
+    fprintf(out, "Book catalog:         %.1f KB\n", usage.catalog / 1024.0);
+    fprintf(out, "Rental queue:         %.1f KB\n", usage.rentals / 1024.0);
+    if (memoryMode) {
+        fprintf(out, "Database in memory:   %ld snapshots to %s, the last took %.1f ms\n", snapshotCount, databaseFile,
+                snapshotMillis);
+    }
+    if (memoryBudget > 0) {
+        fprintf(out, "Budget:               %.1f MB (caches shrink above %.1f MB)\n\n", memoryBudget / 1048576.0,
+                memoryBudget / 4 * 3 / 1048576.0);
+    } else {
+        fprintf(out, "Budget:               none, set BOOKERY_MEMORY_LIMIT_MB\n\n");
+    }
+    return true;
+}
@@ -0,0 +1,226 @@
+/*
+ * File:          profile.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the optional SQL profiler: statements slower than a threshold are logged
+ *                with their parameters and the command that ran them, and every statement is timed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <sqlite3.h>
+
+#define PROFILE_STATEMENTS 256           // Distinct statements timed.
+#define PROFILE_SQL_LENGTH 256           // Characters of SQL kept per statement.
+#define PROFILE_NESTING 8                // Statements timed at once by one thread.
+
+// Define structure for the timings of one statement.
+struct StatementProfile {
+    char sql[PROFILE_SQL_LENGTH];        // SQL text with its parameters unbound, empty if the slot is free.
+    long count;                          // Runs.
+    long slow;                           // Runs slower than the threshold.
+    sqlite3_int64 totalNanos;            // Sum of the run times.
+    sqlite3_int64 maxNanos;              // Longest run time.
+};
+
+struct StatementProfile statementProfiles[PROFILE_STATEMENTS];
+pthread_mutex_t statementProfilesLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Whether profiling is enabled, and the threshold in nanoseconds above which a statement is logged.
+bool profiling = false;
+sqlite3_int64 slowQueryNanos;
+
+// Stream receiving the slow-query log.
+FILE *slowQueryLog;
+
+// Command running on this thread, named in the slow-query log.
+__thread const char *currentCommand;
+
+// Statements started by this thread and not finished yet, with their start times. SQLite's own
+// timings come from the VFS clock, which only has millisecond resolution.
+__thread sqlite3_stmt *runningStmt[PROFILE_NESTING];
+__thread sqlite3_int64 runningSince[PROFILE_NESTING];
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+sqlite3_int64 monotonicNanos() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (sqlite3_int64)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * @brief Adds one run of a statement to the aggregates.
+ *
+ * @param sql   The SQL text of the statement.
+ * @param nanos Run time of the statement.
+ * @param slow  Whether the run was slower than the threshold.
+ */
+void recordStatement(const char *sql, sqlite3_int64 nanos, bool slow) {
+    // FNV-1a hash of the SQL, probing linearly from it.
+    unsigned int hash = 2166136261u;
+    for (const char *c = sql; *c != '\0' && c - sql < PROFILE_SQL_LENGTH - 1; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+
+    pthread_mutex_lock(&statementProfilesLock);
+    for (int i = 0; i < PROFILE_STATEMENTS; i++) {
+        struct StatementProfile *profile = &statementProfiles[(hash + i) % PROFILE_STATEMENTS];
+        if (profile->sql[0] == '\0') {
+            snprintf(profile->sql, sizeof(profile->sql), "%s", sql);
+        }
+        if (strncmp(profile->sql, sql, PROFILE_SQL_LENGTH - 1) == 0) {
+            profile->count++;
+            profile->slow += slow;
+            profile->totalNanos += nanos;
+            if (nanos > profile->maxNanos) {
+                profile->maxNanos = nanos;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&statementProfilesLock);
+}
+
+/**
+ * @brief Trace callback noting when a statement starts and timing it when it finishes.
+ *
+ * Statements on the users and sessions tables are logged without their parameters, which hold
+ * password and token hashes.
+ *
+ * @param type    SQLITE_TRACE_STMT when the statement starts, SQLITE_TRACE_PROFILE when it finishes.
+ * @param context Unused.
+ * @param p       The statement.
+ * @param x       For SQLITE_TRACE_PROFILE, pointer to the run time measured by SQLite.
+ *
+ * @return 0.
+ */
+int profileStatement(unsigned type, void *context, void *p, void *x) {
+    sqlite3_stmt *stmt = p;
+    int slot = 0;
+
+    while (slot < PROFILE_NESTING && runningStmt[slot] != stmt) {
+        slot++;
+    }
+    if (type == SQLITE_TRACE_STMT) {
+        // Triggers report their own start, keep the one of the statement.
+        for (int i = 0; i < PROFILE_NESTING && slot == PROFILE_NESTING; i++) {
+            if (runningStmt[i] == NULL) {
+                runningStmt[i] = stmt;
+                runningSince[i] = monotonicNanos();
+                slot = i;
+            }
+        }
+        return 0;
+    }
+
+    sqlite3_int64 nanos = *(sqlite3_int64 *)x;
+    if (slot < PROFILE_NESTING) {
+        nanos = monotonicNanos() - runningSince[slot];
+        runningStmt[slot] = NULL;
+    }
+
+    const char *sql = sqlite3_sql(stmt);
+    bool slow = nanos >= slowQueryNanos;
+    if (sql == NULL) {
+        return 0;
+    }
+    recordStatement(sql, nanos, slow);
+
+    if (slow) {
+        bool secret = strstr(sql, "users") != NULL || strstr(sql, "sessions") != NULL;
+        char *expanded = secret ? NULL : sqlite3_expanded_sql(stmt);
+
+        flockfile(slowQueryLog);
+        fprintf(slowQueryLog, "[slow query] %.3f ms in '%s': %s\n", nanos / 1e6,
+                currentCommand != NULL ? currentCommand : "no command", expanded != NULL ? expanded : sql);
+        fflush(slowQueryLog);
+        funlockfile(slowQueryLog);
+        sqlite3_free(expanded);
+    }
+    return 0;
+}
+
+/**
+ * @brief Compares two statement profiles by descending total time, for qsort().
+ */
+int compareProfiles(const void *a, const void *b) {
+    sqlite3_int64 left = ((const struct StatementProfile *)a)->totalNanos;
+    sqlite3_int64 right = ((const struct StatementProfile *)b)->totalNanos;
+    return left < right ? 1 : left > right ? -1 : 0;
+}
+
+/**
+ * @brief Prints the timings of every statement run so far, the most expensive first.
+ *
+ * @param out Stream receiving the table.
+ */
+void printProfile(FILE *out) {
+    struct StatementProfile sorted[PROFILE_STATEMENTS];
+    int count = 0;
+
+    pthread_mutex_lock(&statementProfilesLock);
+    for (int i = 0; i < PROFILE_STATEMENTS; i++) {
+        if (statementProfiles[i].sql[0] != '\0') {
+            sorted[count++] = statementProfiles[i];
+        }
+    }
+    pthread_mutex_unlock(&statementProfilesLock);
+    qsort(sorted, count, sizeof(sorted[0]), compareProfiles);
+
+    fprintf(out, "%8s %6s %10s %10s %10s  %s\n", "runs", "slow", "total ms", "mean ms", "max ms", "statement");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "%8ld %6ld %10.3f %10.3f %10.3f  %s\n", sorted[i].count, sorted[i].slow, sorted[i].totalNanos / 1e6,
+                sorted[i].totalNanos / 1e6 / sorted[i].count, sorted[i].maxNanos / 1e6, sorted[i].sql);
+    }
+}
+
+/**
+ * @brief Writes the statement timings to the slow-query log when the process exits.
+ */
+void dumpProfile() {
+    flockfile(slowQueryLog);
+    fprintf(slowQueryLog, "\nStatement profile:\n");
+    printProfile(slowQueryLog);
+    funlockfile(slowQueryLog);
+    fflush(slowQueryLog);
+}
+
+/**
+ * @brief Turns profiling on if $BOOKERY_SLOW_QUERY_MS is set, logging to $BOOKERY_SLOW_QUERY_LOG or stderr.
+ */
+void setupProfiling() {
+    const char *threshold = getenv("BOOKERY_SLOW_QUERY_MS");
+    const char *path = getenv("BOOKERY_SLOW_QUERY_LOG");
+
+    if (threshold == NULL) {
+        return;
+    }
+    slowQueryNanos = (sqlite3_int64)(atof(threshold) * 1e6);
+    slowQueryLog = path != NULL ? fopen(path, "a") : NULL;
+    if (slowQueryLog == NULL) {
+        slowQueryLog = stderr;
+    }
+    profiling = true;
+    atexit(dumpProfile);
+}
+
+/**
+ * @brief Registers the profiler on a connection when profiling is enabled.
+ *
+ * @param db The connection.
+ */
+void profileConnection(sqlite3 *db) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+    // Read the settings when the first connection opens.
+    pthread_once(&once, setupProfiling);
+    if (profiling) {
+        sqlite3_trace_v2(db, SQLITE_TRACE_STMT | SQLITE_TRACE_PROFILE, profileStatement, NULL);
+    }
+}
@@ -0,0 +1,555 @@
+/*
+ * File:          rentals.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the queue of open rentals: a min-heap ordered by return date, kept in
+ *                step with the rents table, that answers what is overdue and what comes due soon by
+ *                walking down from its top, and the reminder batches written from it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#define RENTAL_PENDING_MAX 1024          // Changed rents refreshed one by one; more reload everything.
+#define REMINDER_SECONDS (24 * 60 * 60)  // Interval of the reminder batches in the audit log.
+#define REMINDER_DAYS 2                  // Days ahead a reminder batch looks for rents coming due.
+
+// Define structure for an open rental in the queue.
+struct DueRental {
+    int due;                             // Return date as YYYYMMDD, so dates compare as numbers.
+    int id;                              // Rent id.
+};
+
+// Define structure for the queue of open rentals, a binary min-heap ordered by return date, then id.
+struct RentalQueue {
+    struct DueRental *heap;
+    int count;                           // Rentals in the heap.
+    int capacity;                        // Allocated length of heap.
+    int *positions;                      // Heap index + 1 of every rent id, 0 when not queued.
+    int positionCapacity;                // Allocated length of positions.
+    bool loaded;
+    sqlite3_int64 version;               // data_version of the watched connection at the last load.
+};
+
+struct RentalQueue rentals;
+pthread_rwlock_t rentalLock = PTHREAD_RWLOCK_INITIALIZER;
+
+// Connection every rent change of this process goes through, and its statement reading the data version.
+struct Database *rentalsWatched;
+sqlite3_stmt *rentalVersion;
+
+// Rents changed on the watched connection since the queue last caught up with it.
+int rentalPending[RENTAL_PENDING_MAX];
+int rentalPendingCount;
+bool rentalStale;                        // Changes not tracked row by row: reload everything.
+pthread_mutex_t rentalPendingLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Seconds between reminder batches, 0 for none, and days ahead they look.
+int reminderInterval = REMINDER_SECONDS;
+int reminderDays = REMINDER_DAYS;
+
+// Connection of the event thread, read-only, bringing the queue up to date for the reminders.
+struct Database reminderDatabase;
+
+/**
+ * @brief Converts a YYYY-MM-DD date to YYYYMMDD.
+ *
+ * @return The date, or 0 if there is none.
+ */
+int dueDay(const char *date) {
+    int year, month, day;
+
+    if (date == NULL || sscanf(date, "%d-%d-%d", &year, &month, &day) != 3) {
+        return 0;
+    }
+    return year * 10000 + month * 100 + day;
+}
+
+/**
+ * @brief Returns the local date a number of days from today as YYYYMMDD, the way rentals date
+ *        their returns.
+ */
+int dayFromToday(int days) {
+    time_t t = time(NULL);
+    struct tm today;
+
+    localtime_r(&t, &today);
+    today.tm_mday += days;
+    mktime(&today);
+    return (today.tm_year + 1900) * 10000 + (today.tm_mon + 1) * 100 + today.tm_mday;
+}
+
+/**
+ * @brief Returns whether a rental comes due before another, ties in id order.
+ */
+bool rentalBefore(const struct DueRental *a, const struct DueRental *b) {
+    return a->due < b->due || (a->due == b->due && a->id < b->id);
+}
+
+/**
+ * @brief Puts a rental at an index of the heap and remembers where it is.
+ */
+void placeRental(int index, struct DueRental rental) {
+    rentals.heap[index] = rental;
+    rentals.positions[rental.id] = index + 1;
+}
+
+/**
+ * @brief Moves the rental at an index up until its parent comes due first.
+ */
+void siftRentalUp(int index) {
+    struct DueRental rental = rentals.heap[index];
+
+    while (index > 0 && rentalBefore(&rental, &rentals.heap[(index - 1) / 2])) {
+        placeRental(index, rentals.heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
+    }
+    placeRental(index, rental);
+}
+
+/**
+ * @brief Moves the rental at an index down until both its children come due after it.
+ */
+void siftRentalDown(int index) {
+    struct DueRental rental = rentals.heap[index];
+
+    while (2 * index + 1 < rentals.count) {
+        int child = 2 * index + 1;
+        if (child + 1 < rentals.count && rentalBefore(&rentals.heap[child + 1], &rentals.heap[child])) {
+            child++;
+        }
+        if (!rentalBefore(&rentals.heap[child], &rental)) {
+            break;
+        }
+        placeRental(index, rentals.heap[child]);
+        index = child;
+    }
+    placeRental(index, rental);
+}
+
+/**
+ * @brief Removes a rent from the queue, if it is there.
+ */
+void dropRental(int id) {
+    if (id <= 0 || id >= rentals.positionCapacity || rentals.positions[id] == 0) {
+        return;
+    }
+
+    int index = rentals.positions[id] - 1;
+    rentals.positions[id] = 0;
+    rentals.count--;
+    if (index < rentals.count) {
+        // The last rental fills the hole and moves whichever way its date takes it.
+        int moved = rentals.heap[rentals.count].id;
+        placeRental(index, rentals.heap[rentals.count]);
+        siftRentalUp(index);
+        siftRentalDown(rentals.positions[moved] - 1);
+    }
+}
+
+/**
+ * @brief Makes room for a rent id in the positions and for one more rental in the heap.
+ */
+void reserveRental(int id) {
+    if (id >= rentals.positionCapacity) {
+        int capacity = rentals.positionCapacity ? rentals.positionCapacity : 1024;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        rentals.positions = realloc(rentals.positions, capacity * sizeof(int));
+        memset(rentals.positions + rentals.positionCapacity, 0, (capacity - rentals.positionCapacity) * sizeof(int));
+        rentals.positionCapacity = capacity;
+    }
+    if (rentals.count == rentals.capacity) {
+        rentals.capacity = rentals.capacity ? rentals.capacity * 2 : 1024;
+        rentals.heap = realloc(rentals.heap, rentals.capacity * sizeof(struct DueRental));
+    }
+}
+
+/**
+ * @brief Adds a rent to the queue or moves it to a new return date. A rent without one leaves the queue.
+ */
+void queueRental(int id, int due) {
+    if (id <= 0) {
+        return;
+    }
+    if (due == 0) {
+        dropRental(id);
+        return;
+    }
+
+    reserveRental(id);
+    int index = rentals.positions[id] - 1;
+    if (index < 0) {
+        index = rentals.count++;
+    }
+    placeRental(index, (struct DueRental){due, id});
+    siftRentalUp(index);
+    siftRentalDown(rentals.positions[id] - 1);
+}
+
+/**
+ * @brief Reads every open rental into the queue, which is then ordered in one pass.
+ *
+ * @return True on success.
+ */
+bool loadRentals(struct Database *database) {
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT id, return_date FROM rents;");
+    if (stmt == NULL) {
+        return false;
+    }
+
+    rentals.count = 0;
+    if (rentals.positions != NULL) {
+        memset(rentals.positions, 0, rentals.positionCapacity * sizeof(int));
+    }
+
+    int return_code;
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        int due = dueDay((const char *)sqlite3_column_text(stmt, 1));
+        if (id <= 0 || due == 0) {
+            continue;
+        }
+        // Append in any order; the heap is built once all are in.
+        reserveRental(id);
+        placeRental(rentals.count++, (struct DueRental){due, id});
+    }
+    sqlite3_reset(stmt);
+
+    for (int i = rentals.count / 2 - 1; i >= 0; i--) {
+        siftRentalDown(i);
+    }
+    rentals.loaded = return_code == SQLITE_DONE;
+    return rentals.loaded;
+}
+
+/**
+ * @brief Reads one rent again, queueing, moving or dropping it.
+ *
+ * @return True on success.
+ */
+bool refreshRental(struct Database *database, int id) {
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT return_date FROM rents WHERE id=?;");
+    if (stmt == NULL) {
+        return false;
+    }
+
+    sqlite3_bind_int(stmt, 1, id);
+    int return_code = sqlite3_step(stmt);
+    if (return_code == SQLITE_ROW) {
+        queueRental(id, dueDay((const char *)sqlite3_column_text(stmt, 0)));
+    } else {
+        dropRental(id);
+    }
+    sqlite3_reset(stmt);
+    return return_code == SQLITE_ROW || return_code == SQLITE_DONE;
+}
+
+/**
+ * @brief Notes a rent added, changed or deleted by a command; the queue reads it again once the
+ *        command has committed, so a rolled back rental never shows up.
+ */
+void noteRental(sqlite3_int64 id) {
+    pthread_mutex_lock(&rentalPendingLock);
+    if (rentalPendingCount < RENTAL_PENDING_MAX) {
+        rentalPending[rentalPendingCount++] = (int)id;
+    } else {
+        rentalStale = true;
+    }
+    pthread_mutex_unlock(&rentalPendingLock);
+}
+
+/**
+ * @brief Tracks the rents changed through a connection, which must be the one every change of
+ *        this process goes through.
+ */
+void watchRentals(struct Database *database) {
+    rentalsWatched = database;
+    sqlite3_prepare_v2(database->db, "PRAGMA data_version;", -1, &rentalVersion, NULL);
+}
+
+/**
+ * @brief Returns the data version of the watched connection.
+ */
+sqlite3_int64 rentalDataVersion() {
+    sqlite3_int64 version = -1;
+
+    if (sqlite3_step(rentalVersion) == SQLITE_ROW) {
+        version = sqlite3_column_int64(rentalVersion, 0);
+    }
+    sqlite3_reset(rentalVersion);
+    return version;
+}
+
+/**
+ * @brief Returns whether the caller is the watched connection outside a transaction with
+ *        changes of its own still to read into the queue.
+ */
+bool rentalsBehind(struct Database *database) {
+    if (database != rentalsWatched || !sqlite3_get_autocommit(database->db)) {
+        return false;
+    }
+    pthread_mutex_lock(&rentalPendingLock);
+    bool behind = rentalPendingCount > 0 || rentalStale;
+    pthread_mutex_unlock(&rentalPendingLock);
+    return behind;
+}
+
+/**
+ * @brief Brings the queue up to date before it is read, like syncCatalog() does for the books:
+ *        noted rents are read again once the watched connection has committed them, and a commit
+ *        by another connection reloads everything.
+ *
+ * @param database Connection of the caller.
+ *
+ * @return False if the rents could not be read.
+ */
+bool syncRentals(struct Database *database) {
+    bool ok = true;
+    sqlite3_int64 seen = dataVersion(database);
+
+    pthread_rwlock_wrlock(&rentalLock);
+    bool own = database == rentalsWatched && sqlite3_get_autocommit(database->db);
+    sqlite3_int64 version = database == rentalsWatched ? seen : rentalDataVersion();
+
+    pthread_mutex_lock(&rentalPendingLock);
+    int pending[RENTAL_PENDING_MAX];
+    int count = own ? rentalPendingCount : 0;
+    bool stale = own && rentalStale;
+    memcpy(pending, rentalPending, count * sizeof(*pending));
+    if (own) {
+        rentalPendingCount = 0;
+        rentalStale = false;
+    }
+    pthread_mutex_unlock(&rentalPendingLock);
+
+    if (!rentals.loaded || stale || version != rentals.version) {
+        ok = loadRentals(database);
+        rentals.version = version;
+    } else {
+        for (int i = 0; i < count && ok; i++) {
+            ok = refreshRental(database, pending[i]);
+        }
+    }
+    if (!ok) {
+        rentals.loaded = false;
+    } else {
+        database->rentalsSeen = seen;
+    }
+    pthread_rwlock_unlock(&rentalLock);
+    return ok;
+}
+
+/**
+ * @brief Brings the queue up to date and locks it for reading; release it with releaseRentals().
+ *        Like readCatalog(), it takes only the shared lock while nothing was committed.
+ *
+ * @return False if the rents could not be read, in which case the queue is not locked.
+ */
+bool readRentals(struct Database *database) {
+    sqlite3_int64 seen = dataVersion(database);
+
+    pthread_rwlock_rdlock(&rentalLock);
+    if (rentals.loaded && seen == database->rentalsSeen && !rentalsBehind(database)) {
+        return true;
+    }
+    pthread_rwlock_unlock(&rentalLock);
+
+    if (!syncRentals(database)) {
+        return false;
+    }
+    pthread_rwlock_rdlock(&rentalLock);
+    return true;
+}
+
+/**
+ * @brief Releases the queue after readRentals().
+ */
+void releaseRentals() {
+    pthread_rwlock_unlock(&rentalLock);
+}
+
+/**
+ * @brief Adds a heap index to the frontier of dueRentals(), itself a min-heap of heap indexes.
+ */
+void pushFrontier(int **frontier, int *count, int *capacity, int index) {
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        *frontier = realloc(*frontier, *capacity * sizeof(int));
+    }
+
+    int i = (*count)++;
+    while (i > 0 && rentalBefore(&rentals.heap[index], &rentals.heap[(*frontier)[(i - 1) / 2]])) {
+        (*frontier)[i] = (*frontier)[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    (*frontier)[i] = index;
+}
+
+/**
+ * @brief Takes the heap index coming due first off the frontier of dueRentals().
+ */
+int popFrontier(int *frontier, int *count) {
+    int top = frontier[0];
+    int last = frontier[--(*count)];
+    int i = 0;
+
+    while (2 * i + 1 < *count) {
+        int child = 2 * i + 1;
+        if (child + 1 < *count && rentalBefore(&rentals.heap[frontier[child + 1]], &rentals.heap[frontier[child]])) {
+            child++;
+        }
+        if (!rentalBefore(&rentals.heap[frontier[child]], &rentals.heap[last])) {
+            break;
+        }
+        frontier[i] = frontier[child];
+        i = child;
+    }
+    frontier[i] = last;
+    return top;
+}
+
+/**
+ * @brief Finds the open rentals due from one day up to, not including, another, in order of
+ *        return date. Must be called with the queue read.
+ *
+ * Only the part of the heap due before the end is visited: a frontier of the subtrees not yet
+ * entered yields the rentals in order, so the cost grows with the rentals due before the end,
+ * k log k, not with all rentals.
+ *
+ * @param from First return date, YYYYMMDD.
+ * @param to   Return date to stop at, YYYYMMDD.
+ * @param ids  Receives the rent ids; free it after use.
+ *
+ * @return Number of rents in ids.
+ */
+int dueRentals(int from, int to, int **ids) {
+    int count = 0, capacity = 0;
+    int *frontier = NULL;
+    int frontierCount = 0, frontierCapacity = 0;
+
+    *ids = NULL;
+    if (rentals.count > 0 && rentals.heap[0].due < to) {
+        pushFrontier(&frontier, &frontierCount, &frontierCapacity, 0);
+    }
+    while (frontierCount > 0) {
+        int index = popFrontier(frontier, &frontierCount);
+        if (rentals.heap[index].due >= from) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                *ids = realloc(*ids, capacity * sizeof(int));
+            }
+            (*ids)[count++] = rentals.heap[index].id;
+        }
+        for (int child = 2 * index + 1; child <= 2 * index + 2 && child < rentals.count; child++) {
+            if (rentals.heap[child].due < to) {
+                pushFrontier(&frontier, &frontierCount, &frontierCapacity, child);
+            }
+        }
+    }
+    free(frontier);
+    return count;
+}
+
+/**
+ * @brief Writes a list of rent ids as a JSON array.
+ *
+ * @return Number of bytes written.
+ */
+int writeRentIds(FILE *file, const int *ids, int count) {
+    int length = fprintf(file, "[");
+    for (int i = 0; i < count; i++) {
+        length += fprintf(file, i > 0 ? ",%d" : "%d", ids[i]);
+    }
+    return length + fprintf(file, "]");
+}
+
+/**
+ * @brief Applies the reminder schedule from $BOOKERY_REMINDER_INTERVAL and $BOOKERY_REMINDER_DAYS.
+ */
+void setReminderSchedule() {
+    const char *interval = getenv("BOOKERY_REMINDER_INTERVAL");
+    const char *days = getenv("BOOKERY_REMINDER_DAYS");
+
+    if (interval != NULL) {
+        reminderInterval = atoi(interval);
+    }
+    if (days != NULL && atoi(days) >= 0) {
+        reminderDays = atoi(days);
+    }
+}
+
+/**
+ * @brief Opens the connection of the reminders on the database the watched connection uses.
+ *
+ * @return True if the connection is open.
+ */
+bool openReminderDatabase() {
+    char uri[1024];
+
+    if (reminderDatabase.db != NULL) {
+        return true;
+    }
+    if (memoryMode) {
+        snprintf(uri, sizeof(uri), "%s", databaseName);
+    } else {
+        databaseUri(uri, sizeof(uri), sqlite3_db_filename(rentalsWatched->db, "main"), "mode=ro");
+    }
+    return openDatabase(&reminderDatabase, uri, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI) == SQLITE_OK;
+}
+
+/**
+ * @brief Writes a batch of reminders to the audit log every reminderInterval seconds: the rents
+ *        overdue and those due within reminderDays. The queue is brought up to date on a
+ *        connection of the event thread first, so rents changed by other processes are included.
+ *
+ * Called by the event thread of the audit log every second.
+ *
+ * @param file  The audit log.
+ * @param stamp Current time, formatted like the audit records.
+ *
+ * @return Number of bytes written, 0 if no batch was due or nothing needs a reminder.
+ */
+int writeReminderEvent(FILE *file, const char *stamp) {
+    static time_t last = 0;
+    time_t now = time(NULL);
+    int *overdue, *due;
+
+    if (reminderInterval <= 0 || now - last < reminderInterval || rentalsWatched == NULL) {
+        return 0;
+    }
+    last = now;
+    if (!openReminderDatabase() || !readRentals(&reminderDatabase)) {
+        return 0;
+    }
+    int today = dayFromToday(0);
+    int overdueCount = dueRentals(0, today, &overdue);
+    int dueCount = dueRentals(today, dayFromToday(reminderDays) + 1, &due);
+    releaseRentals();
+    resetStatements(&reminderDatabase);
+
+    int length = 0;
+    if (overdueCount > 0 || dueCount > 0) {
+        length = fprintf(file, "{\"time\":\"%s\",\"event\":\"reminders\",\"overdue\":", stamp);
+        length += writeRentIds(file, overdue, overdueCount);
+        length += fprintf(file, ",\"due\":");
+        length += writeRentIds(file, due, dueCount);
+        length += fprintf(file, "}\n");
+    }
+    free(overdue);
+    free(due);
+    return length;
+}
+
+/**
+ * @brief Returns the memory held by the queue, in bytes. Must be called with rentalLock held.
+ */
+size_t rentalBytes() {
+    return rentals.capacity * sizeof(struct DueRental) + rentals.positionCapacity * sizeof(int);
+}
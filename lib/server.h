@@ -0,0 +1,953 @@
+/*
+ * File:          server.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the local server mode, which keeps one warm database connection and serves
+ *                many tills over a Unix domain socket, and the client side used by the CLI in client mode.
+ *
+ *                Protocol: a request is one line of tab separated fields, the first being the command as
+ *                typed in the advanced CLI ("sell book\tDune\t2"). The response is the command output,
+ *                with lines starting with '.' prefixed by another '.', followed by a ".OK" or ".ERR" line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+
+#define MAX_CLIENTS 64
+#define SERVER_WORKERS 4
+#define GROUP_COMMIT_MAX_OPS 64
+#define GROUP_COMMIT_WINDOW_MS 5
+
+bool handleRequest(struct Session *session, const char *request);
+void finishRecord(struct Session *session, const struct CommandRecord *record, bool committed);
+
+// Define structure for a client connected to the server.
+struct Client {
+    int fd;                              // Client socket.
+    char buffer[REQUEST_MAX_LENGTH];     // Bytes received but not yet processed.
+    size_t length;                       // Number of bytes in the buffer.
+    atomic_bool busy;                    // Whether a request of this client is queued or running.
+    char *reply;                         // Framed response the poll() loop still has to send, or NULL.
+    size_t replyLength;                  // Size of the response.
+    size_t replySent;                    // Bytes of it already sent.
+    struct Session session;              // Session of the user logged in on this client.
+};
+
+// Define structure for a request waiting for a worker.
+struct Job {
+    struct Client *client;               // Client that sent the request.
+    char request[REQUEST_MAX_LENGTH];    // The request line.
+    char *output;                        // Output produced by the request.
+    size_t size;                         // Size of the output.
+    bool ok;                             // Whether the request succeeded.
+    // Write of the server itself, run by the writer instead of a request; NULL for client requests.
+    bool (*apply)(struct Database *database, void *data, FILE *out);
+    void *data;                          // Handed to apply.
+    bool waited;                         // Whether the thread handing over the write waits for it.
+    bool done;                           // Set once the group of a waited write finished.
+    struct Job *next;                    // Next job in the queue.
+};
+
+// Define structure for a queue of jobs shared by worker threads.
+struct JobQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    struct Job *head;
+    struct Job *tail;
+};
+
+// Read-only requests are spread over the workers, writes all go to the single writer.
+struct JobQueue readQueue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL};
+struct JobQueue writeQueue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL};
+
+// Pipe used by workers to wake the poll() loop when a client becomes idle again.
+int wakePipe[2];
+
+// Whether the writer thread runs and takes the writes of queueWrite() and commitWrite().
+bool writerRunning = false;
+
+// Signaled by the writer when the group of a write handed over by commitWrite() finished.
+pthread_mutex_t writeDoneLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t writeDone = PTHREAD_COND_INITIALIZER;
+
+// Commands that never modify the database.
+const char *readOnlyCommands[] = {
+    "login", "resume", "whoami", "show books", "show rents", "show users", "search book", "search rent",
+    "rent late", "rent due", "report sales", "report rents", "report genres", "report stores", "export changes",
+    "show locks", "stats", "show queries", "mem", NULL
+};
+
+// Write commands doing slow work (like hashing) before a short write they commit with commitWrite(),
+// so they run on the workers instead of holding up the writer and its lock.
+const char *selfCommittingCommands[] = {
+    "add user", "import users", "calibrate hash", NULL
+};
+
+// Set by SIGINT or SIGTERM to stop the server cleanly.
+volatile sig_atomic_t serverStopping = 0;
+
+// Socket connected to the server in client mode, -1 when commands run locally.
+int serverSocket = -1;
+FILE *serverReplies = NULL;
+
+// Set in reporting mode, where the CLI runs on a read-only connection and refuses anything but
+// the read-only commands.
+bool reportingMode = false;
+
+
+/**
+ * @brief Splits a request line into its tab separated fields in place.
+ *
+ * @param request The request line, modified in place.
+ * @param argv    Array receiving pointers to the fields.
+ * @param maxArgs Capacity of argv.
+ *
+ * @return The number of fields, or -1 if there are more than maxArgs.
+ */
+int splitRequest(char *request, char **argv, int maxArgs) {
+    int argc = 0;
+    char *field = request;
+
+    if (request[0] == '\0') {
+        return 0;
+    }
+    while (field != NULL) {
+        if (argc == maxArgs) {
+            return -1;
+        }
+        argv[argc++] = field;
+        field = strchr(field, '\t');
+        if (field != NULL) {
+            *field++ = '\0';
+        }
+    }
+    return argc;
+}
+
+/**
+ * @brief Checks whether the command of a request is one of a list.
+ *
+ * @param commands NULL terminated list of command names.
+ * @param request  The request line.
+ *
+ * @return True if the command is in the list.
+ */
+bool isCommandOf(const char **commands, const char *request) {
+    size_t length = strcspn(request, "\t");
+
+    for (int i = 0; commands[i] != NULL; i++) {
+        if (strlen(commands[i]) == length && strncmp(request, commands[i], length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether a request must run inside a write transaction of its caller.
+ *
+ * @param request The request line.
+ *
+ * @return False for read-only commands and commands committing on their own, true otherwise.
+ */
+bool needsWriteTransaction(const char *request) {
+    return !isCommandOf(readOnlyCommands, request) && !isCommandOf(selfCommittingCommands, request);
+}
+
+/**
+ * @brief Writes the whole buffer to a socket.
+ *
+ * @return True if everything was written, false if the peer went away.
+ */
+bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * @brief Frames the output of a request for the line protocol.
+ *
+ * @param output Output produced by the request.
+ * @param size   Size of the output.
+ * @param ok     Whether the request succeeded.
+ * @param framed Set to the framed response, to be freed by the caller.
+ *
+ * @return Size of the framed response.
+ */
+size_t frameResponse(const char *output, size_t size, bool ok, char **framed) {
+    char *frame = malloc(size * 2 + 8);
+    size_t length = 0;
+    bool lineStart = true;
+
+    // Escape lines starting with '.' so they can't be mistaken for the status line.
+    for (size_t i = 0; i < size; i++) {
+        if (lineStart && output[i] == '.') {
+            frame[length++] = '.';
+        }
+        frame[length++] = output[i];
+        lineStart = output[i] == '\n';
+    }
+    if (!lineStart) {
+        frame[length++] = '\n';
+    }
+    length += sprintf(&frame[length], ok ? ".OK\n" : ".ERR\n");
+
+    *framed = frame;
+    return length;
+}
+
+/**
+ * @brief Sends a short response to a client right away, for errors of the poll() loop itself.
+ *
+ * @param fd     Client socket.
+ * @param output Output to send.
+ * @param size   Size of the output.
+ * @param ok     Whether the request succeeded.
+ *
+ * @return True if the response was sent.
+ */
+bool sendResponse(int fd, const char *output, size_t size, bool ok) {
+    char *framed;
+    size_t length = frameResponse(output, size, ok, &framed);
+
+    bool sent = writeAll(fd, framed, length);
+    free(framed);
+    return sent;
+}
+
+/**
+ * @brief Runs the request of a job in the session of its client and keeps the output.
+ *
+ * A client has at most one request in flight, so its session is only used by one thread at a time.
+ *
+ * @param job      The job to run.
+ * @param database Connection of the calling thread.
+ */
+void runJob(struct Job *job, struct Database *database) {
+    struct Session *session = &job->client->session;
+
+    session->database = database;
+    session->out = open_memstream(&job->output, &job->size);
+    job->ok = false;
+    if (!session->authenticated && strncmp(job->request, "login\t", 6) != 0 && strncmp(job->request, "resume\t", 7) != 0) {
+        fprintf(session->out, "%sPlease login first.%s\n", RED, RESET);
+        pushAudit(session, "unauthenticated", NULL, AUDIT_DENIED, 0);
+    } else {
+        job->ok = handleRequest(session, job->request);
+    }
+    fclose(session->out);
+    session->out = NULL;
+}
+
+//**********************************************************************************************************************************
+
+/**
+ * @brief Appends a job to a queue and wakes one thread waiting on it.
+ */
+void pushJob(struct JobQueue *queue, struct Job *job) {
+    job->next = NULL;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail != NULL) {
+        queue->tail->next = job;
+    } else {
+        queue->head = job;
+    }
+    queue->tail = job;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+ * @brief Removes the oldest job of a queue, waiting until there is one.
+ *
+ * @param queue    The queue.
+ * @param deadline Absolute CLOCK_REALTIME time to give up at, or NULL to wait forever.
+ *
+ * @return The job, or NULL if the deadline passed first.
+ */
+struct Job *popJob(struct JobQueue *queue, const struct timespec *deadline) {
+    pthread_mutex_lock(&queue->lock);
+    while (queue->head == NULL) {
+        if (deadline == NULL) {
+            pthread_cond_wait(&queue->ready, &queue->lock);
+        } else if (pthread_cond_timedwait(&queue->ready, &queue->lock, deadline) == ETIMEDOUT) {
+            pthread_mutex_unlock(&queue->lock);
+            return NULL;
+        }
+    }
+    struct Job *job = queue->head;
+    queue->head = job->next;
+    if (queue->head == NULL) {
+        queue->tail = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return job;
+}
+
+/**
+ * @brief Hands the response of a job and its client back to the poll() loop, which sends it.
+ *
+ * The thread never writes to the socket itself: a client that stops reading a long listing
+ * only holds up its own responses, not a worker or the writer.
+ */
+void answerJob(struct Job *job) {
+    struct Client *client = job->client;
+
+    // Writes of the server itself have nobody to answer; a waited one is freed by its waiter.
+    if (client == NULL && job->waited) {
+        pthread_mutex_lock(&writeDoneLock);
+        job->done = true;
+        pthread_cond_broadcast(&writeDone);
+        pthread_mutex_unlock(&writeDoneLock);
+        return;
+    }
+    if (client == NULL) {
+        free(job->output);
+        free(job);
+        return;
+    }
+
+    client->replyLength = frameResponse(job->output, job->size, job->ok, &client->reply);
+    client->replySent = 0;
+    free(job->output);
+    free(job);
+
+    atomic_store(&client->busy, false);
+    write(wakePipe[1], "", 1);
+}
+
+/**
+ * @brief Opens the connection of a read worker.
+ *
+ * Read-only, so every write goes through the writer; a login rehashing a password hands the new
+ * hash to it with queueWrite().
+ *
+ * @return True if the connection is open.
+ */
+bool openReadWorker(struct Database *database) {
+    if (openDatabase(database, databaseName, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_exec(database->db, "PRAGMA query_only=1;", 0, 0, 0);
+    attachStores(database->db);
+    return true;
+}
+
+/**
+ * @brief Worker thread serving read-only requests on the connection opened for it.
+ */
+void *readWorker(void *arg) {
+    struct Database *database = arg;
+
+    while (true) {
+        struct Job *job = popJob(&readQueue, NULL);
+        runJob(job, database);
+        answerJob(job);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs a group of write requests in one transaction.
+ *
+ * Each request runs in its own savepoint so a failed request is rolled back alone. If the
+ * final commit fails nothing of the group is durable, so every request is reported as failed.
+ *
+ * @param database The read-write connection.
+ * @param group    The jobs of the group.
+ * @param count    Number of jobs in the group.
+ */
+void commitGroup(struct Database *database, struct Job **group, int count) {
+    // Another process holding the write lock past every retry fails the whole group.
+    if (runLocked(database, "BEGIN IMMEDIATE;") != SQLITE_OK) {
+        for (int i = 0; i < count; i++) {
+            group[i]->size = asprintf(&group[i]->output, "%sDatabase is busy, please try again: %s%s\n",
+                                      RED, sqlite3_errmsg(database->db), RESET);
+            group[i]->ok = false;
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        sqlite3_exec(database->db, "SAVEPOINT request;", 0, 0, 0);
+        if (group[i]->apply != NULL) {
+            FILE *out = open_memstream(&group[i]->output, &group[i]->size);
+            group[i]->ok = group[i]->apply(database, group[i]->data, out);
+            fclose(out);
+        } else {
+            group[i]->client->session.deferRecord = true;
+            group[i]->client->session.record.command = NULL;
+            runJob(group[i], database);
+        }
+        if (!group[i]->ok) {
+            sqlite3_exec(database->db, "ROLLBACK TO request;", 0, 0, 0);
+        }
+        sqlite3_exec(database->db, "RELEASE request;", 0, 0, 0);
+    }
+
+    bool committed = runLocked(database, "COMMIT;") == SQLITE_OK;
+    if (!committed) {
+        char error[256];
+        snprintf(error, sizeof(error), "%s", sqlite3_errmsg(database->db));
+        sqlite3_exec(database->db, "ROLLBACK;", 0, 0, 0);
+
+        for (int i = 0; i < count; i++) {
+            free(group[i]->output);
+            group[i]->size = asprintf(&group[i]->output, "%sCommit failed: %s%s\n", RED, error, RESET);
+            group[i]->ok = false;
+        }
+    }
+
+    // Only now is it known whether the requests took effect.
+    for (int i = 0; i < count; i++) {
+        struct Session *session = group[i]->client != NULL ? &group[i]->client->session : NULL;
+        if (session != NULL && session->record.command != NULL) {
+            finishRecord(session, &session->record, committed);
+        }
+        if (session != NULL) {
+            session->deferRecord = false;
+        }
+    }
+
+    // Read the books and rents the group changed into the catalog and the rental queue before
+    // readers look at them.
+    syncCatalog(database);
+    syncRentals(database);
+}
+
+/**
+ * @brief Writer thread serving every request that may modify the database.
+ *
+ * Writes queued by all clients are committed in groups of up to GROUP_COMMIT_MAX_OPS requests
+ * collected within GROUP_COMMIT_WINDOW_MS of the first one, and each caller is answered once its
+ * group is durable, so one fsync covers the whole group.
+ */
+void *writeWorker(void *arg) {
+    struct Job *group[GROUP_COMMIT_MAX_OPS];
+
+    while (true) {
+        int count = 0;
+        group[count++] = popJob(&writeQueue, NULL);
+
+        // Collect more writes until the group is full or its window closes.
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += GROUP_COMMIT_WINDOW_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        while (count < GROUP_COMMIT_MAX_OPS && (group[count] = popJob(&writeQueue, &deadline)) != NULL) {
+            count++;
+        }
+
+        commitGroup(&shopDatabase, group, count);
+        for (int i = 0; i < count; i++) {
+            answerJob(group[i]);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Hands a write of the server itself to the writer thread, which runs it in its next group.
+ *
+ * @param apply   Runs the write on the writer's connection.
+ * @param request Text handed to apply.
+ *
+ * @return False if no writer thread runs.
+ */
+bool queueWrite(bool (*apply)(struct Database *database, void *data, FILE *out), const char *request) {
+    if (!writerRunning) {
+        return false;
+    }
+    struct Job *job = calloc(1, sizeof(*job));
+    snprintf(job->request, sizeof(job->request), "%s", request);
+    job->apply = apply;
+    job->data = job->request;
+    pushJob(&writeQueue, job);
+    return true;
+}
+
+/**
+ * @brief Commits the write of a command that did its slow work before, outside any transaction.
+ *
+ * On a read worker the write is handed to the writer thread, which runs it in its next group, and
+ * the worker waits until that group committed. Elsewhere it runs in a transaction of its own.
+ *
+ * @param session The session running the command; apply prints to its output.
+ * @param apply   Runs the write, returning false to roll it back.
+ * @param data    Handed to apply.
+ *
+ * @return True if the write succeeded and was committed.
+ */
+bool commitWrite(struct Session *session, bool (*apply)(struct Database *database, void *data, FILE *out), void *data) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    if (sqlite3_db_readonly(database->db, "main")) {
+        if (!writerRunning) {
+            fprintf(out, "%sNot available on a read-only connection.%s\n", RED, RESET);
+            return false;
+        }
+        struct Job *job = calloc(1, sizeof(*job));
+        job->apply = apply;
+        job->data = data;
+        job->waited = true;
+        pushJob(&writeQueue, job);
+
+        pthread_mutex_lock(&writeDoneLock);
+        while (!job->done) {
+            pthread_cond_wait(&writeDone, &writeDoneLock);
+        }
+        pthread_mutex_unlock(&writeDoneLock);
+
+        fwrite(job->output, 1, job->size, out);
+        bool ok = job->ok;
+        free(job->output);
+        free(job);
+        return ok;
+    }
+
+    if (runLocked(database, "BEGIN IMMEDIATE;") != SQLITE_OK) {
+        fprintf(out, "%sDatabase is busy, please try again: %s%s\n", RED, sqlite3_errmsg(database->db), RESET);
+        return false;
+    }
+    bool ok = apply(database, data, out);
+    if (ok && runLocked(database, "COMMIT;") != SQLITE_OK) {
+        fprintf(out, "%sCommit failed: %s%s\n", RED, sqlite3_errmsg(database->db), RESET);
+        ok = false;
+    }
+    if (!ok) {
+        sqlite3_exec(database->db, "ROLLBACK;", 0, 0, 0);
+    }
+    return ok;
+}
+
+/**
+ * @brief Reads available bytes from a client into its buffer.
+ *
+ * @return False if the client disconnected or must be dropped.
+ */
+bool readClient(struct Client *client) {
+    ssize_t received = read(client->fd, client->buffer + client->length, sizeof(client->buffer) - client->length);
+    if (received < 0 && errno == EINTR) {
+        return true;
+    }
+    if (received <= 0) {
+        return false;
+    }
+    client->length += received;
+
+    if (client->length == sizeof(client->buffer) && memchr(client->buffer, '\n', client->length) == NULL) {
+        sendResponse(client->fd, "Request too long.\n", 18, false);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Sends as much of the pending response of a client as its socket takes without blocking.
+ *
+ * @return False if the client disconnected.
+ */
+bool sendReply(struct Client *client) {
+    ssize_t written = send(client->fd, client->reply + client->replySent, client->replyLength - client->replySent,
+                           MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (written < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    }
+    if (written <= 0) {
+        return false;
+    }
+    client->replySent += written;
+    if (client->replySent == client->replyLength) {
+        free(client->reply);
+        client->reply = NULL;
+    }
+    return true;
+}
+
+/**
+ * @brief Queues the next complete request of an idle client.
+ *
+ * Only one request per client is in flight, and the next is only queued once the response to
+ * the previous one was sent, so its responses keep the order of its requests.
+ */
+void dispatchClient(struct Client *client) {
+    if (atomic_load(&client->busy) || client->reply != NULL) {
+        return;
+    }
+
+    char *newline = memchr(client->buffer, '\n', client->length);
+    if (newline == NULL) {
+        return;
+    }
+
+    struct Job *job = malloc(sizeof(*job));
+    size_t length = newline - client->buffer;
+    memcpy(job->request, client->buffer, length);
+    job->request[length] = '\0';
+    job->client = client;
+    job->apply = NULL;
+
+    // Keep the rest of the buffer for the next request.
+    client->length -= length + 1;
+    memmove(client->buffer, newline + 1, client->length);
+
+    atomic_store(&client->busy, true);
+    pushJob(needsWriteTransaction(job->request) ? &writeQueue : &readQueue, job);
+}
+
+/**
+ * @brief Signal handler asking the server loop to stop.
+ */
+void stopServer(int signal) {
+    serverStopping = 1;
+}
+
+/**
+ * @brief Runs the server mode until it receives SIGINT or SIGTERM.
+ *
+ * The database must already be open in shopDatabase, which becomes the writer's connection.
+ * The poll() loop only moves bytes: reads, searches and reports run in parallel on SERVER_WORKERS
+ * threads with their own connections, while writes are funneled to one writer thread,
+ * so a long report never delays a checkout.
+ *
+ * @param path Path of the Unix domain socket.
+ *
+ * @return 0 once stopped by a signal, non-zero if the socket could not be set up.
+ */
+int runServer(const char *path) {
+    struct sockaddr_un address;
+    struct Client *clients[MAX_CLIENTS];
+    struct pollfd fds[MAX_CLIENTS + 2];
+    int polled[MAX_CLIENTS];
+    int count = 0;
+    pthread_t thread;
+
+    // A client hanging up mid-response must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    // Stop on SIGINT or SIGTERM by leaving the loop, so exit handlers still run.
+    struct sigaction stop;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = stopServer;
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+
+    // Readers must not block the writer, nor the writer the readers, and every commit is synced.
+    sqlite3_exec(shopDatabase.db, "PRAGMA journal_mode=WAL;", 0, 0, 0);
+    sqlite3_exec(shopDatabase.db, "PRAGMA synchronous=FULL;", 0, 0, 0);
+
+    // Open the connections of the workers up front: read requests would wait forever without one.
+    struct Database *readers = calloc(SERVER_WORKERS, sizeof(struct Database));
+    int workers = 0;
+    for (int i = 0; i < SERVER_WORKERS; i++) {
+        if (openReadWorker(&readers[workers])) {
+            workers++;
+        }
+    }
+    if (workers == 0) {
+        fprintf(stderr, "%sNo read worker could open %s, not serving.%s\n", RED, databaseFile, RESET);
+        return 1;
+    }
+    if (workers < SERVER_WORKERS) {
+        fprintf(stderr, "%sOnly %d of %d read workers could open %s.%s\n", YELLOW, workers, SERVER_WORKERS, databaseFile, RESET);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || pipe(wakePipe) != 0) {
+        perror("socket");
+        return 1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    // Remove a socket left behind by a previous server.
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+        perror("bind");
+        close(listener);
+        return 1;
+    }
+    chmod(path, 0660);
+
+    // Start the worker pool and the writer.
+    for (int i = 0; i < workers; i++) {
+        pthread_create(&thread, NULL, readWorker, &readers[i]);
+        pthread_detach(thread);
+    }
+    writerRunning = true;
+    pthread_create(&thread, NULL, writeWorker, NULL);
+    pthread_detach(thread);
+
+    printf("%sServing %s%s on %s with %d workers%s\n", GREEN, databaseFile, memoryMode ? " from memory" : "", path,
+           workers, RESET);
+    fflush(stdout);
+
+    while (!serverStopping) {
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+        fds[1].fd = wakePipe[0];
+        fds[1].events = POLLIN;
+
+        // Only idle clients are polled; busy ones are owned by a worker until it answers. A
+        // client with a response left to send is polled for writing until it was sent.
+        int polledCount = 0;
+        for (int i = 0; i < count; i++) {
+            if (!atomic_load(&clients[i]->busy)) {
+                fds[polledCount + 2].fd = clients[i]->fd;
+                fds[polledCount + 2].events = clients[i]->reply != NULL ? POLLOUT : POLLIN;
+                polled[polledCount++] = i;
+            }
+        }
+
+        if (poll(fds, polledCount + 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        // Drain the wake-ups of finished jobs.
+        if (fds[1].revents & POLLIN) {
+            char drain[64];
+            read(wakePipe[0], drain, sizeof(drain));
+        }
+
+        // Send responses and read requests, dropping the clients that hung up.
+        for (int i = 0; i < polledCount; i++) {
+            struct Client *client = clients[polled[i]];
+            bool ready = fds[i + 2].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR);
+            if (ready && !(client->reply != NULL ? sendReply(client) : readClient(client))) {
+                close(client->fd);
+                closeSession(&client->session);
+                free(client->reply);
+                free(client);
+                clients[polled[i]] = NULL;
+            }
+        }
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            if (clients[i] != NULL) {
+                clients[kept++] = clients[i];
+            }
+        }
+        count = kept;
+
+        // Hand the next request of every idle client to the workers.
+        for (int i = 0; i < count; i++) {
+            dispatchClient(clients[i]);
+        }
+
+        // Accept a new client.
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0 && count == MAX_CLIENTS) {
+                sendResponse(fd, "Too many clients.\n", 18, false);
+                close(fd);
+            } else if (fd >= 0) {
+                clients[count] = calloc(1, sizeof(struct Client));
+                clients[count]->fd = fd;
+                openSession(&clients[count]->session, NULL, NULL);
+
+                // Throttle failed logins per client process: the tills of a shop often run as the
+                // same local user, and one of them mistyping must not lock the others out.
+                struct ucred peer;
+                socklen_t length = sizeof(peer);
+                if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0) {
+                    snprintf(clients[count]->session.origin, sizeof(clients[count]->session.origin), "uid %d pid %d",
+                             (int)peer.uid, (int)peer.pid);
+                }
+                count++;
+            }
+        }
+    }
+
+    close(listener);
+    unlink(path);
+    return serverStopping ? 0 : 1;
+}
+
+//**********************************************************************************************************************************
+
+/**
+ * @brief Connects the CLI to a running server so every command is executed there.
+ *
+ * @param path Path of the Unix domain socket.
+ *
+ * @return 0 on success, non-zero otherwise.
+ */
+int connectServer(const char *path) {
+    struct sockaddr_un address;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "%sCan't connect to server at %s: %s%s\n", RED, path, strerror(errno), RESET);
+        close(fd);
+        return 1;
+    }
+
+    serverSocket = fd;
+    serverReplies = fdopen(dup(fd), "r");
+    return 0;
+}
+
+/**
+ * @brief Sends a request to the server and prints its output.
+ *
+ * @param request The request line.
+ * @param out     Stream receiving the output.
+ *
+ * @return True if the server reported success.
+ */
+bool sendRequest(const char *request, FILE *out) {
+    char *line = NULL;
+    size_t capacity = 0;
+
+    if (!writeAll(serverSocket, request, strlen(request)) || !writeAll(serverSocket, "\n", 1)) {
+        fprintf(stderr, "%sConnection to server lost.%s\n", RED, RESET);
+        exit(1);
+    }
+
+    while (getline(&line, &capacity, serverReplies) > 0) {
+        if (strcmp(line, ".OK\n") == 0 || strcmp(line, ".ERR\n") == 0) {
+            bool ok = line[1] == 'O';
+            free(line);
+            return ok;
+        }
+        // Drop the escape added to lines starting with '.'.
+        fputs(line[0] == '.' ? line + 1 : line, out);
+    }
+
+    free(line);
+    fprintf(stderr, "%sConnection to server lost.%s\n", RED, RESET);
+    exit(1);
+}
+
+/**
+ * @brief Runs a write request in its own transaction, running it again if it lost a lock race.
+ *
+ * The output of an attempt is only printed once the attempt is final, so a retried sale
+ * doesn't print its error before printing its success.
+ *
+ * @param session The session running the command, on a read-write connection.
+ * @param request The request line.
+ *
+ * @return True if the command succeeded and was committed.
+ */
+bool runWriteRequest(struct Session *session, const char *request) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+    bool ok = false;
+
+    session->output = NULL;
+    session->size = 0;
+    for (int attempt = 0; attempt <= TRANSACTION_RETRIES; attempt++) {
+        FILE *buffer = open_memstream(&session->output, &session->size);
+        long timeouts = database->busyTimeouts;
+
+        if (runLocked(database, "BEGIN IMMEDIATE;") != SQLITE_OK) {
+            fprintf(buffer, "%sDatabase is busy, please try again: %s%s\n", RED, sqlite3_errmsg(database->db), RESET);
+            fclose(buffer);
+            break;
+        }
+
+        session->out = buffer;
+        ok = handleRequest(session, request);
+        session->out = out;
+        if (ok && runLocked(database, "COMMIT;") != SQLITE_OK) {
+            fprintf(buffer, "%sCommit failed: %s%s\n", RED, sqlite3_errmsg(database->db), RESET);
+            ok = false;
+        }
+        if (!ok) {
+            sqlite3_exec(database->db, "ROLLBACK;", 0, 0, 0);
+        }
+        fclose(buffer);
+
+        // Only a statement that gave up waiting for a lock is worth running again.
+        if (ok || database->busyTimeouts == timeouts) {
+            break;
+        }
+        atomic_fetch_add(&transactionRetries, 1);
+        free(session->output);
+        session->output = NULL;
+    }
+
+    fwrite(session->output, 1, session->size, out);
+    free(session->output);
+    session->output = NULL;
+    return ok;
+}
+
+/**
+ * @brief Sends a tab separated request to the server, or runs it locally when not connected to one.
+ *
+ * @param request The request line.
+ * @param out     Stream receiving the output.
+ *
+ * @return True if the command succeeded.
+ */
+bool submitRequestTo(const char *request, FILE *out) {
+    if (serverSocket >= 0) {
+        return sendRequest(request, out);
+    }
+
+    if (reportingMode && !isCommandOf(readOnlyCommands, request)) {
+        fprintf(out, "%sNot available in reporting mode: %.*s%s\n", RED, (int)strcspn(request, "\t"), request, RESET);
+        fflush(out);
+        return false;
+    }
+
+    FILE *previous = localSession.out;
+    localSession.out = out;
+    bool ok = needsWriteTransaction(request) ? runWriteRequest(&localSession, request)
+                                             : handleRequest(&localSession, request);
+    localSession.out = previous;
+    fflush(out);
+    return ok;
+}
+
+/**
+ * @brief Submits a request and prints its output.
+ *
+ * @param request The request line.
+ *
+ * @return True if the command succeeded.
+ */
+bool submitRequest(const char *request) {
+    return submitRequestTo(request, stdout);
+}
@@ -0,0 +1,69 @@
+/*
+ * File:          session.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the session every command runs in: who is logged in, which connection
+ *                the command uses and where its output goes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
+// Define structure for the statistics and audit record of a command, kept while its group commit
+// is pending.
+struct CommandRecord {
+    const char *command;                 // Name the command is recorded under, NULL when none is kept.
+    const char *target;                  // First argument, or NULL.
+    bool ok;                             // Whether the command succeeded.
+    int outcome;                         // enum AuditOutcome of the audit record.
+    double micros;                       // Wall time.
+    long rows;                           // Rows changed.
+    long steps;                          // SQLite steps.
+    long fullScanSteps;                  // Steps of full table scans.
+};
+
+// Define structure for the context a command runs in.
+struct Session {
+    struct Database *database;           // Connection the current command runs on.
+    FILE *out;                           // Stream receiving the output of the current command.
+    bool authenticated;                  // Whether the user has logged in.
+    char userName[50];                   // Name of the logged in user.
+    int userRole;                        // Role of the logged in user, 0 for admins.
+    bool denied;                         // Whether the current command was refused for lack of permission.
+    char origin[32];                     // Where the user connects from, for login throttling.
+    char line[REQUEST_MAX_LENGTH];       // Copy of the current request, split in place into arguments.
+    char *output;                        // Output of the current command while it is buffered.
+    size_t size;                         // Size of the buffered output.
+    struct Arena arena;                  // Records of the current command, released when it ends.
+    bool deferRecord;                    // Whether the record waits for the commit of the command's group.
+    struct CommandRecord record;         // Record of the last command while it waits.
+};
+
+// Session of the interactive user when commands run in this process.
+struct Session localSession;
+
+/**
+ * @brief Starts a new session with no logged in user.
+ *
+ * @param session  The session to initialize.
+ * @param database Connection the commands of the session run on.
+ * @param out      Stream receiving the output of the commands.
+ */
+void openSession(struct Session *session, struct Database *database, FILE *out) {
+    memset(session, 0, sizeof(*session));
+    session->database = database;
+    session->out = out;
+    session->userRole = 1;
+    snprintf(session->origin, sizeof(session->origin), "local");
+}
+
+/**
+ * @brief Frees what a session holds, when its client leaves.
+ */
+void closeSession(struct Session *session) {
+    freeArena(&session->arena);
+}
@@ -0,0 +1,184 @@
+/*
+ * File:          snapshot.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the memory mode: the database is loaded into memory at startup, every
+ *                command runs against that copy, and a background thread writes it back to the file
+ *                on an interval and at exit. A crash loses the changes since the last snapshot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sqlite3.h>
+
+#define MEMORY_DATABASE "file:/bookshop.db?vfs=memdb" // Shared by every connection of the process.
+#define SNAPSHOT_SECONDS 10              // Interval of the snapshots.
+
+// Seconds between snapshots, 0 for snapshots at exit only.
+int snapshotInterval = SNAPSHOT_SECONDS;
+
+// Connection of the snapshot thread to the in-memory database. Being a connection of its own, it
+// only ever sees committed changes.
+struct Database snapshotSource;
+sqlite3_int64 snapshotVersion = -1;      // data_version of the source at the last snapshot.
+long snapshotCount;                      // Snapshots written.
+double snapshotMillis;                   // Duration of the last snapshot.
+
+pthread_t snapshotThread;
+pthread_mutex_t snapshotLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t snapshotWake = PTHREAD_COND_INITIALIZER;
+bool snapshotStopping = false;
+
+/**
+ * @brief Switches the process to memory mode; call before opening the shop.
+ *
+ * $BOOKERY_SNAPSHOT_INTERVAL sets the seconds between snapshots.
+ */
+void useMemoryDatabase() {
+    const char *interval = getenv("BOOKERY_SNAPSHOT_INTERVAL");
+
+    memoryMode = true;
+    databaseName = MEMORY_DATABASE;
+    if (interval != NULL) {
+        snapshotInterval = atoi(interval);
+    }
+}
+
+/**
+ * @brief Copies a whole database into another with the online backup API.
+ *
+ * The copy is one transaction on the destination, so a reader of it sees either the old or the
+ * new database, never a mix. A source locked by a commit in progress is waited for.
+ *
+ * @return SQLITE_OK on success, an SQLite error code otherwise.
+ */
+int copyDatabase(sqlite3 *to, sqlite3 *from) {
+    sqlite3_backup *backup = sqlite3_backup_init(to, "main", from, "main");
+    if (backup == NULL) {
+        return sqlite3_errcode(to);
+    }
+
+    int return_code;
+    while ((return_code = sqlite3_backup_step(backup, -1)) == SQLITE_BUSY || return_code == SQLITE_LOCKED) {
+        usleep(BUSY_BACKOFF_MIN_US);
+    }
+    int finished = sqlite3_backup_finish(backup);
+    return return_code == SQLITE_DONE ? finished : return_code;
+}
+
+/**
+ * @brief Loads the database file, if there is one, into the in-memory database.
+ *
+ * @param database Connection to the in-memory database.
+ *
+ * @return SQLITE_OK on success, an SQLite error code otherwise.
+ */
+int loadMemoryDatabase(struct Database *database) {
+    sqlite3 *file;
+
+    if (access(databaseFile, F_OK) != 0) {
+        return SQLITE_OK;
+    }
+    int return_code = sqlite3_open_v2(databaseFile, &file, SQLITE_OPEN_READONLY, NULL);
+    if (return_code == SQLITE_OK) {
+        sqlite3_busy_timeout(file, BUSY_TIMEOUT_MS);
+        return_code = copyDatabase(database->db, file);
+    }
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "Can't load %s into memory: %s\n", databaseFile, sqlite3_errstr(return_code));
+    }
+    sqlite3_close(file);
+    return return_code;
+}
+
+/**
+ * @brief Writes the in-memory database to the file, unless nothing was committed since the last
+ *        snapshot.
+ *
+ * @return SQLITE_OK on success, an SQLite error code otherwise.
+ */
+int takeSnapshot() {
+    sqlite3 *file;
+    sqlite3_stmt *stmt;
+    sqlite3_int64 version = -1;
+
+    sqlite3_prepare_v2(snapshotSource.db, "PRAGMA data_version;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (version == snapshotVersion) {
+        return SQLITE_OK;
+    }
+
+    double start = monotonicMicros();
+    int return_code = sqlite3_open_v2(databaseFile, &file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (return_code == SQLITE_OK) {
+        sqlite3_busy_timeout(file, BUSY_TIMEOUT_MS);
+        return_code = copyDatabase(file, snapshotSource.db);
+    }
+    sqlite3_close(file);
+
+    if (return_code != SQLITE_OK) {
+        fprintf(stderr, "%sSnapshot to %s failed: %s%s\n", RED, databaseFile, sqlite3_errstr(return_code), RESET);
+        return return_code;
+    }
+    snapshotVersion = version;
+    snapshotCount++;
+    snapshotMillis = (monotonicMicros() - start) / 1000;
+    return SQLITE_OK;
+}
+
+/**
+ * @brief Snapshot thread: writes the database back to the file every snapshotInterval seconds.
+ */
+void *snapshotWorker(void *arg) {
+    pthread_mutex_lock(&snapshotLock);
+    while (!snapshotStopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += snapshotInterval;
+        if (pthread_cond_timedwait(&snapshotWake, &snapshotLock, &deadline) != 0 && !snapshotStopping) {
+            pthread_mutex_unlock(&snapshotLock);
+            takeSnapshot();
+            pthread_mutex_lock(&snapshotLock);
+        }
+    }
+    pthread_mutex_unlock(&snapshotLock);
+    return NULL;
+}
+
+/**
+ * @brief Stops the snapshot thread and writes the last snapshot, at exit.
+ */
+void stopSnapshots() {
+    pthread_mutex_lock(&snapshotLock);
+    snapshotStopping = true;
+    pthread_cond_signal(&snapshotWake);
+    pthread_mutex_unlock(&snapshotLock);
+    if (snapshotInterval > 0) {
+        pthread_join(snapshotThread, NULL);
+    }
+    takeSnapshot();
+}
+
+/**
+ * @brief Opens the connection of the snapshots and starts the thread taking them.
+ *
+ * @return SQLITE_OK on success, an SQLite error code otherwise.
+ */
+int startSnapshots() {
+    int return_code = openDatabase(&snapshotSource, databaseName, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI);
+    if (return_code != SQLITE_OK) {
+        return return_code;
+    }
+    if (snapshotInterval > 0) {
+        pthread_create(&snapshotThread, NULL, snapshotWorker, NULL);
+    }
+    atexit(stopSnapshots);
+    return SQLITE_OK;
+}
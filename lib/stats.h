@@ -0,0 +1,179 @@
+/*
+ * File:          stats.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the per-command statistics: a log-scale latency histogram, the rows
+ *                changed and the SQLite virtual machine steps of every command, shown by "stats".
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#define STATS_COMMANDS 64                // Distinct commands tracked.
+#define STATS_BUCKETS 32                 // Bucket i counts latencies in [2^i, 2^(i+1)) microseconds.
+
+// Define structure for the statistics of one command.
+struct CommandStats {
+    char name[32];                       // Command name, empty if the slot is free.
+    long count;                          // Runs.
+    long failed;                         // Runs that reported a failure.
+    double totalMicros;                  // Sum of the wall times.
+    double maxMicros;                    // Longest wall time.
+    long rows;                           // Rows inserted, updated or deleted.
+    long steps;                          // SQLite virtual machine steps.
+    long fullScanSteps;                  // Steps spent scanning whole tables.
+    long buckets[STATS_BUCKETS];         // Latency histogram.
+};
+
+struct CommandStats commandStats[STATS_COMMANDS];
+pthread_mutex_t commandStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Whether the statistics are written to stderr on exit, set when running as a server.
+bool statsToStderr = false;
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+double monotonicMicros() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1e6 + time.tv_nsec / 1e3;
+}
+
+/**
+ * @brief Collects the steps run by the cached statements of a connection since the last call.
+ *
+ * @param database      The connection.
+ * @param fullScanSteps Set to the steps spent in full table scans.
+ *
+ * @return The virtual machine steps.
+ */
+long collectSteps(struct Database *database, long *fullScanSteps) {
+    long steps = 0;
+
+    *fullScanSteps = 0;
+    for (int i = 0; i < database->cached; i++) {
+        steps += sqlite3_stmt_status(database->cachedStmt[i], SQLITE_STMTSTATUS_VM_STEP, 1);
+        *fullScanSteps += sqlite3_stmt_status(database->cachedStmt[i], SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    }
+    return steps;
+}
+
+/**
+ * @brief Adds one run of a command to its statistics.
+ *
+ * @param command       Name of the command.
+ * @param ok            Whether the command succeeded.
+ * @param micros        Wall time of the run.
+ * @param rows          Rows changed by the run.
+ * @param steps         Virtual machine steps of the run.
+ * @param fullScanSteps Steps of the run spent in full table scans.
+ */
+void recordCommand(const char *command, bool ok, double micros, long rows, long steps, long fullScanSteps) {
+    int bucket = 0;
+    while (bucket < STATS_BUCKETS - 1 && micros >= (double)(2L << bucket)) {
+        bucket++;
+    }
+
+    pthread_mutex_lock(&commandStatsLock);
+    struct CommandStats *stats = NULL;
+    for (int i = 0; i < STATS_COMMANDS && stats == NULL; i++) {
+        if (commandStats[i].name[0] == '\0') {
+            snprintf(commandStats[i].name, sizeof(commandStats[i].name), "%s", command);
+        }
+        if (strcmp(commandStats[i].name, command) == 0) {
+            stats = &commandStats[i];
+        }
+    }
+    if (stats != NULL) {
+        stats->count++;
+        stats->failed += !ok;
+        stats->totalMicros += micros;
+        if (micros > stats->maxMicros) {
+            stats->maxMicros = micros;
+        }
+        stats->rows += rows;
+        stats->steps += steps;
+        stats->fullScanSteps += fullScanSteps;
+        stats->buckets[bucket]++;
+    }
+    pthread_mutex_unlock(&commandStatsLock);
+}
+
+/**
+ * @brief Estimates a percentile of a command's latency from its histogram.
+ *
+ * @return The upper bound of the bucket holding the percentile, in milliseconds.
+ */
+double statsPercentile(const struct CommandStats *stats, double fraction) {
+    long target = (long)(fraction * stats->count + 0.5);
+    long seen = 0;
+
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += stats->buckets[i];
+        if (seen >= target && seen > 0) {
+            double upper = (double)(2L << i) / 1000;
+            return upper < stats->maxMicros / 1000 ? upper : stats->maxMicros / 1000;
+        }
+    }
+    return stats->maxMicros / 1000;
+}
+
+/**
+ * @brief Prints the statistics of every command run so far.
+ *
+ * @param out Stream receiving the table.
+ */
+void printStats(FILE *out) {
+    fprintf(out, "%-16s %8s %7s %10s %10s %10s %10s %10s %12s %12s\n", "command", "runs", "failed", "mean ms",
+            "p50 ms", "p99 ms", "max ms", "rows", "steps", "scan steps");
+
+    pthread_mutex_lock(&commandStatsLock);
+    for (int i = 0; i < STATS_COMMANDS && commandStats[i].name[0] != '\0'; i++) {
+        struct CommandStats *stats = &commandStats[i];
+        fprintf(out, "%-16s %8ld %7ld %10.3f %10.3f %10.3f %10.3f %10ld %12ld %12ld\n", stats->name, stats->count,
+                stats->failed, stats->totalMicros / stats->count / 1000, statsPercentile(stats, 0.50),
+                statsPercentile(stats, 0.99), stats->maxMicros / 1000, stats->rows, stats->steps, stats->fullScanSteps);
+    }
+    pthread_mutex_unlock(&commandStatsLock);
+}
+
+/**
+ * @brief Prints the command statistics.
+ *
+ * @param session The session running the command.
+ *
+ * @return True.
+ */
+bool execStats(struct Session *session) {
+    fprintf(session->out, "\n%s*********** Command Statistics ***********%s\n\n", YELLOW, RESET);
+    printStats(session->out);
+    fprintf(session->out, "\n");
+    return true;
+}
+
+/**
+ * @brief Writes the command statistics when the process exits: to $BOOKERY_STATS_FILE if set,
+ *        otherwise to stderr when running as a server.
+ */
+void dumpStats() {
+    const char *path = getenv("BOOKERY_STATS_FILE");
+
+    if (commandStats[0].name[0] == '\0') {
+        return;
+    }
+    if (path != NULL) {
+        FILE *file = fopen(path, "w");
+        if (file != NULL) {
+            printStats(file);
+            fclose(file);
+        }
+    } else if (statsToStderr) {
+        fprintf(stderr, "\nCommand statistics:\n");
+        printStats(stderr);
+    }
+}
@@ -0,0 +1,123 @@
+/*
+ * File:          throttle.h
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   File contains the failed login throttling: a fixed-size table of recent failures per
+ *                username and per client, checked before any password is hashed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+
+#define THROTTLE_SLOTS 1024              // Size of the table, a power of two.
+#define THROTTLE_PROBES 8                // Slots searched for a key before evicting one.
+#define THROTTLE_FREE_FAILURES 3         // Failures allowed before logins get delayed.
+#define THROTTLE_DELAY_SECONDS 1         // First delay, doubled on every further failure.
+#define THROTTLE_LOCKOUT_FAILURES 10     // Failures after which a client is locked out.
+#define THROTTLE_LOCKOUT_SECONDS 900     // Length of a lockout.
+#define THROTTLE_USER_MAX_SECONDS 30     // Longest delay of a username, which is never locked out.
+#define THROTTLE_FORGET_SECONDS 3600     // Failures older than this are forgotten.
+
+// Define structure for the recent failed logins of a username or a client.
+struct LoginFailures {
+    char key[64];                        // "user:<name>" or "client:<origin>", empty if the slot is free.
+    int failures;                        // Failed logins in a row.
+    time_t last;                         // Time of the last failure.
+    time_t blockedUntil;                 // Logins are refused until this time.
+};
+
+struct LoginFailures loginFailures[THROTTLE_SLOTS];
+pthread_mutex_t loginFailuresLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Finds the slot of a key, taking a free or the oldest slot of its probe window if absent.
+ *
+ * Must be called with loginFailuresLock held.
+ *
+ * @param key    The key.
+ * @param create Whether to take a slot for a missing key.
+ *
+ * @return The slot, or NULL if the key is absent and create is false.
+ */
+struct LoginFailures *findLoginFailures(const char *key, bool create) {
+    // FNV-1a hash of the key.
+    unsigned int hash = 2166136261u;
+    for (const char *c = key; *c != '\0'; c++) {
+        hash = (hash ^ (unsigned char)*c) * 16777619u;
+    }
+
+    struct LoginFailures *victim = NULL;
+    for (int i = 0; i < THROTTLE_PROBES; i++) {
+        struct LoginFailures *slot = &loginFailures[(hash + i) & (THROTTLE_SLOTS - 1)];
+        if (strcmp(slot->key, key) == 0) {
+            return slot;
+        }
+        // Prefer a free slot, then the one whose last failure is the oldest.
+        if (victim == NULL || slot->key[0] == '\0' || (victim->key[0] != '\0' && slot->last < victim->last)) {
+            victim = slot;
+        }
+    }
+    if (!create) {
+        return NULL;
+    }
+
+    memset(victim, 0, sizeof(*victim));
+    snprintf(victim->key, sizeof(victim->key), "%s", key);
+    return victim;
+}
+
+/**
+ * @brief Returns how many seconds logins for a key are still refused.
+ *
+ * @param key The key.
+ *
+ * @return 0 if a login may be attempted now.
+ */
+long loginWait(const char *key) {
+    pthread_mutex_lock(&loginFailuresLock);
+    struct LoginFailures *slot = findLoginFailures(key, false);
+    long wait = slot != NULL ? (long)(slot->blockedUntil - time(NULL)) : 0;
+    pthread_mutex_unlock(&loginFailuresLock);
+    return wait > 0 ? wait : 0;
+}
+
+/**
+ * @brief Records the outcome of a login for a key.
+ *
+ * Failures past THROTTLE_FREE_FAILURES block the key for THROTTLE_DELAY_SECONDS, doubling on
+ * every further failure. THROTTLE_LOCKOUT_FAILURES failures lock a client out; a username is
+ * only delayed, up to THROTTLE_USER_MAX_SECONDS, so guessing someone's password can't lock the
+ * real user out. A success clears the key.
+ *
+ * @param key     The key.
+ * @param success Whether the login succeeded.
+ * @param lockout Whether the key may be locked out, true for clients.
+ */
+void recordLogin(const char *key, bool success, bool lockout) {
+    pthread_mutex_lock(&loginFailuresLock);
+    struct LoginFailures *slot = findLoginFailures(key, !success);
+    time_t now = time(NULL);
+
+    if (success) {
+        if (slot != NULL) {
+            memset(slot, 0, sizeof(*slot));
+        }
+    } else {
+        if (now - slot->last > THROTTLE_FORGET_SECONDS) {
+            slot->failures = 0;
+        }
+        slot->failures++;
+        slot->last = now;
+        if (lockout && slot->failures >= THROTTLE_LOCKOUT_FAILURES) {
+            slot->blockedUntil = now + THROTTLE_LOCKOUT_SECONDS;
+        } else if (slot->failures > THROTTLE_FREE_FAILURES) {
+            int doublings = slot->failures - THROTTLE_FREE_FAILURES - 1;
+            long delay = (long)THROTTLE_DELAY_SECONDS << (doublings < 16 ? doublings : 16);
+            slot->blockedUntil = now + (lockout || delay < THROTTLE_USER_MAX_SECONDS ? delay : THROTTLE_USER_MAX_SECONDS);
+        }
+    }
+    pthread_mutex_unlock(&loginFailuresLock);
+}
@@ -14,8 +14,17 @@
 #include <time.h>
 #include <unistd.h>
 #include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <openssl/crypto.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define IMPORT_THREADS_MAX 16
 
 #include "book.h"
+#include "throttle.h"
 
 // Define structure for a user.
 struct User {
@@ -63,33 +72,233 @@ void hashPassword(const char *password, unsigned char *hash) {
     EVP_MD_CTX_free(mdctx);
 }
 
+/**
+ * @brief Encodes bytes as a lowercase hexadecimal string.
+ *
+ * @param bytes  The bytes to encode.
+ * @param length Number of bytes.
+ * @param hex    Buffer of at least 2 * length + 1 characters receiving the string.
+ */
+void toHex(const unsigned char *bytes, size_t length, char *hex) {
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < length; i++) {
+        hex[i * 2] = digits[bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[bytes[i] & 0x0f];
+    }
+    hex[length * 2] = '\0';
+}
+
+/**
+ * @brief Hashes a password the way it is stored in the users table.
+ *
+ * @details Passwords are derived with PBKDF2-HMAC-SHA256 using the per-user salt and cost
+ *          (number of iterations). A cost of 0 marks accounts created before salting, whose
+ *          password is a single unsalted SHA-256; they are rehashed at their next login.
+ *
+ * @param password The plain password.
+ * @param salt     Salt of the user, as stored (ignored for cost 0).
+ * @param cost     Number of PBKDF2 iterations, or 0 for legacy SHA-256.
+ * @param hex      Buffer of PASSWORD_HASH_LENGTH * 2 + 1 characters receiving the hash.
+ */
+void derivePassword(const char *password, const char *salt, int cost, char *hex) {
+    unsigned char key[PASSWORD_HASH_LENGTH];
+
+    if (cost == 0) {
+        hashPassword(password, key);
+    } else {
+        PKCS5_PBKDF2_HMAC(password, strlen(password), (const unsigned char *)salt, strlen(salt),
+                          cost, EVP_sha256(), sizeof(key), key);
+    }
+    toHex(key, sizeof(key), hex);
+}
+
+/**
+ * @brief Generates a random salt for a new password hash.
+ *
+ * @param salt Buffer of PASSWORD_SALT_LENGTH * 2 + 1 characters receiving the salt as hex.
+ */
+void newSalt(char *salt) {
+    unsigned char bytes[PASSWORD_SALT_LENGTH];
+
+    RAND_bytes(bytes, sizeof(bytes));
+    toHex(bytes, sizeof(bytes), salt);
+}
+
+/**
+ * @brief Returns the cost new password hashes are made with, as set by "calibrate hash".
+ *
+ * @param database The open database connection.
+ *
+ * @return The number of PBKDF2 iterations.
+ */
+int passwordCost(struct Database *database) {
+    int cost = PASSWORD_COST_DEFAULT;
+
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT value FROM settings WHERE name='password_cost';");
+    if (stmt != NULL && sqlite3_step(stmt) == SQLITE_ROW) {
+        cost = sqlite3_column_int(stmt, 0);
+    }
+    if (stmt != NULL) {
+        sqlite3_reset(stmt);
+    }
+    return cost;
+}
+
+/**
+ * @brief Stores a fresh salted hash of a password with the current cost.
+ *
+ * @param database The open database connection.
+ * @param username The user whose password is stored.
+ * @param password The plain password.
+ *
+ * @return True if the hash was stored.
+ */
+bool storePassword(struct Database *database, const char *username, const char *password) {
+    char salt[PASSWORD_SALT_LENGTH * 2 + 1];
+    char hash[PASSWORD_HASH_LENGTH * 2 + 1];
+    int cost = passwordCost(database);
+
+    newSalt(salt);
+    derivePassword(password, salt, cost, hash);
+
+    sqlite3_stmt *stmt = prepareStatement(database, "UPDATE users SET password=?, salt=?, cost=? WHERE username=?;");
+    if (stmt == NULL) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, salt, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, cost);
+    sqlite3_bind_text(stmt, 4, username, -1, SQLITE_STATIC);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return return_code == SQLITE_DONE;
+}
+
+/**
+ * @brief Stores a password hash computed by a read worker, run by the writer. The hash is only
+ *        replaced if it is still the one the worker checked, so a password changed meanwhile wins.
+ *
+ * @param database The writer's connection.
+ * @param data     "username\told hash\tsalt\tnew hash\tcost".
+ * @param out      Unused, nobody waits for a rehash.
+ *
+ * @return True if the statement ran.
+ */
+bool applyRehash(struct Database *database, void *data, FILE *out) {
+    const char *request = data;
+    char copy[REQUEST_MAX_LENGTH], *state;
+    char *fields[5];
+
+    snprintf(copy, sizeof(copy), "%s", request);
+    fields[0] = strtok_r(copy, "\t", &state);
+    for (int i = 1; i < 5; i++) {
+        fields[i] = strtok_r(NULL, "\t", &state);
+    }
+    if (fields[4] == NULL) {
+        return false;
+    }
+
+    sqlite3_stmt *stmt = prepareStatement(database, "UPDATE users SET password=?, salt=?, cost=? WHERE username=? AND password=?;");
+    if (stmt == NULL) {
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, fields[3], -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, fields[2], -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, atoi(fields[4]));
+    sqlite3_bind_text(stmt, 4, fields[0], -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, fields[1], -1, SQLITE_STATIC);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    return return_code == SQLITE_DONE;
+}
+
+/**
+ * @brief Rehashes a password stored with another cost than the current one. A read-only
+ *        connection can't write it: the hash is computed here, on the read worker, and handed to
+ *        the writer, or dropped when there is none, as in reporting mode.
+ *
+ * @param database The connection of the login.
+ * @param username The user.
+ * @param password The plain password, just checked.
+ * @param stored   The hash it was checked against.
+ */
+void upgradePassword(struct Database *database, const char *username, const char *password, const char *stored) {
+    if (!sqlite3_db_readonly(database->db, "main")) {
+        storePassword(database, username, password);
+        return;
+    }
+
+    char salt[PASSWORD_SALT_LENGTH * 2 + 1];
+    char hash[PASSWORD_HASH_LENGTH * 2 + 1];
+    char request[REQUEST_MAX_LENGTH];
+    int cost = passwordCost(database);
+
+    newSalt(salt);
+    derivePassword(password, salt, cost, hash);
+    snprintf(request, sizeof(request), "%s\t%s\t%s\t%s\t%d", username, stored, salt, hash, cost);
+    queueWrite(applyRehash, request);
+}
+
 //*******************************************************************************************************************************************
 
 /**
  * @brief Function to update user information in the database.
- * 
- * This function connects to the SQLite database, prompts the user for the username to update,
- * retrieves new username, email, and role information, validates the inputs, updates the user
- * information in the users table, and closes the database connection.
- * 
- * @return void
+ *
+ * @param session     The session running the command.
+ * @param searchUser  Username of the user to update.
+ * @param updatedUser New username, email and role.
+ *
+ * @return True if the user was updated, false otherwise.
  */
-void updateUser() {
-    sqlite3 *db; // SQLite database pointer.
-    char *errMsg = 0; // Error message pointer.
+bool execUpdateUser(struct Session *session, const char *searchUser, const struct User *updatedUser) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
     int return_code; // Return code from SQLite functions.
 
-    // Open the SQLite database.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
-    if (return_code) {
+    // SQL query to update user information in the users table.
+    sqlite3_stmt *stmt = prepareStatement(database, "UPDATE users SET username=?, email=?, role=? WHERE username=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    // Bind parameters to the prepared statement.
+    sqlite3_bind_text(stmt, 1, updatedUser->username, -1, SQLITE_STATIC);
 
-        // If opening the database fails, print error message, close the database, and return.
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    sqlite3_bind_text(stmt, 2, updatedUser->email, -1, SQLITE_STATIC);
 
-        sqlite3_close(db);
-        return;
+    sqlite3_bind_int(stmt, 3, updatedUser->role);
+
+    sqlite3_bind_text(stmt, 4, searchUser, -1, SQLITE_STATIC);
+
+    // Execute the SQL statement
+    return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code == SQLITE_CONSTRAINT) {
+        // The unique index on users.username rejects renaming to a taken name.
+        fprintf(out, "%sUsername '%s' is already taken.%s\n", RED, updatedUser->username, RESET);
+        return false;
     }
+    if (return_code != SQLITE_DONE) {
+        // If executing the SQL statement fails, print error message.
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    // If update is successful, print success message.
+    fprintf(out, "%sUser updated successfully.%s\n", GREEN, RESET);
+    return true;
+}
 
+/**
+ * @brief Function to update user information in the database.
+ *
+ * This function prompts the user for the username to update, retrieves new username,
+ * email, and role information, validates the inputs and submits the update.
+ *
+ * @return void
+ */
+void updateUser() {
     char searchUser[MAX_TITLE_LENGTH]; // Array to store the username to update.
     // Prompt the user for the username to update.
     do {
@@ -115,36 +324,10 @@ void updateUser() {
         scanf("%d", &updatedUser.role);
     } while (!validateRole(updatedUser.role));
 
-    char sql[1000]; // Array to store SQL query.
-    // SQL query to update user information in the users table.
-    sprintf(sql, "UPDATE users SET username=?, email=?, role=? WHERE username=?;");
-
-    sqlite3_stmt *stmt; // SQLite statement pointer.
-    // Prepare the SQL statement
-    sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    // Bind parameters to the prepared statement.
-    sqlite3_bind_text(stmt, 1, updatedUser.username, -1, SQLITE_STATIC);
-
-    sqlite3_bind_text(stmt, 2, updatedUser.email, -1, SQLITE_STATIC);
-
-    sqlite3_bind_int(stmt, 3, updatedUser.role);
-
-    sqlite3_bind_text(stmt, 4, searchUser, -1, SQLITE_STATIC);
-
-    // Execute the SQL statement
-    return_code = sqlite3_step(stmt);
-    if (return_code != SQLITE_DONE) {
-        // If executing the SQL statement fails, print error message.
-        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-    } else {
-        // If update is successful, print success message.
-        printf("%sUser updated successfully.%s\n", GREEN, RESET);
-    }
-
-    // Finalize the statement.
-    sqlite3_finalize(stmt);
-    // Close the database connection.
-    sqlite3_close(db);
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "update user\t%s\t%s\t%s\t%d",
+             searchUser, updatedUser.username, updatedUser.email, updatedUser.role);
+    submitRequest(request);
 }
 
 
@@ -154,23 +337,30 @@ void updateUser() {
 
 /**
  * @brief Prints the role of the current user.
- * 
+ *
  * @details This function prints whether the current user is an admin or a regular user.
  *          It uses ANSI escape codes for colored output.
- * 
- * @param None
- * 
- * @return None
+ *
+ * @param session The session running the command.
+ *
+ * @return True.
  */
-void whoami(){
+bool execWhoami(struct Session *session){
+    FILE *out = session->out;
+
     // Check if the user role is admin (0) or not.
-    if(userRole == 0){
+    if(session->userRole == 0){
         // Print the user name and indicate that they are an admin.
-        printf("%s : You are an %sadmin.%s\n",userName,GREEN,RESET);
+        fprintf(out, "%s : You are an %sadmin.%s\n",session->userName,GREEN,RESET);
     } else {
         // Print the user name and indicate that they are a regular user.
-        printf("%s : You are a %suser%s.\n",userName,GREEN,RESET);
+        fprintf(out, "%s : You are a %suser%s.\n",session->userName,GREEN,RESET);
     }
+    return true;
+}
+
+void whoami(){
+    submitRequest("whoami");
 }
 
 
@@ -178,292 +368,821 @@ void whoami(){
 
 // Function to add users.
 
+// Define structure for a new user whose password was hashed before the write.
+struct HashedUser {
+    const struct User *user;
+    char salt[PASSWORD_SALT_LENGTH * 2 + 1];
+    char hash[PASSWORD_HASH_LENGTH * 2 + 1];
+    int cost;
+};
+
+/**
+ * @brief Inserts a new user, run by commitWrite().
+ *
+ * @param database The connection taking the write.
+ * @param data     The struct HashedUser.
+ * @param out      Stream receiving the errors.
+ *
+ * @return True if the user was inserted.
+ */
+bool insertUser(struct Database *database, void *data, FILE *out) {
+    const struct HashedUser *hashed = data;
+
+    // Prepare SQL statement to insert new user into the database.
+    sqlite3_stmt *stmt = prepareStatement(database, "INSERT INTO users (username, password, salt, cost, email, role) VALUES (?, ?, ?, ?, ?, ?);");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+
+    // Bind parameters to SQL statement
+    sqlite3_bind_text(stmt, 1, hashed->user->username, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, hashed->hash, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, hashed->salt, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 4, hashed->cost);
+    sqlite3_bind_text(stmt, 5, hashed->user->email, -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 6, hashed->user->role);
+
+    // Execute SQL statement
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code == SQLITE_CONSTRAINT) {
+        // The unique index on users.username rejects duplicate accounts.
+        fprintf(out, "%sUsername '%s' is already taken.%s\n", RED, hashed->user->username, RESET);
+        return false;
+    }
+    if (return_code != SQLITE_DONE) {
+        // If SQL execution fails, print error message.
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    return true;
+}
+
 /**
  * @brief Adds a new user to the database.
- * 
+ *
+ * @details Hashes the password, then stores the new user's information in the database, so the
+ *          write lock is not held while hashing. If the current user is not an admin, permission
+ *          denial message is displayed.
+ *
+ * @param session  The session running the command.
+ * @param newUser  Username, plain password, email and role of the new user.
+ *
+ * @return True if the user was added, false otherwise.
+ */
+bool execAddUser(struct Session *session, const struct User *newUser) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    // Check if the current user is an admin (session->userRole == 0)
+    if(session->userRole != 0){
+        // Display permission denial message if the current user is not an admin.
+        fprintf(out, "%sYou don't have permission for this action! This incident will be reported.%s\n",RED,RESET);
+        session->denied = true;
+        return false;
+    }
+
+    // Hash the password with a new salt and the current cost.
+    struct HashedUser hashed = {newUser};
+    hashed.cost = passwordCost(database);
+    newSalt(hashed.salt);
+    derivePassword(newUser->password, hashed.salt, hashed.cost, hashed.hash);
+
+    if (!commitWrite(session, insertUser, &hashed)) {
+        return false;
+    }
+    // If user added successfully, print success message.
+    fprintf(out, "%sUser added successfully.%s\n",GREEN,RESET);
+    return true;
+}
+
+/**
+ * @brief Adds a new user to the database.
+ *
  * @details This function prompts the admin user to input details of the new user,
- *          including username, password, email, and role. It then validates the input,
- *          hashes the password, and stores the new user's information in the database.
- *          If the current user is not an admin, permission denial message is displayed.
- * 
+ *          including username, password, email, and role, validates the input and
+ *          submits the new user.
+ *
  * @param None
- * 
+ *
  * @return None
  */
 void addUser() {
-    // Check if the current user is an admin (userRole == 0)
-    if(userRole != 0){
-        // Display permission denial message if the current user is not an admin.
-        printf("%sYou don't have permission for this action! This incident will be reported.%s\n",RED,RESET);
-    } else {
-        // If the current user is an admin, proceed with adding a new user.
-        
-        // Declare variables for password input.
-        char *passwordPtr,*password2Ptr;
-        char password[100], password2[100];
-        
-        // Declare variables for interacting with the database.
-        sqlite3 *db;
-        char *errMsg = 0;
-        int return_code;
-
-        // Open the database
-        return_code = sqlite3_open(DATABASE_FILE, &db);
-        if (return_code) {
-            // If unable to open the database, print error message and return.
-            fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-            sqlite3_close(db);
-            return;
-        }
+    // Declare variables for password input.
+    char *passwordPtr,*password2Ptr;
+    char password[100], password2[100];
 
-        // Declare a struct to store the details of the new user.
-        struct User newUser;
-        
-        // Prompt the admin to enter the username.
-        do {
-            printf("Enter username: ");
-            scanf("%49s", newUser.username);
-        } while (!validateUsername(newUser.username));
-
-        // Prompt the admin to enter the password twice and validate that they match.
-        do {
-            passwordPtr = getpass("Enter password: ");
-            strcpy(password, passwordPtr);
-            password2Ptr = getpass("Enter password again: ");
-            strcpy(password2, password2Ptr);
-            if(strcmp(password,password2) != 0){
-                printf("%sPasswords don't match!%s\n",RED,RESET);
-            } else {
-                // If passwords match, store the password in newUser struct.
-                strcpy(newUser.password, password);
-            }
-        } while (!validatePassword(newUser.password));
-
-        // Prompt the admin to enter the email.
-        do {
-            printf("Enter email: ");
-            scanf("%99s", newUser.email);
-        } while (!validateEmail(newUser.email));
-
-        // Prompt the admin to enter the role (0 for admin, 1 for regular user).
-        do {
-            printf("Enter role (0 for admin, 1 for regular user): ");
-            scanf("%d", &newUser.role);
-        } while (!validateRole(newUser.role));
-
-        // Hash the password using SHA-256 algorithm.
-        unsigned char hashed_password[SHA256_DIGEST_LENGTH];
-        hashPassword(newUser.password, hashed_password);
-
-        // Convert hashed password to hexadecimal string.
-        char hashed_password_str[SHA256_DIGEST_LENGTH * 2 + 1];
-        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-            sprintf(&hashed_password_str[i * 2], "%02x", hashed_password[i]);
-        }
+    // Declare a struct to store the details of the new user.
+    struct User newUser;
+    newUser.password[0] = '\0';
 
-        // Construct SQL query to insert new user into the database.
-        char sql[1000];
-        sprintf(sql, "INSERT INTO users (username, password, email, role) VALUES (?, ?, ?, ?);");
-
-        // Prepare SQL statement
-        sqlite3_stmt *stmt;
-        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-        
-        // Bind parameters to SQL statement
-        sqlite3_bind_text(stmt, 1, newUser.username, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 2, hashed_password_str, -1, SQLITE_STATIC);
-        sqlite3_bind_text(stmt, 3, newUser.email, -1, SQLITE_STATIC);
-        sqlite3_bind_int(stmt, 4, newUser.role);
-
-        // Execute SQL statement
-        return_code = sqlite3_step(stmt);
-        if (return_code != SQLITE_DONE) {
-            // If SQL execution fails, print error message.
-            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+    // Prompt the admin to enter the username.
+    do {
+        printf("Enter username: ");
+        scanf("%49s", newUser.username);
+    } while (!validateUsername(newUser.username));
+
+    // Prompt the admin to enter the password twice and validate that they match.
+    do {
+        passwordPtr = getpass("Enter password: ");
+        strcpy(password, passwordPtr);
+        password2Ptr = getpass("Enter password again: ");
+        strcpy(password2, password2Ptr);
+        if(strcmp(password,password2) != 0){
+            printf("%sPasswords don't match!%s\n",RED,RESET);
         } else {
-            // If user added successfully, print success message.
-            printf("%sUser added successfully.%s\n",GREEN,RESET);
+            // If passwords match, store the password in newUser struct.
+            strcpy(newUser.password, password);
         }
+    } while (!validatePassword(newUser.password));
 
-        // Finalize the SQL statement and close the database connection.
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-    }
+    // Prompt the admin to enter the email.
+    do {
+        printf("Enter email: ");
+        scanf("%99s", newUser.email);
+    } while (!validateEmail(newUser.email));
+
+    // Prompt the admin to enter the role (0 for admin, 1 for regular user).
+    do {
+        printf("Enter role (0 for admin, 1 for regular user): ");
+        scanf("%d", &newUser.role);
+    } while (!validateRole(newUser.role));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "add user\t%s\t%s\t%s\t%d",
+             newUser.username, newUser.password, newUser.email, newUser.role);
+    submitRequest(request);
 }
 
-// Delete a user.
+//************************************************************************************************************************************
+
+// Bulk import of users.
+
+// Define structure for a user read from an import file.
+struct ImportedUser {
+    struct User user;
+    int line;                                  // Line of the file the user was read from.
+    char salt[PASSWORD_SALT_LENGTH * 2 + 1];
+    char hash[PASSWORD_HASH_LENGTH * 2 + 1];
+};
+
+// Define structure for the users shared by the hashing threads of an import.
+struct ImportBatch {
+    struct ImportedUser *users;
+    int count;
+    int cost;
+    atomic_int next;                           // Index of the next user to hash.
+};
 
 /**
- * @brief Deletes a user from the database.
- * 
- * @details This function allows the admin user to delete a user from the database
- *          by providing the username of the user to be deleted. It validates the username,
- *          constructs a SQL query to delete the user, and executes the query.
- *          If the current user is not an admin, permission denial message is displayed.
- * 
- * @param None
- * 
- * @return None
+ * @brief Hashing thread of an import, taking users from the batch until none are left.
  */
-void delUser() {
-    // Check if the current user is an admin (userRole == 0)
-    if(userRole != 0){
-        // Display permission denial message if the current user is not an admin.
-        printf("%sYou don't have permission for this action! This incident will be reported.%s\n",RED,RESET);
-    } else {
-        // If the current user is an admin, proceed with deleting a user.
-        
-        // Declare variables for interacting with the database.
-        sqlite3 *db;
-        char *errMsg = 0;
-        int return_code;
-
-        // Open the database
-        return_code = sqlite3_open(DATABASE_FILE, &db);
-        if (return_code) {
-            // If unable to open the database, print error message and return.
-            fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-            sqlite3_close(db);
-            return;
+void *hashImportedUsers(void *arg) {
+    struct ImportBatch *batch = arg;
+
+    for (int i = atomic_fetch_add(&batch->next, 1); i < batch->count; i = atomic_fetch_add(&batch->next, 1)) {
+        newSalt(batch->users[i].salt);
+        derivePassword(batch->users[i].user.password, batch->users[i].salt, batch->cost, batch->users[i].hash);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Reads the users of a CSV file with lines "username,email,role,password".
+ *
+ * @param out   Stream receiving the errors.
+ * @param path  Path of the CSV file. A first line starting with "username" is a header.
+ * @param count Set to the number of users read.
+ *
+ * @return The users, or NULL if the file can't be read or a line is invalid.
+ */
+struct ImportedUser *readImportFile(FILE *out, const char *path, int *count) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(out, "%sCan't open %s.%s\n", RED, path, RESET);
+        return NULL;
+    }
+
+    struct ImportedUser *users = NULL;
+    int capacity = 0;
+    char line[512];
+    bool valid = true;
+
+    *count = 0;
+    for (int number = 1; fgets(line, sizeof(line), file) != NULL; number++) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || (number == 1 && strncmp(line, "username", 8) == 0)) {
+            continue;
         }
 
-        // Declare variable to store the username of the user to be deleted.
-        char del_username[MAX_AUTHOR_LENGTH];
-        
-        // Prompt the admin to enter the username of the user to be deleted.
-        do{
-            printf("Enter the user to delete: ");
-            scanf(" %[^\n]s", del_username);
-        }while(!validateUsername(del_username));
-
-        // Check if there is only one user in the database
-        int user_count;
-        char sql_count[1000];
-        sprintf(sql_count, "SELECT COUNT(*) FROM users;");
-        return_code = sqlite3_exec(db, sql_count, callback_count, &user_count, &errMsg);
-        if (return_code != SQLITE_OK) {
-            fprintf(stderr, "SQL error: %s\n", errMsg);
-            sqlite3_free(errMsg);
-            sqlite3_close(db);
-            return;
+        // strsep() keeps empty fields, so a missing column is reported instead of shifting the others.
+        char *fields[5], *rest = line;
+        int found = 0;
+        bool empty = false;
+        for (char *field = strsep(&rest, ","); field != NULL && found < 5; field = strsep(&rest, ",")) {
+            empty = empty || field[0] == '\0';
+            fields[found++] = field;
+        }
+        if (empty && found == 4) {
+            fprintf(out, "%sLine %d: empty field.%s\n", RED, number, RESET);
+            valid = false;
+            continue;
+        }
+        if (found != 4 || strlen(fields[0]) <= 3 || strlen(fields[0]) >= sizeof(users->user.username) ||
+            !validateEmail(fields[1]) || strlen(fields[1]) >= sizeof(users->user.email) ||
+            (strcmp(fields[2], "0") != 0 && strcmp(fields[2], "1") != 0) ||
+            strlen(fields[3]) <= 4 || strlen(fields[3]) >= sizeof(users->user.password)) {
+            fprintf(out, "%sLine %d: expected username (4+ characters), email, role (0 or 1) and password (5+ characters).%s\n",
+                    RED, number, RESET);
+            valid = false;
+            continue;
         }
 
-        if (user_count <= 1) {
-            printf("%sYou can't delete the last user.%s\n", RED, RESET);
-            sqlite3_close(db);
-            return;
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            users = realloc(users, capacity * sizeof(*users));
         }
+        struct ImportedUser *imported = &users[(*count)++];
+        memset(imported, 0, sizeof(*imported));
+        snprintf(imported->user.username, sizeof(imported->user.username), "%s", fields[0]);
+        snprintf(imported->user.email, sizeof(imported->user.email), "%s", fields[1]);
+        imported->user.role = atoi(fields[2]);
+        snprintf(imported->user.password, sizeof(imported->user.password), "%s", fields[3]);
+        imported->line = number;
+    }
+    fclose(file);
+
+    if (!valid) {
+        free(users);
+        return NULL;
+    }
+    return users;
+}
+
+/**
+ * @brief Inserts the hashed users of an import, run by commitWrite(). A duplicate username fails
+ *        the write, so the whole import is rolled back.
+ *
+ * @param database The connection taking the write.
+ * @param data     The struct ImportBatch, already hashed.
+ * @param out      Stream receiving the errors.
+ *
+ * @return True if every user was inserted.
+ */
+bool insertImportedUsers(struct Database *database, void *data, FILE *out) {
+    struct ImportBatch *batch = data;
 
-        // Construct SQL query to delete the user from the database.
-        char sql1[1000];
-        sprintf(sql1, "DELETE FROM users WHERE username=?;");
-        
-        // Prepare SQL statement
-        sqlite3_stmt *stmt;
-        sqlite3_prepare_v2(db, sql1, -1, &stmt, NULL);
-        sqlite3_bind_text(stmt, 1, del_username, -1, SQLITE_STATIC);
-
-        // Execute SQL statement
-        return_code = sqlite3_step(stmt);
+    sqlite3_stmt *stmt = prepareStatement(database, "INSERT INTO users (username, password, salt, cost, email, role) VALUES (?, ?, ?, ?, ?, ?);");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+
+    for (int i = 0; i < batch->count; i++) {
+        struct ImportedUser *imported = &batch->users[i];
+        sqlite3_bind_text(stmt, 1, imported->user.username, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, imported->hash, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, imported->salt, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 4, batch->cost);
+        sqlite3_bind_text(stmt, 5, imported->user.email, -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmt, 6, imported->user.role);
+
+        int return_code = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (return_code == SQLITE_CONSTRAINT) {
+            fprintf(out, "%sLine %d: username '%s' is already taken.%s\n", RED, imported->line, imported->user.username, RESET);
+            return false;
+        }
         if (return_code != SQLITE_DONE) {
-            // If SQL execution fails, print error message.
-            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
-        } else {
-            // If user deleted successfully, print success message.
-            printf("%sUser deleted successfully.%s\n",GREEN,RESET);
+            fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+            return false;
         }
+    }
+    return true;
+}
+
+/**
+ * @brief Adds every user of a CSV file, all or none.
+ *
+ * @details Passwords are hashed on a pool of threads before the database is touched, so the write
+ *          lock is only held for the inserts, which commitWrite() commits in one go: on the
+ *          server the read worker hashes and the writer inserts.
+ *
+ * @param session The session running the command.
+ * @param path    Path of the CSV file, read by the process running the command.
+ *
+ * @return True if all users were added, false otherwise.
+ */
+bool execImportUsers(struct Session *session, const char *path) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    if (session->userRole != 0) {
+        fprintf(out, "%sYou don't have permission for this action! This incident will be reported.%s\n", RED, RESET);
+        session->denied = true;
+        return false;
+    }
 
-        // Finalize the SQL statement and close the database connection.
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
+    struct ImportBatch batch;
+    batch.users = readImportFile(out, path, &batch.count);
+    if (batch.users == NULL) {
+        return false;
+    }
+    batch.cost = passwordCost(database);
+    atomic_init(&batch.next, 0);
+
+    // Hash on one thread per CPU.
+    pthread_t threads[IMPORT_THREADS_MAX];
+    int threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadCount > IMPORT_THREADS_MAX) {
+        threadCount = IMPORT_THREADS_MAX;
+    }
+    if (threadCount > batch.count) {
+        threadCount = batch.count;
+    }
+    for (int i = 0; i < threadCount; i++) {
+        pthread_create(&threads[i], NULL, hashImportedUsers, &batch);
     }
+    for (int i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    bool ok = commitWrite(session, insertImportedUsers, &batch);
+    if (ok) {
+        fprintf(out, "%s%d users imported.%s\n", GREEN, batch.count, RESET);
+    } else {
+        fprintf(out, "%sNo users were imported.%s\n", RED, RESET);
+    }
+    free(batch.users);
+    return ok;
 }
 
+/**
+ * @brief Prompts for a CSV file and imports its users.
+ */
+void importUsers() {
+    char path[256];
 
+    printf("CSV lines: username,email,role,password\n");
+    do {
+        printf("Enter the path of the CSV file: ");
+        scanf(" %255[^\n]", path);
+    } while (!validateField(path));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "import users\t%s", path);
+    submitRequest(request);
+}
+
+// Delete a user.
 
 /**
- * @brief Authenticates a user based on provided username and password.
- * 
- * @details This function prompts the user to enter a username and a password.
- *          It then hashes the password, queries the database to check if the
- *          provided username and hashed password match any user credentials in the database.
- *          If a match is found, it retrieves the role of the user and updates global variables
- *          `userName` and `userRole` accordingly. If authentication is successful, it returns true;
- *          otherwise, it returns false.
- * 
- * @param None
- * 
- * @return True if authentication is successful, false otherwise.
+ * @brief Deletes a user from the database.
+ *
+ * @details Refuses to delete the last remaining user.
+ *          If the current user is not an admin, permission denial message is displayed.
+ *
+ * @param session      The session running the command.
+ * @param del_username Username of the user to delete.
+ *
+ * @return True if the user was deleted, false otherwise.
  */
-bool authenticateUser() {
-    // Declare variables for storing username, password, SQL query, and database interactions.
-    char username[50], *password;
-    char sql[1000];
-    sqlite3 *db;
-    sqlite3_stmt *stmt;
+bool execDelUser(struct Session *session, const char *del_username) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    // Check if the current user is an admin (session->userRole == 0)
+    if(session->userRole != 0){
+        // Display permission denial message if the current user is not an admin.
+        fprintf(out, "%sYou don't have permission for this action! This incident will be reported.%s\n",RED,RESET);
+        session->denied = true;
+        return false;
+    }
+
     int return_code;
 
-    // Open the database connection.
-    return_code = sqlite3_open(DATABASE_FILE, &db);
+    // Check if there is only one user in the database
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT COUNT(*) FROM users;");
+    if (stmt == NULL || sqlite3_step(stmt) != SQLITE_ROW) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    int user_count = sqlite3_column_int(stmt, 0);
+    sqlite3_reset(stmt);
 
-    // Prompt the user to enter username and password.
-    printf("Enter username: ");
-    scanf("%49s", username);
-    password = getpass("Enter password: ");
+    if (user_count <= 1) {
+        fprintf(out, "%sYou can't delete the last user.%s\n", RED, RESET);
+        return false;
+    }
 
-    // Hash the password
-    unsigned char hashed_password[SHA256_DIGEST_LENGTH];
-    hashPassword(password, hashed_password);
+    // Prepare SQL statement to delete the user from the database.
+    stmt = prepareStatement(database, "DELETE FROM users WHERE username=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, del_username, -1, SQLITE_STATIC);
 
-    // Convert the hashed password to a hexadecimal string.
-    char hashed_password_str[SHA256_DIGEST_LENGTH * 2 + 1]; // Add 1 for null terminator.
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        sprintf(&hashed_password_str[i * 2], "%02x", hashed_password[i]);
+    // Execute SQL statement
+    return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        // If SQL execution fails, print error message.
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
     }
+    // If user deleted successfully, print success message.
+    fprintf(out, "%sUser deleted successfully.%s\n",GREEN,RESET);
+    return true;
+}
+
+/**
+ * @brief Deletes a user from the database.
+ *
+ * @details This function prompts for the username of the user to be deleted,
+ *          validates it and submits the deletion.
+ *
+ * @param None
+ *
+ * @return None
+ */
+void delUser() {
+    // Declare variable to store the username of the user to be deleted.
+    char del_username[MAX_AUTHOR_LENGTH];
+
+    // Prompt the admin to enter the username of the user to be deleted.
+    do{
+        printf("Enter the user to delete: ");
+        scanf(" %[^\n]s", del_username);
+    }while(!validateUsername(del_username));
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "del user\t%s", del_username);
+    submitRequest(request);
+}
+
 
-    // Prepare SQL statement to query for user credentials and role,
-    sprintf(sql, "SELECT role FROM users WHERE username=? AND password=?;");
 
-    // Prepare SQL statement and bind parameters.
-    sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+/**
+ * @brief Authenticates a user based on provided username and password.
+ *
+ * @details This function looks up the stored hash, salt and cost of the user, hashes the
+ *          provided password the same way and compares the two. If they match, it records the
+ *          user name and role in the session, and rehashes the password if it was stored with
+ *          another cost than the current one (including legacy unsalted SHA-256 hashes).
+ *
+ * @param session  The session running the command.
+ * @param username The username to authenticate.
+ * @param password The plain password.
+ *
+ * @return True if authentication is successful, false otherwise.
+ */
+bool execLogin(struct Session *session, const char *username, const char *password) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    int return_code;
+    int role = 1, cost = passwordCost(database);
+    char stored[PASSWORD_HASH_LENGTH * 2 + 1] = "";
+    char salt[PASSWORD_SALT_LENGTH * 2 + 1] = "";
+
+    // Refuse throttled usernames and clients before spending anything on hashing.
+    char userKey[64], clientKey[64];
+    snprintf(userKey, sizeof(userKey), "user:%s", username);
+    snprintf(clientKey, sizeof(clientKey), "client:%s", session->origin);
+    long wait = loginWait(userKey);
+    if (loginWait(clientKey) > wait) {
+        wait = loginWait(clientKey);
+    }
+    if (wait > 0) {
+        fprintf(out, "%sToo many failed logins, try again in %ld seconds.%s\n", RED, wait, RESET);
+        return false;
+    }
+
+    // Look up the stored hash and role of the user, an index seek on the unique username.
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT role, password, salt, cost FROM users WHERE username=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
     sqlite3_bind_text(stmt, 1, username, -1, SQLITE_STATIC);
-    sqlite3_bind_text(stmt, 2, hashed_password_str, -1, SQLITE_STATIC);
 
     // Execute SQL statement
     return_code = sqlite3_step(stmt);
     if (return_code == SQLITE_ROW) {
-        // If authentication is successful, retrieve the user's role.
-        int role = sqlite3_column_int(stmt, 0);
+        role = sqlite3_column_int(stmt, 0);
+        snprintf(stored, sizeof(stored), "%s", (const char *)sqlite3_column_text(stmt, 1));
+        if (sqlite3_column_type(stmt, 2) != SQLITE_NULL) {
+            snprintf(salt, sizeof(salt), "%s", (const char *)sqlite3_column_text(stmt, 2));
+        }
+        cost = sqlite3_column_int(stmt, 3);
+    }
+    sqlite3_reset(stmt);
+
+    // Hash the password the way the stored one was hashed. Unknown users still pay the full
+    // current cost so the response time doesn't tell which usernames exist.
+    char hashed_password_str[PASSWORD_HASH_LENGTH * 2 + 1];
+    derivePassword(password, salt, cost, hashed_password_str);
+
+    // Compare in constant time so the response time doesn't leak how much of the hash matched.
+    bool match = strlen(stored) == strlen(hashed_password_str) &&
+                 CRYPTO_memcmp(stored, hashed_password_str, strlen(stored)) == 0;
+    bool success = return_code == SQLITE_ROW && match;
+    recordLogin(userKey, success, false);
+    recordLogin(clientKey, success, true);
+    if (success) {
+        // Upgrade hashes made with an older cost.
+        if (cost != passwordCost(database)) {
+            upgradePassword(database, username, password, stored);
+        }
         // Print authentication success message.
-        printf("%sAuthentication successful!%s\n",GREEN ,RESET);
-        // Update global variables with user information.
-        strcpy(userName, username);
-        userRole = role;
-        // Finalize the SQL statement and close the database connection.
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
+        fprintf(out, "%sAuthentication successful!%s\n",GREEN ,RESET);
+        // Record the user in the session.
+        session->authenticated = true;
+        snprintf(session->userName, sizeof(session->userName), "%s", username);
+        session->userRole = role;
         // Return true to indicate successful authentication.
         return true;
+    }
+    // If authentication fails, print error message.
+    fprintf(out, "%sIncorrect username or password.\n%s",RED,RESET);
+    // Return false to indicate authentication failure.
+    return false;
+}
+
+//********************************************************************************************************************************************************
+
+// Session tokens, so a new invocation doesn't have to hash the password again.
+
+/**
+ * @brief Hashes a session token the way it is stored in the sessions table.
+ *
+ * @details Tokens are random, so a plain SHA-256 is enough; only the hash is stored so a copy
+ *          of the database doesn't give away live sessions.
+ *
+ * @param token The token.
+ * @param hex   Buffer of SHA256_DIGEST_LENGTH * 2 + 1 characters receiving the hash.
+ */
+void hashToken(const char *token, char *hex) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+
+    hashPassword(token, hash);
+    toHex(hash, sizeof(hash), hex);
+}
+
+/**
+ * @brief Issues a session token for the logged in user, valid for SESSION_TOKEN_LIFETIME seconds.
+ *
+ * @param session The session running the command.
+ *
+ * @return True if the token was stored and printed, false otherwise.
+ */
+bool execNewToken(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    if (!session->authenticated) {
+        fprintf(out, "%sPlease login first.%s\n", RED, RESET);
+        return false;
+    }
+
+    unsigned char bytes[SESSION_TOKEN_LENGTH];
+    char token[SESSION_TOKEN_LENGTH * 2 + 1];
+    char hash[SHA256_DIGEST_LENGTH * 2 + 1];
+    RAND_bytes(bytes, sizeof(bytes));
+    toHex(bytes, sizeof(bytes), token);
+    hashToken(token, hash);
+
+    // Drop expired sessions, then store the new one.
+    sqlite3_stmt *stmt = prepareStatement(database, "DELETE FROM sessions WHERE expires <= ?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_int64(stmt, 1, time(NULL));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+
+    stmt = prepareStatement(database, "INSERT INTO sessions (token, username, expires) VALUES (?, ?, ?);");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, session->userName, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 3, time(NULL) + SESSION_TOKEN_LIFETIME);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+
+    fprintf(out, "%s\n", token);
+    return true;
+}
+
+/**
+ * @brief Authenticates the session with a token issued by an earlier login.
+ *
+ * @param session The session running the command.
+ * @param token   The token.
+ *
+ * @return True if the token is valid and not expired, false otherwise.
+ */
+bool execResume(struct Session *session, const char *token) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    char hash[SHA256_DIGEST_LENGTH * 2 + 1];
+    hashToken(token, hash);
+
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT users.username, users.role FROM sessions "
+                                                    "JOIN users ON users.username = sessions.username "
+                                                    "WHERE sessions.token=? AND sessions.expires > ?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, time(NULL));
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_reset(stmt);
+        fprintf(out, "%sSaved login expired, please login again.%s\n", YELLOW, RESET);
+        return false;
+    }
+    session->authenticated = true;
+    snprintf(session->userName, sizeof(session->userName), "%s", (const char *)sqlite3_column_text(stmt, 0));
+    session->userRole = sqlite3_column_int(stmt, 1);
+    sqlite3_reset(stmt);
+
+    fprintf(out, "%sWelcome back, %s!%s\n", GREEN, session->userName, RESET);
+    return true;
+}
+
+/**
+ * @brief Revokes a session token.
+ *
+ * @param session The session running the command.
+ * @param token   The token.
+ *
+ * @return True if the token was revoked, false otherwise.
+ */
+bool execLogout(struct Session *session, const char *token) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
+
+    char hash[SHA256_DIGEST_LENGTH * 2 + 1];
+    hashToken(token, hash);
+
+    sqlite3_stmt *stmt = prepareStatement(database, "DELETE FROM sessions WHERE token=?;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, hash, -1, SQLITE_STATIC);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    fprintf(out, "%sLogged out.%s\n", GREEN, RESET);
+    return true;
+}
+
+/**
+ * @brief Returns the path of the file keeping the session token: $BOOKERY_TOKEN_FILE, or
+ *        SESSION_TOKEN_FILE in the home directory.
+ */
+void tokenPath(char *path, size_t size) {
+    const char *file = getenv("BOOKERY_TOKEN_FILE");
+    const char *home = getenv("HOME");
+
+    if (file != NULL) {
+        snprintf(path, size, "%s", file);
     } else {
-        // If authentication fails, print error message.
-        printf("%sIncorrect username or password.\n%s",RED,RESET);
-        // Finalize the SQL statement and close the database connection.
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);
-        // Return false to indicate authentication failure.
+        snprintf(path, size, "%s/%s", home != NULL ? home : ".", SESSION_TOKEN_FILE);
+    }
+}
+
+/**
+ * @brief Reads the saved session token.
+ *
+ * @param token Buffer of SESSION_TOKEN_LENGTH * 2 + 1 characters receiving the token.
+ *
+ * @return True if a token was read.
+ */
+bool readToken(char *token) {
+    char path[512];
+    tokenPath(path, sizeof(path));
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    bool found = fscanf(file, "%64s", token) == 1 && strlen(token) == SESSION_TOKEN_LENGTH * 2;
+    fclose(file);
+    return found;
+}
+
+/**
+ * @brief Asks for a session token for the logged in user and saves it, readable by the owner only.
+ */
+void saveToken() {
+    char *output = NULL;
+    size_t size = 0;
+    FILE *buffer = open_memstream(&output, &size);
+    bool issued = submitRequestTo("new token", buffer);
+    fclose(buffer);
+
+    char path[512];
+    tokenPath(path, sizeof(path));
+    if (issued) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0) {
+            fchmod(fd, 0600);
+            write(fd, output, strlen(output));
+            close(fd);
+        }
+    }
+    free(output);
+}
+
+/**
+ * @brief Authenticates with the saved session token, if there is a valid one.
+ *
+ * @return True if the session was resumed.
+ */
+bool resumeSession() {
+    char token[SESSION_TOKEN_LENGTH * 2 + 1];
+    char request[REQUEST_MAX_LENGTH];
+
+    if (!readToken(token)) {
+        return false;
+    }
+    snprintf(request, sizeof(request), "resume\t%s", token);
+    return submitRequest(request);
+}
+
+/**
+ * @brief Revokes the saved session token, removes it and exits.
+ */
+void logout() {
+    char token[SESSION_TOKEN_LENGTH * 2 + 1];
+    char request[REQUEST_MAX_LENGTH];
+    char path[512];
+
+    if (readToken(token)) {
+        snprintf(request, sizeof(request), "logout\t%s", token);
+        submitRequest(request);
+    }
+    tokenPath(path, sizeof(path));
+    unlink(path);
+    printf("\n\nbye!\n");
+    exit(0);
+}
+
+/**
+ * @brief Prompts for a username and a password and authenticates the user.
+ *
+ * @details On success a session token is saved, so the next invocation doesn't ask again.
+ *
+ * @param None
+ *
+ * @return True if authentication is successful, false otherwise.
+ */
+bool authenticateUser() {
+    char username[50], *password;
+
+    // Prompt the user to enter username and password.
+    printf("Enter username: ");
+    scanf("%49s", username);
+    password = getpass("Enter password: ");
+    if (!validateField(password)) {
+        return false;
+    }
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "login\t%s\t%s", username, password);
+    if (!submitRequest(request)) {
         return false;
     }
+    saveToken();
+    return true;
 }
 
 /**
  * @brief Displays the login interface and authenticates the user.
- * 
+ *
  * @details This function clears the screen, displays the Bookery introduction,
  *          and prompts the user to log in by calling the `authenticateUser` function.
  *          If the authentication is unsuccessful, the program exits.
- * 
+ *
  * @param None
- * 
+ *
  * @return None
  */
 void login(){
@@ -482,93 +1201,203 @@ void login(){
 
 /**
  * @brief Displays the list of users.
- * 
+ *
  * @details This function retrieves user data from the database and displays it in a tabular format.
  *          Only users with admin privileges can access this function.
- * 
- * @param None
- * 
- * @return None
+ *
+ * @param session The session running the command.
+ *
+ * @return True on success, false otherwise.
  */
-void displayUsers() {
-    if(userRole != 0){
-        printf("%sYou dont have permission for this action!\n this incident will be reported.\n%s",RED,RESET);
-    }else{
-        sqlite3 *db;
-        sqlite3_stmt *stmt;
-        int return_code;
-
-        // Open the database
-        return_code = sqlite3_open(DATABASE_FILE, &db);
-        if (return_code != SQLITE_OK) {
-            fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-            sqlite3_close(db);
-            return;
-        }
+bool execShowUsers(struct Session *session) {
+    struct Database *database = session->database;
+    FILE *out = session->out;
 
-        // Print the header
-        printf("\n********** List of Users **************\n");
+    if(session->userRole != 0){
+        fprintf(out, "%sYou dont have permission for this action!\n this incident will be reported.\n%s",RED,RESET);
+        session->denied = true;
+        return false;
+    }
 
-        // SQL query to select user data.
-        const char *sql = "SELECT username, email, role FROM users;";
-        return_code = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-        if (return_code != SQLITE_OK) {
-            fprintf(stderr, "Failed to execute statement: %s\n", sqlite3_errmsg(db));
-            sqlite3_close(db);
-            return;
-        }
+    int return_code;
 
-        // Calculate maximum widths for each column.
-        int max_user_width = 0;
-        int max_email_width = 0;
-        int max_role_width = 5;
-        
-        // Iterate over the result set to calculate maximum column widths.
-        while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-            max_user_width = fmax(max_user_width, (int)strlen((const char *)sqlite3_column_text(stmt, 0)));
-            max_email_width = fmax(max_email_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
-        }
+    // Print the header
+    fprintf(out, "\n********** List of Users **************\n");
 
-        // Print column separator
-        printf("%s",BLUE);
-        for(int i =0;i < (max_user_width + max_email_width + max_role_width) + 8;i++){
-            printf("-");
-        }
-        printf("%s\n",RESET);
+    // SQL query to select user data.
+    sqlite3_stmt *stmt = prepareStatement(database, "SELECT username, email, role FROM users;");
+    if (stmt == NULL) {
+        fprintf(out, "Failed to execute statement: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+
+    // Calculate maximum widths for each column.
+    int max_user_width = 0;
+    int max_email_width = 0;
+    int max_role_width = 5;
+
+    // Iterate over the result set to calculate maximum column widths.
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+        max_user_width = fmax(max_user_width, (int)strlen((const char *)sqlite3_column_text(stmt, 0)));
+        max_email_width = fmax(max_email_width, (int)strlen((const char *)sqlite3_column_text(stmt, 1)));
+    }
+
+    // Print column separator
+    fprintf(out, "%s",BLUE);
+    for(int i =0;i < (max_user_width + max_email_width + max_role_width) + 8;i++){
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n",RESET);
+
+    // Print column headers
+    fprintf(out, "%s%-*s | %-*s | %-*s |%s\n",
+        BLUE,
+        max_user_width, "User",
+        max_email_width, "Email",
+        max_role_width,"Role",
+            RESET);
+
+    // Print column separator
+    fprintf(out, "%s",BLUE);
+    for(int i =0;i < (max_user_width + max_email_width + max_role_width) + 8;i++){
+        fprintf(out, "-");
+    }
+    fprintf(out, "%s\n",RESET);
 
-        // Print column headers
-        printf("%s%-*s | %-*s | %-*s |%s\n",
-            BLUE,
-            max_user_width, "User",
-            max_email_width, "Email",
-            max_role_width,"Role",
-                RESET);
+    // Print user data
+    sqlite3_reset(stmt); // Reset the statement to re-execute
+    while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+        fprintf(out, "%-*s | %-*s | %-*s | \n",
+            max_user_width, (const char *)sqlite3_column_text(stmt, 0),
+            max_email_width, (const char *)sqlite3_column_text(stmt, 1),
+            max_role_width, (const char *)sqlite3_column_text(stmt, 2));
 
         // Print column separator
-        printf("%s",BLUE);
         for(int i =0;i < (max_user_width + max_email_width + max_role_width) + 8;i++){
-            printf("-");
-        }
-        printf("%s\n",RESET);
-
-        // Print user data
-        sqlite3_reset(stmt); // Reset the statement to re-execute
-        while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
-            printf("%-*s | %-*s | %-*s | \n",
-                max_user_width, (const char *)sqlite3_column_text(stmt, 0),
-                max_email_width, (const char *)sqlite3_column_text(stmt, 1),
-                max_role_width, (const char *)sqlite3_column_text(stmt, 2));
-
-            // Print column separator
-            for(int i =0;i < (max_user_width + max_email_width + max_role_width) + 8;i++){
-                printf("-");
-            }
-            printf("\n");
+            fprintf(out, "-");
         }
+        fprintf(out, "\n");
+    }
+
+    // Reset the statement.
+    sqlite3_reset(stmt);
+    return true;
+}
+
+/**
+ * @brief Displays the list of users.
+ *
+ * @param None
+ *
+ * @return None
+ */
+void displayUsers() {
+    submitRequest("show users");
+}
+
+//********************************************************************************************************************************************************
+
+/**
+ * @brief Measures how long hashing a password takes with a given cost.
+ *
+ * @param cost Number of PBKDF2 iterations.
+ *
+ * @return The time taken, in milliseconds.
+ */
+double timePassword(int cost) {
+    char hash[PASSWORD_HASH_LENGTH * 2 + 1];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    derivePassword("calibration", "00000000000000000000000000000000", cost, hash);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+}
+
+/**
+ * @brief Stores the password hashing cost, run by commitWrite().
+ *
+ * @param database The connection taking the write.
+ * @param data     The cost, an int.
+ * @param out      Stream receiving the errors.
+ *
+ * @return True if the cost was stored.
+ */
+bool storePasswordCost(struct Database *database, void *data, FILE *out) {
+    sqlite3_stmt *stmt = prepareStatement(database, "INSERT INTO settings (name, value) VALUES ('password_cost', ?) "
+                                                    "ON CONFLICT(name) DO UPDATE SET value=excluded.value;");
+    if (stmt == NULL) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, *(int *)data);
+    int return_code = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    if (return_code != SQLITE_DONE) {
+        fprintf(out, "SQL error: %s\n", sqlite3_errmsg(database->db));
+        return false;
+    }
+    return true;
+}
 
-        // Finalize and close the database connection.
-        sqlite3_finalize(stmt);
-        sqlite3_close(db);   
+/**
+ * @brief Picks the password hashing cost that makes a login take about the target time on this machine.
+ *
+ * @details Doubles the cost until hashing takes long enough to be measured reliably, then scales
+ *          it to the target, all before the write lock is taken for storing it. New passwords are hashed with the chosen cost, and existing ones
+ *          are rehashed at the next login of their user.
+ *
+ * @param session  The session running the command.
+ * @param targetMs Target hashing time in milliseconds.
+ *
+ * @return True if the cost was stored, false otherwise.
+ */
+bool execCalibrateHash(struct Session *session, int targetMs) {
+    FILE *out = session->out;
+
+    if (session->userRole != 0) {
+        fprintf(out, "%sYou don't have permission for this action! This incident will be reported.%s\n", RED, RESET);
+        session->denied = true;
+        return false;
+    }
+    if (targetMs <= 0) {
+        fprintf(out, "%sTarget time must be a positive number of milliseconds.%s\n", RED, RESET);
+        return false;
     }
 
-}
\ No newline at end of file
+    int cost = PASSWORD_COST_MIN;
+    double elapsed = timePassword(cost);
+    while (elapsed < 20 && cost < PASSWORD_COST_MAX / 2) {
+        cost *= 2;
+        elapsed = timePassword(cost);
+    }
+    double scaled = cost * targetMs / (elapsed > 0 ? elapsed : 1);
+    cost = scaled < PASSWORD_COST_MIN ? PASSWORD_COST_MIN : scaled > PASSWORD_COST_MAX ? PASSWORD_COST_MAX : (int)scaled;
+    elapsed = timePassword(cost);
+
+    if (!commitWrite(session, storePasswordCost, &cost)) {
+        return false;
+    }
+
+    fprintf(out, "%sPassword cost set to %d iterations (%.0f ms per login).%s\n", GREEN, cost, elapsed, RESET);
+    fprintf(out, "Existing passwords are rehashed at the next login of their user.\n");
+    return true;
+}
+
+/**
+ * @brief Prompts for a target login time and calibrates the password hashing cost.
+ */
+void calibrateHash() {
+    int targetMs;
+
+    printf("Enter target login time in milliseconds (e.g. %d): ", PASSWORD_TARGET_MS);
+    if (scanf("%d", &targetMs) != 1) {
+        clearInputBuffer();
+        printf("%sInvalid input.%s\n", RED, RESET);
+        return;
+    }
+
+    char request[REQUEST_MAX_LENGTH];
+    snprintf(request, sizeof(request), "calibrate hash\t%d", targetMs);
+    submitRequest(request);
+}
@@ -0,0 +1,357 @@
+/*
+ * File:          bench.c
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   End-to-end benchmark: generates a synthetic shop and times every operation through the
+ *                same request path as the CLI, writing throughput and p50/p99 latencies as JSON.
+ *
+ *                gcc tests/bench.c -o bench -lsqlite3 -lssl -lm -lcrypto -lpthread
+ *                ./bench [--books N] [--rents N] [--skew S] [--ops N] [--scan-ops N] [--seed N]
+ *                        [--db FILE] [--out FILE] [--keep]
+ */
+
+#define BOOKERY_NO_MAIN
+#include "../bookery.c"
+
+// Define structure for the settings of a benchmark run.
+struct BenchOptions {
+    long books;                          // Books generated.
+    long rents;                          // Rents generated.
+    double skew;                         // Zipf exponent of book popularity, 0 for uniform.
+    int ops;                             // Runs of each fast operation.
+    int scanOps;                         // Runs of each operation reading the whole catalog.
+    unsigned int seed;                   // Seed of the random generator.
+    const char *db;                      // Database file, recreated by the run.
+    const char *out;                     // JSON results file.
+    bool keep;                           // Keep the database after the run.
+    double generateSeconds;              // Time taken to generate the data.
+};
+
+// Define structure for the timings of one operation.
+struct BenchResult {
+    const char *name;
+    int count;                           // Runs.
+    int failed;                          // Runs the command reported as failed.
+    double total;                        // Sum of the latencies, in seconds.
+    double *latencies;                   // Latency of every run, in seconds.
+};
+
+// Cumulative popularity of the books, so a uniform number picks a book by Zipf's law.
+double *popularity;
+
+// Receives the output of the timed commands.
+FILE *discard;
+
+const char *genres[] = {"Fiction", "Non-Fiction", "Mystery", "Fantasy", "Science", "History", "Biography", "Poetry"};
+
+/**
+ * @brief Returns the current time in seconds.
+ */
+double now() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Precomputes the cumulative Zipf distribution of book popularity.
+ */
+void setupPopularity(long books, double skew) {
+    popularity = malloc(books * sizeof(*popularity));
+
+    double sum = 0;
+    for (long i = 0; i < books; i++) {
+        sum += 1.0 / pow(i + 1, skew);
+        popularity[i] = sum;
+    }
+    for (long i = 0; i < books; i++) {
+        popularity[i] /= sum;
+    }
+}
+
+/**
+ * @brief Picks a book, popular books more often than others.
+ *
+ * @return Index of the book, from 0.
+ */
+long pickBook(long books) {
+    double target = (double)rand() / RAND_MAX;
+    long low = 0, high = books - 1;
+
+    while (low < high) {
+        long middle = (low + high) / 2;
+        if (popularity[middle] < target) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Fills the database with books and rents, in one transaction.
+ */
+bool generateShop(struct BenchOptions *options) {
+    sqlite3 *db = shopDatabase.db;
+    sqlite3_stmt *author, *genre, *book, *rent;
+
+    sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+    sqlite3_prepare_v2(db, "INSERT INTO authors (id, name) VALUES (?, ?);", -1, &author, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO genres (id, name) VALUES (?, ?);", -1, &genre, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO books (title, author_id, genre_id, price, quantity_available, quantity_rented, "
+                           "quantity_sold, quantity_rented_all, quantity_rented_days) VALUES (?, ?, ?, ?, ?, 0, ?, 0, 0);",
+                       -1, &book, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO rents (title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date) "
+                           "VALUES (?, ?, ?, 1, ?, date('now', ?), date('now', ?));",
+                       -1, &rent, NULL);
+
+    for (int i = 0; i < 8; i++) {
+        sqlite3_bind_int(genre, 1, i + 1);
+        sqlite3_bind_text(genre, 2, genres[i], -1, SQLITE_STATIC);
+        sqlite3_step(genre);
+        sqlite3_reset(genre);
+    }
+
+    char title[MAX_TITLE_LENGTH], authorName[MAX_AUTHOR_LENGTH], name[50], phone[20], rented[20], due[20];
+    for (long i = 0; i < options->books; i++) {
+        // Ten books per author.
+        if (i % 10 == 0) {
+            snprintf(authorName, sizeof(authorName), "Author %05ld", i / 10);
+            sqlite3_bind_int64(author, 1, i / 10 + 1);
+            sqlite3_bind_text(author, 2, authorName, -1, SQLITE_TRANSIENT);
+            sqlite3_step(author);
+            sqlite3_reset(author);
+        }
+        snprintf(title, sizeof(title), "Book %07ld", i);
+        sqlite3_bind_text(book, 1, title, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(book, 2, i / 10 + 1);
+        sqlite3_bind_int(book, 3, i % 8 + 1);
+        sqlite3_bind_double(book, 4, 5 + rand() % 4500 / 100.0);
+        sqlite3_bind_int(book, 5, 1000 + rand() % 9000);
+        sqlite3_bind_int(book, 6, rand() % 500);
+        if (sqlite3_step(book) != SQLITE_DONE) {
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+            return false;
+        }
+        sqlite3_reset(book);
+    }
+
+    for (long i = 0; i < options->rents; i++) {
+        int days = 1 + rand() % 30;
+        int age = rand() % 60;
+        snprintf(title, sizeof(title), "Book %07ld", pickBook(options->books));
+        snprintf(name, sizeof(name), "Customer %ld", i % 100000);
+        snprintf(phone, sizeof(phone), "0%09ld", i % 1000000000);
+        snprintf(rented, sizeof(rented), "-%d days", age);
+        snprintf(due, sizeof(due), "%+d days", days - age);
+        sqlite3_bind_text(rent, 1, title, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(rent, 2, name, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(rent, 3, phone, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(rent, 4, days);
+        sqlite3_bind_text(rent, 5, rented, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(rent, 6, due, -1, SQLITE_TRANSIENT);
+        if (sqlite3_step(rent) != SQLITE_DONE) {
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+            return false;
+        }
+        sqlite3_reset(rent);
+    }
+    sqlite3_finalize(author);
+    sqlite3_finalize(genre);
+    sqlite3_finalize(book);
+    sqlite3_finalize(rent);
+    return sqlite3_exec(db, "COMMIT;", 0, 0, 0) == SQLITE_OK;
+}
+
+/**
+ * @brief Times one run of a request, through the same path as the local CLI.
+ */
+void timeRequest(struct BenchResult *result, const char *request) {
+    double start = now();
+    bool ok = submitRequestTo(request, discard);
+    double elapsed = now() - start;
+
+    result->latencies[result->count++] = elapsed;
+    result->total += elapsed;
+    if (!ok) {
+        result->failed++;
+    }
+}
+
+int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns a percentile of the sorted latencies of a result, in milliseconds.
+ */
+double percentile(struct BenchResult *result, double fraction) {
+    if (result->count == 0) {
+        return 0;
+    }
+    int index = (int)(fraction * (result->count - 1) + 0.5);
+    return result->latencies[index] * 1000;
+}
+
+/**
+ * @brief Runs every operation and returns the number of results.
+ */
+int runOperations(struct BenchOptions *options, struct BenchResult *results) {
+    char request[REQUEST_MAX_LENGTH];
+    int count = 0;
+    const char *fast[] = {"sell", "rent", "recall", "login", NULL};
+    const char *scans[] = {"search", "show books", "show rents", "rent late", "report sales", "report rents", NULL};
+
+    for (int i = 0; fast[i] != NULL; i++) {
+        results[count].name = fast[i];
+        results[count].latencies = calloc(options->ops, sizeof(double));
+        count++;
+    }
+    for (int i = 0; scans[i] != NULL; i++) {
+        results[count].name = scans[i];
+        results[count].latencies = calloc(options->scanOps, sizeof(double));
+        count++;
+    }
+
+    for (int i = 0; i < options->ops; i++) {
+        snprintf(request, sizeof(request), "sell book\tBook %07ld\t1", pickBook(options->books));
+        timeRequest(&results[0], request);
+    }
+    for (int i = 0; i < options->ops; i++) {
+        snprintf(request, sizeof(request), "rent book\tBook %07ld\tBench Customer\t0555000000\t14", pickBook(options->books));
+        timeRequest(&results[1], request);
+    }
+    // Recall generated rents spread over the table, each at most once: stepping by a prime that
+    // doesn't divide the number of rents visits every id before repeating one.
+    long step = options->rents % 1000003 != 0 ? 1000003 : 1;
+    for (int i = 0; i < options->ops; i++) {
+        long id = options->rents > 0 ? 1 + (i * step) % options->rents : 1;
+        snprintf(request, sizeof(request), "rent recall\t%ld", id);
+        timeRequest(&results[2], request);
+    }
+    for (int i = 0; i < options->ops; i++) {
+        timeRequest(&results[3], "login\tbench\tbench-password");
+    }
+
+    for (int i = 0; i < options->scanOps; i++) {
+        snprintf(request, sizeof(request), "search book\tBook %07ld", pickBook(options->books));
+        timeRequest(&results[4], request);
+        timeRequest(&results[5], "show books");
+        timeRequest(&results[6], "show rents");
+        timeRequest(&results[7], "rent late");
+        timeRequest(&results[8], "report sales");
+        timeRequest(&results[9], "report rents");
+    }
+    return count;
+}
+
+/**
+ * @brief Writes the results as JSON and prints a summary.
+ */
+bool writeResults(struct BenchOptions *options, struct BenchResult *results, int count) {
+    FILE *json = fopen(options->out, "w");
+    if (json == NULL) {
+        fprintf(stderr, "Can't write %s.\n", options->out);
+        return false;
+    }
+
+    fprintf(json, "{\n  \"books\": %ld,\n  \"rents\": %ld,\n  \"skew\": %.2f,\n  \"seed\": %u,\n"
+                  "  \"generate_seconds\": %.3f,\n  \"operations\": [\n",
+            options->books, options->rents, options->skew, options->seed, options->generateSeconds);
+    printf("\n%-14s %8s %8s %12s %10s %10s\n", "operation", "runs", "failed", "ops/s", "p50 ms", "p99 ms");
+    for (int i = 0; i < count; i++) {
+        struct BenchResult *result = &results[i];
+        qsort(result->latencies, result->count, sizeof(double), compareDoubles);
+        double throughput = result->total > 0 ? result->count / result->total : 0;
+
+        fprintf(json, "    {\"name\": \"%s\", \"runs\": %d, \"failed\": %d, \"seconds\": %.6f, "
+                      "\"ops_per_second\": %.2f, \"p50_ms\": %.4f, \"p99_ms\": %.4f}%s\n",
+                result->name, result->count, result->failed, result->total, throughput,
+                percentile(result, 0.50), percentile(result, 0.99), i + 1 < count ? "," : "");
+        printf("%-14s %8d %8d %12.1f %10.3f %10.3f\n", result->name, result->count, result->failed, throughput,
+               percentile(result, 0.50), percentile(result, 0.99));
+    }
+    fprintf(json, "  ]\n}\n");
+    fclose(json);
+    printf("\nResults written to %s\n", options->out);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    struct BenchOptions options = {100000, 200000, 1.0, 1000, 10, 1, "bench.db", "bench.json", false, 0};
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--books") == 0 && hasValue) {
+            options.books = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--rents") == 0 && hasValue) {
+            options.rents = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--skew") == 0 && hasValue) {
+            options.skew = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--ops") == 0 && hasValue) {
+            options.ops = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scan-ops") == 0 && hasValue) {
+            options.scanOps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && hasValue) {
+            options.seed = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--db") == 0 && hasValue) {
+            options.db = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && hasValue) {
+            options.out = argv[++i];
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            options.keep = true;
+        } else {
+            fprintf(stderr, "Usage: %s [--books N] [--rents N] [--skew S] [--ops N] [--scan-ops N] [--seed N] "
+                            "[--db FILE] [--out FILE] [--keep]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (options.books < 1) {
+        fprintf(stderr, "At least one book is needed.\n");
+        return 2;
+    }
+    srand(options.seed);
+
+    // Start from an empty database laid out like the shop's.
+    char journal[512];
+    unlink(options.db);
+    snprintf(journal, sizeof(journal), "%s-journal", options.db);
+    unlink(journal);
+    if (openDatabase(&shopDatabase, options.db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) != SQLITE_OK ||
+        initializeDatabase(&shopDatabase) != 0) {
+        return 1;
+    }
+
+    printf("Generating %ld books and %ld rents (skew %.2f)...\n", options.books, options.rents, options.skew);
+    double start = now();
+    setupPopularity(options.books, options.skew);
+    if (!generateShop(&options)) {
+        return 1;
+    }
+    options.generateSeconds = now() - start;
+    printf("Generated in %.1f s.\n", options.generateSeconds);
+
+    // Run everything as an admin, discarding the command output. The fresh database has no users
+    // yet, so the benchmark admin is created by a session that starts out as admin.
+    discard = fopen("/dev/null", "w");
+    openSession(&localSession, &shopDatabase, discard);
+    localSession.userRole = 0;
+    struct User bench = {"bench", "bench-password", "bench@bookery.local", 0};
+    if (!execAddUser(&localSession, &bench) || !submitRequestTo("login\tbench\tbench-password", discard)) {
+        fprintf(stderr, "Failed to set up the benchmark user.\n");
+        return 1;
+    }
+
+    struct BenchResult results[16];
+    memset(results, 0, sizeof(results));
+    int count = runOperations(&options, results);
+    bool written = writeResults(&options, results, count);
+
+    closeDatabase(&shopDatabase);
+    if (!options.keep) {
+        unlink(options.db);
+    }
+    return written ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/*
+ * File:          plan.c
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   Query plan regression test: runs every command once against a populated database, then
+ *                checks with EXPLAIN QUERY PLAN that no statement the commands prepared scans a whole
+ *                table, apart from the listings, searches and catalog load that are meant to.
+ *
+ *                gcc tests/plan.c -o plan -lsqlite3 -lssl -lm -lcrypto -lpthread
+ *                ./plan [--db FILE]
+ */
+
+#define BOOKERY_NO_MAIN
+#include "../bookery.c"
+
+#define PLAN_BOOKS 5000
+#define PLAN_RENTS 20000
+
+// Statements allowed to scan, by a distinctive part of their SQL: they read every row on purpose.
+const char *fullScans[] = {
+    "quantity_rented_days FROM books ORDER BY id;",                       // book catalog load
+    "SELECT id, name FROM authors;",                                      // book catalog load, names
+    "SELECT id, name FROM genres;",                                       // book catalog load, names
+    "return_date FROM rents;",                                            // show rents, rental queue load
+    "FROM rents WHERE title LIKE ? OR Name LIKE ? OR Phone LIKE ?;",      // search rent, substring match
+    "SELECT username, email, role FROM users;",                           // show users
+    "SELECT COUNT(*) FROM users;",                                        // del user, last user check
+    "DELETE FROM books;",                                                 // del allbooks
+    NULL
+};
+
+// Hot statements that must have been checked, so renaming one doesn't silently drop it from the test.
+const char *hotStatements[] = {
+    "SELECT quantity_available FROM books WHERE title=?;",
+    "UPDATE books SET quantity_sold = quantity_sold + ?, quantity_available = quantity_available - ? WHERE title=?;",
+    "FROM json_each(?) AS due CROSS JOIN rents ON rents.id = due.value;",
+    "SELECT return_date FROM rents WHERE id=?;",
+    "SELECT title FROM rents WHERE id=?;",
+    "SELECT role, password, salt, cost FROM users WHERE username=?;",
+    "DELETE FROM sessions WHERE expires <= ?;",
+    "FROM changes WHERE seq > ? ORDER BY seq LIMIT ?;",
+    NULL
+};
+
+// Receives the output of the commands.
+FILE *discard;
+
+/**
+ * @brief Returns whether a statement is one of those allowed to scan.
+ */
+bool fullScanAllowed(const char *sql) {
+    for (int i = 0; fullScans[i] != NULL; i++) {
+        if (strstr(sql, fullScans[i]) != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Runs one request, reporting it if it fails.
+ */
+bool run(const char *request) {
+    if (!submitRequestTo(request, discard)) {
+        fprintf(stderr, "Command failed: %s\n", request);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Fills the database with books, rents and users, like a shop after some use.
+ */
+bool populate(sqlite3 *db) {
+    char sql[256];
+
+    sqlite3_exec(db, "BEGIN; INSERT INTO genres (id, name) VALUES (1, 'Fiction');", 0, 0, 0);
+    for (int i = 0; i < PLAN_BOOKS / 10; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO authors (id, name) VALUES (%d, 'Author %04d');", i + 1, i);
+        if (sqlite3_exec(db, sql, 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+    }
+    for (int i = 0; i < PLAN_BOOKS; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO books (title, author_id, genre_id, price, quantity_available, quantity_rented, "
+                                   "quantity_sold, quantity_rented_all, quantity_rented_days) "
+                                   "VALUES ('Book %05d', %d, 1, 10, 100, 0, %d, 0, 0);", i, i / 10 + 1, i % 50);
+        if (sqlite3_exec(db, sql, 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+    }
+    for (int i = 0; i < PLAN_RENTS; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO rents (title, Name, Phone, quantity_rented, rented_for_days, rent_date, return_date) "
+                                   "VALUES ('Book %05d', 'Customer %d', '0555%06d', 1, 14, date('now', '-%d days'), "
+                                   "date('now', '%+d days'));", i % PLAN_BOOKS, i, i, i % 60, 14 - i % 60);
+        if (sqlite3_exec(db, sql, 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+    }
+    for (int i = 0; i < 100; i++) {
+        snprintf(sql, sizeof(sql), "INSERT INTO users (username, password, email, role) VALUES ('user%d', '', 'user%d@bookery.local', 1);", i, i);
+        if (sqlite3_exec(db, sql, 0, 0, 0) != SQLITE_OK) {
+            return false;
+        }
+    }
+    return sqlite3_exec(db, "COMMIT; ANALYZE;", 0, 0, 0) == SQLITE_OK;
+}
+
+/**
+ * @brief Runs every command once, so each statement it uses gets prepared into the cache.
+ */
+bool runCommands(const char *importFile) {
+    const char *requests[] = {
+        "whoami", "show books", "search book\tBook 00042", "add book\tPlan Book\tPlan Author\tFiction\t9.5\t3",
+        "update book\tPlan Book\tPlan Book\tPlan Author\tFiction\t9.5\t4", "sell book\tBook 00042\t1",
+        "rent book\tBook 00007\tPlan Customer\t0555123456\t14", "rent recall\t1", "rent late", "rent due\t7", "show rents",
+        "search rent\tCustomer 12", "report sales", "report rents", "report genres", "add user\tplanuser\tplan-password\tp@b\t1",
+        "update user\tplanuser\tplanuser2\tp@b\t1", "del user\tplanuser2", "show users", "del book\tPlan Book",
+        "show locks", "stats", "export changes\t0\t10", NULL
+    };
+
+    for (int i = 0; requests[i] != NULL; i++) {
+        if (!run(requests[i])) {
+            return false;
+        }
+    }
+
+    // Session tokens: issue one, log in with it and revoke it.
+    char *token = NULL;
+    size_t size = 0;
+    char request[REQUEST_MAX_LENGTH];
+    FILE *buffer = open_memstream(&token, &size);
+    bool issued = submitRequestTo("new token", buffer);
+    fclose(buffer);
+    token[strcspn(token, "\n")] = '\0';
+    snprintf(request, sizeof(request), "resume\t%s", token);
+    bool resumed = issued && run(request);
+    snprintf(request, sizeof(request), "logout\t%s", token);
+    bool revoked = resumed && run(request);
+    free(token);
+
+    // Logging out ended the session, log in again for the admin commands.
+    snprintf(request, sizeof(request), "import users\t%s", importFile);
+    return revoked && run("login\tplanadmin\tplan-password") && run(request) && run("calibrate hash\t1") &&
+           run("del allbooks");
+}
+
+/**
+ * @brief Prints the query plan of a statement and reports whether it scans a table.
+ */
+bool scans(sqlite3 *db, const char *sql) {
+    char explain[2048];
+    sqlite3_stmt *stmt;
+    bool scan = false;
+
+    snprintf(explain, sizeof(explain), "EXPLAIN QUERY PLAN %s", sql);
+    if (sqlite3_prepare_v2(db, explain, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Can't explain %s: %s\n", sql, sqlite3_errmsg(db));
+        return true;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *detail = (const char *)sqlite3_column_text(stmt, 3);
+        printf("    %s\n", detail);
+        // A table-valued function such as json_each() only yields the values bound to it.
+        if (strncmp(detail, "SCAN ", 5) == 0 && strstr(detail, "VIRTUAL TABLE") == NULL) {
+            scan = true;
+        }
+    }
+    sqlite3_finalize(stmt);
+    return scan;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc == 3 && strcmp(argv[1], "--db") == 0 ? argv[2] : "plan.db";
+    char journal[512], importFile[512];
+
+    unlink(path);
+    snprintf(journal, sizeof(journal), "%s-journal", path);
+    unlink(journal);
+    if (openDatabase(&shopDatabase, path, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) != SQLITE_OK ||
+        initializeDatabase(&shopDatabase) != 0 || !populate(shopDatabase.db)) {
+        fprintf(stderr, "Failed to set up %s.\n", path);
+        return 1;
+    }
+
+    snprintf(importFile, sizeof(importFile), "%s.csv", path);
+    FILE *csv = fopen(importFile, "w");
+    fprintf(csv, "username,email,role,password\nimported,imported@bookery.local,1,imported-password\n");
+    fclose(csv);
+
+    // Run everything as an admin: the fresh database has no admin yet, so one is created by a
+    // session that starts out as admin.
+    discard = fopen("/dev/null", "w");
+    openSession(&localSession, &shopDatabase, discard);
+    localSession.userRole = 0;
+    struct User admin = {"planadmin", "plan-password", "admin@bookery.local", 0};
+    bool ran = execAddUser(&localSession, &admin) && run("login\tplanadmin\tplan-password") &&
+               runCommands(importFile);
+    unlink(importFile);
+    if (!ran) {
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = 0; i < shopDatabase.cached; i++) {
+        const char *sql = shopDatabase.cachedSql[i];
+        printf("%s\n", sql);
+        if (scans(shopDatabase.db, sql) && !fullScanAllowed(sql)) {
+            printf("%sFAIL:%s scans a whole table\n", RED, RESET);
+            failures++;
+        }
+    }
+    for (int i = 0; hotStatements[i] != NULL; i++) {
+        bool checked = false;
+        for (int j = 0; j < shopDatabase.cached && !checked; j++) {
+            checked = strstr(shopDatabase.cachedSql[j], hotStatements[i]) != NULL;
+        }
+        if (!checked) {
+            printf("%sFAIL:%s no statement matches %s\n", RED, RESET, hotStatements[i]);
+            failures++;
+        }
+    }
+
+    printf("\n%d statements checked, %d failures\n", shopDatabase.cached, failures);
+    closeDatabase(&shopDatabase);
+    unlink(path);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+/*
+ * File:          server.c
+ * Authors:       Fuad Alizada, Mehdi Hasanli, Toghrul Abdullazada, Tural Gadirov, Ilham Bakhishov
+ * Date:          May 09, 2024
+ * Description:   Server mode test: starts a server on a fresh database in a child process and runs the
+ *                commands whose slow work is done on a read worker and whose write is handed to the
+ *                writer, through the socket as a till would.
+ *
+ *                gcc tests/server.c -o server -lsqlite3 -lssl -lm -lcrypto -lpthread
+ *                ./server [--db FILE]
+ */
+
+#define BOOKERY_NO_MAIN
+#include "../bookery.c"
+#include <sys/wait.h>
+
+int failures = 0;
+
+/**
+ * @brief Sends one request to the server and checks whether it succeeded and what it printed.
+ *
+ * @param request The request line.
+ * @param ok      Whether the request must succeed.
+ * @param text    Text its output must contain, or NULL.
+ */
+void expect(const char *request, bool ok, const char *text) {
+    char *output = NULL;
+    size_t size = 0;
+    FILE *buffer = open_memstream(&output, &size);
+    bool result = submitRequestTo(request, buffer);
+    fclose(buffer);
+
+    if (result != ok || (text != NULL && strstr(output, text) == NULL)) {
+        printf("%sFAIL:%s %.*s\n%s", RED, RESET, (int)strcspn(request, "\t"), request, output);
+        failures++;
+    } else {
+        printf("ok    %.*s\n", (int)strcspn(request, "\t"), request);
+    }
+    free(output);
+}
+
+/**
+ * @brief Writes a CSV file of users to import.
+ */
+void writeCsv(const char *path, const char *lines) {
+    FILE *csv = fopen(path, "w");
+    fprintf(csv, "username,email,role,password\n%s", lines);
+    fclose(csv);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc == 3 && strcmp(argv[1], "--db") == 0 ? argv[2] : "server-test.db";
+    char socketPath[512], importFile[512], request[REQUEST_MAX_LENGTH];
+    const char *suffixes[] = {"", "-wal", "-shm", "-journal", NULL};
+
+    for (int i = 0; suffixes[i] != NULL; i++) {
+        snprintf(request, sizeof(request), "%s%s", path, suffixes[i]);
+        unlink(request);
+    }
+    snprintf(socketPath, sizeof(socketPath), "%s.sock", path);
+    snprintf(importFile, sizeof(importFile), "%s.csv", path);
+
+    // Create an admin on the fresh database, then leave it to the server.
+    setDatabaseFile(path);
+    if (openShop() != 0) {
+        fprintf(stderr, "Failed to set up %s.\n", path);
+        return 1;
+    }
+    openSession(&localSession, &shopDatabase, stdout);
+    localSession.userRole = 0;
+    struct User admin = {"testadmin", "test-password", "admin@bookery.local", 0};
+    if (!execAddUser(&localSession, &admin)) {
+        return 1;
+    }
+    closeSession(&localSession);
+    closeDatabase(&shopDatabase);
+
+    fflush(stdout);
+    pid_t server = fork();
+    if (server == 0) {
+        freopen("/dev/null", "w", stdout);
+        if (openShop() != 0) {
+            _exit(1);
+        }
+        _exit(runServer(socketPath));
+    }
+
+    // Wait for the server to bind its socket.
+    for (int i = 0; i < 50 && access(socketPath, F_OK) != 0; i++) {
+        usleep(100000);
+    }
+    if (connectServer(socketPath) != 0) {
+        kill(server, SIGTERM);
+        return 1;
+    }
+
+    expect("login\ttestadmin\ttest-password", true, NULL);
+
+    // The read worker hashes, the writer inserts: the users must be there, and usable, afterwards.
+    writeCsv(importFile, "imported1,one@bookery.local,1,imported-password\nimported2,two@bookery.local,1,imported-password\n");
+    snprintf(request, sizeof(request), "import users\t%s", importFile);
+    expect(request, true, "2 users imported.");
+    expect("show users", true, "imported2");
+    expect(request, false, "Line 2: username 'imported1' is already taken.");
+
+    // An empty field is reported by its line instead of shifting the columns after it.
+    writeCsv(importFile, "imported3,three@bookery.local,1,imported-password\nbob,,1,imported-password\n");
+    expect(request, false, "Line 3: empty field.");
+    expect("show users", true, "imported1");
+
+    // Hashing and calibrating run on a read worker too, only their writes on the writer.
+    expect("calibrate hash\t1", true, "Password cost set to");
+    expect("add user\taddeduser\tadded-password\tadded@bookery.local\t1", true, "User added successfully.");
+    expect("add user\taddeduser\tadded-password\tadded@bookery.local\t1", false, "Username 'addeduser' is already taken.");
+
+    expect("login\timported1\timported-password", true, NULL);
+    expect("login\taddeduser\tadded-password", true, NULL);
+
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(importFile);
+    for (int i = 0; suffixes[i] != NULL; i++) {
+        snprintf(request, sizeof(request), "%s%s", path, suffixes[i]);
+        unlink(request);
+    }
+
+    printf("\n%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}